@@ -15,6 +15,7 @@
 #include "csr2block.h"
 #include "blockspmv_cpu.h"
 #include "utils.h"
+#include "tile_partition.h"
 #include "common.h"
 #include "mmio_highlevel.h"
 // #include "./biio2.0/src/biio.h"
@@ -29,6 +30,7 @@ double itsol_norm(double *x, int n, int nthread)
 {
     int i;
     double t = 0.;
+#pragma omp parallel for reduction(+ : t) num_threads(nthread)
     for (i = 0; i < n; i++)
         t += x[i] * x[i];
 
@@ -38,6 +40,7 @@ double itsol_dot(double *x, double *y, int n, int nthread)
 {
     int i;
     double t = 0.;
+#pragma omp parallel for reduction(+ : t) num_threads(nthread)
     for (i = 0; i < n; i++)
         t += x[i] * y[i];
 
@@ -45,6 +48,7 @@ double itsol_dot(double *x, double *y, int n, int nthread)
 }
 void mv(int n, int *Rowptr, int *ColIndex, double *Value, double *x, double *y)
 {
+#pragma omp parallel for
     for (int i = 0; i < n; i++)
     {
         y[i] = 0.0;
@@ -600,8 +604,8 @@ __forceinline__ __global__ void stir_spmv_cuda_kernel_newcsr_nnz_balance_below_t
                 //     //while (d_block_signal[(off + u)] != index_dot);
                 // }
 
-                //下面这个等待保证性能
-                for(u = 0; u < vector_each_warp; u++)
+                // all 2 * vector_each_warp row blocks of the warp's rows, the first half alone let it read q early
+                for(u = 0; u < vector_each_warp * 2; u++)
                 {
                     int off=blki_blc * vector_each_warp*2;
                     //index_dot=iter*d_ori_block_signal[(offset + u)];
@@ -708,8 +712,8 @@ __forceinline__ __global__ void stir_spmv_cuda_kernel_newcsr_nnz_balance_below_t
                 //     //while (d_block_signal[(off + u)] != index_dot);
                 // }
 
-                //下面这个等待保证性能
-                for(u = 0; u < vector_each_warp; u++)
+                // all 2 * vector_each_warp row blocks of the warp's rows, the first half alone let it read q early
+                for(u = 0; u < vector_each_warp * 2; u++)
                 {
                     int off=blki_blc * vector_each_warp*2;
                     //index_dot=iter*d_ori_block_signal[(offset + u)];
@@ -1057,162 +1061,31 @@ int bicgstab(int *RowPtr, int *ColIdx, double *Val, double *rhs, double *x,
     int each_block_nnz = block_nnz;
 
     printf("nnz_total=%d each_block_nnz=%d\n", nnz_total, each_block_nnz);
-    int cnt = 0;
-    int balance_row = 0;
-    int index = 1;
-    
-    int block_per_warp=180;
-    int i = 0;
-    int j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    int step = 0;
-    int cnt_block1=0;
-    int nnz_list[12]={16,32,64,96,128,256,512,1024,2048,4096,nnzR/SM_NUM};
-    while(1)
-    {
-    for(int k=0;k<12;k++)
-    {
-    each_block_nnz=nnz_list[k];
-    i = 0;
-    j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    step = 0;
-    cnt_block1=0;
-    while (i < j)
-    {
-        if (((non_each_block[i] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[i];
-            i++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[i] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            i++;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-        if (((non_each_block[j] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[j];
-            j--;
-            cnt_block1++;
-        }
-        else if (((non_each_block[j] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            j--;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-    }
-    if(index<SM_NUM)
-    break;
-    }
-    printf("index=%d\n");
-    if(index<SM_NUM)
-    break;
-    block_per_warp=block_per_warp*2;
-    }
-    printf("index=%d each_block_nnz=%d\n", index, each_block_nnz);
-    int vector_each_warp_16;
-    int vector_total_16;
+    // merge-path split of the tile sequence into contiguous work units, one per resident warp, or about
+    // block_nnz nnz each when it is given
+    int resident_warps = deviceProp.multiProcessorCount * deviceProp.maxThreadsPerMultiProcessor / WARP_SIZE;
+    tile_partition part;
+    tile_partition_create(&part, matrix->blknnz, tilenum, tile_partition_gpu_nparts(nnz_total, tilenum, resident_warps, block_nnz), 0);
+    int index = part.nparts;
+    each_block_nnz = nnz_total / index;
+    printf("index=%d each_block_nnz=%d max_tiles=%d imbalance=%.3f\n", index, each_block_nnz, part.max_tiles, part.imbalance);
     int vector_each_warp_32;
     int vector_total_32;
-    if (index < tilem)
+    // the row-block-per-warp kernels when every row block gets a warp, the 32-row vector split otherwise
+    int rowblk_warps = tile_partition_gpu_rowblk_warps(tilem);
+    if (index < rowblk_warps)
     {
-        printf("index=%d tilem=%d\n", index, tilem);
-        vector_each_warp_16 = ceil((double)(tilem) / (double)(index));
-        vector_total_16 = tilem / vector_each_warp_16;
-        printf("index=%d tilem=%d vector_each_warp=%d vector_total=%d\n", index, tilem, vector_each_warp_16, vector_total_16);
-        int tilem_32 = ceil((double)tilem / 2);
-        //vector_each_warp_32=ceil((double)(tilem_32)/(double)(index));
-        vector_each_warp_32 = vector_each_warp_16*2;
-        vector_total_32 = tilem_32 / vector_each_warp_32;
-        vector_total_32 = (vector_total_32/WARP_PER_BLOCK)*WARP_PER_BLOCK;
-        //if(vector_total_32%2!=0)
-        //vector_total_32-=1;
+        tile_partition_gpu_vector(index, tilem, &vector_each_warp_32, &vector_total_32);
         printf("index=%d tilem=%d vector_each_warp_32=%d vector_total_32=%d\n", index, tilem, vector_each_warp_32, vector_total_32);
     }
-    // if(index<tilem||index>SM_NUM) return;
-    // if (index > SM_NUM||index==0||tilem==0)
-    //     return;
     int *balance_tile_ptr_new = (int *)malloc(sizeof(int) * (index + 1));
-    memset(balance_tile_ptr_new, 0, sizeof(int) * (index + 1));
+    memcpy(balance_tile_ptr_new, part.part_ptr, sizeof(int) * (index + 1));
     int *balance_tile_ptr_shared_end = (int *)malloc(sizeof(int) * (index + 1));
     memset(balance_tile_ptr_shared_end, 0, sizeof(int) * (index + 1));
-    i = 0;
-    j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    step = 0;
-    cnt_block1=0;
-    while (i < j)
-    {
-        if (((non_each_block[i] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[i];
-            index_each_block_new[step] = index_each_block[i];
-            row_each_block_new[step] = row_each_block[i];
-            non_each_block_new[step] = non_each_block[i];
-            i++;
-            step++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[i] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            index_each_block_new[step] = index_each_block[i];
-            row_each_block_new[step] = row_each_block[i];
-            non_each_block_new[step] = non_each_block[i];
-            i++;
-            step++;
-            balance_tile_ptr_new[index] = step;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-         if (((non_each_block[j] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[j];
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            j--;
-            step++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[j] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            j--;
-            step++;
-            balance_tile_ptr_new[index] = step;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-        if (i == j)
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            step++;
-            balance_tile_ptr_new[index] = step;
-        }
-        if (i > j)
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            balance_tile_ptr_new[index] = step;
-        }
-        // printf("i=%d j=%d step=%d\n",i,j,step);
-    }
+    tile_partition_destroy(&part);
+    memcpy(index_each_block_new, index_each_block, sizeof(int) * (tilenum + 1));
+    memcpy(row_each_block_new, row_each_block, sizeof(int) * (tilenum + 1));
+    memcpy(non_each_block_new, non_each_block, sizeof(int) * (tilenum + 1));
     int *d_balance_tile_ptr_new;
     hipMalloc((void **)&d_balance_tile_ptr_new, sizeof(int) * (index + 1));
     hipMemcpy(d_balance_tile_ptr_new, balance_tile_ptr_new, sizeof(int) * (index + 1), hipMemcpyHostToDevice);
@@ -1395,9 +1268,9 @@ int bicgstab(int *RowPtr, int *ColIdx, double *Val, double *rhs, double *x,
     hipMalloc((void **)&k_val, sizeof(double) * (nnzR));
     hipMemcpy(k_val, Val, sizeof(double) * (nnzR), hipMemcpyHostToDevice);
     mv(n, RowPtr, ColIdx, Val, x, tp);
-    for (i = 0; i < n; i++)
+    for (int i = 0; i < n; i++)
         rg[i] = rhs[i] - tp[i];
-    for (i = 0; i < n; i++)
+    for (int i = 0; i < n; i++)
     {
         rh[i] = rg[i];
         sh[i] = ph[i] = 0.;
@@ -1407,7 +1280,7 @@ int bicgstab(int *RowPtr, int *ColIdx, double *Val, double *rhs, double *x,
     residual = err_rel = itsol_norm(rg, n, nthreads);
     tol = residual * fabs(tol);
     // int cnt_pg=0;
-    for (i = 0; i < n; i++)
+    for (int i = 0; i < n; i++)
         pg[i] = rg[i];
     r1 = itsol_dot(rg, rh, n, nthreads);
     dim3 BlockDim(NUM_THREADS);
@@ -1434,9 +1307,9 @@ int bicgstab(int *RowPtr, int *ColIdx, double *Val, double *rhs, double *x,
     gettimeofday(&t1, NULL);
     {
         int num_blocks_nnz_balance = ceil((double)(index) / (double)(num_threads / WARP_SIZE));
-        if(index>=tilem)
+        if(index>=rowblk_warps)
         {
-            int tilem_new=(tilem/WARP_PER_BLOCK+2)*WARP_PER_BLOCK;
+            int tilem_new=rowblk_warps;
             int re_size=(tilem_new)*BLOCK_SIZE;
             printf("tilem=%d tilem_new=%d tilem/WARP_PER_BLOCK=%d tilem_new/WARP_PER_BLOCK=%d\n",tilem,tilem_new,tilem/WARP_PER_BLOCK,tilem_new/WARP_PER_BLOCK);
             int *d_block_signal_new;
@@ -1631,7 +1504,7 @@ int main(int argc, char **argv)
 {
     int n;
     char *filename = argv[1];
-    int block_nnz = atoi(argv[2]);
+    int block_nnz = argc > 2 ? atoi(argv[2]) : 0;
     int m, n_csr, nnzR, isSymmetric;
     FILE *p = fopen(filename, "r");
     mmio_info(&m,&n,&nnzR,&isSymmetric, filename);
@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "csr2block.h"
+#include "blockspmv_cpu.h"
+#include "utils.h"
+#include "bicgstab_cpu.h"
+#include "reorder.h"
+#include "refine_cpu.h"
+#include "./biio2.0/src/biio.h"
+#include "common.h"
+
+#define epsilon 1e-6
+
+#define IMAX 1000
+
+int main(int argc, char **argv)
+{
+    char *filename = argv[1];
+    int maxiter = argc > 2 ? atoi(argv[2]) : IMAX;
+    int m, n, isSymmetric;
+    MAT_PTR_TYPE nnzR;
+    MAT_PTR_TYPE *RowPtr;
+    int *ColIdx;
+    MAT_VAL_TYPE *Val;
+#if MAT_PTR_64
+    read_Dmatrix(&m, &n, &nnzR, &RowPtr, &ColIdx, &Val, &isSymmetric, filename);
+#else
+    read_Dmatrix_32(&m, &n, &nnzR, &RowPtr, &ColIdx, &Val, &isSymmetric, filename);
+#endif
+    if (m != n)
+    {
+        printf("unequal\n");
+        return 0;
+    }
+#if PRIM_BENCH
+    prim_bench(ColIdx, Val, nnzR < INT_MAX ? (int)nnzR : INT_MAX - 1, PRIM_BENCH);
+#endif
+    int ori = n;
+    MAT_VAL_TYPE *X = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * (n));
+    MAT_VAL_TYPE *Y_golden = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * (m));
+    memset(Y_golden, 0, sizeof(MAT_VAL_TYPE) * (m));
+    for (int i = 0; i < n; i++)
+    {
+        X[i] = 1;
+    }
+    int iter = 0;
+    for (int i = 0; i < n; i++)
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            Y_golden[i] += Val[j] * (ColIdx[j] < n ? X[ColIdx[j]] : 0);
+
+    reorder ro;
+    int tile_size = reorder_tile_size(REORDER, n, ori, RowPtr, ColIdx, blockspmv_cpu_simd_level() == SIMD_AVX512);
+    reorder_create(&ro, REORDER, n, ori, RowPtr, &ColIdx, &Val, tile_size);
+    reorder_forward(&ro, Y_golden, 1);
+#if REFINE
+    refine_solve_cpu(REFINE_BICGSTAB, RowPtr, ColIdx, Val, X, Y_golden, n, &iter, maxiter, epsilon, filename, nnzR, ori, tile_size);
+#else
+    bicgstab_solve_cpu(RowPtr, ColIdx, Val, X, Y_golden, n, &iter, maxiter, epsilon, filename, nnzR, ori, tile_size);
+#endif
+    reorder_backward(&ro, X, 1);
+    reorder_destroy(&ro);
+
+    free(X);
+    free(Y_golden);
+    free(RowPtr);
+    free(ColIdx);
+    free(Val);
+    return 0;
+}
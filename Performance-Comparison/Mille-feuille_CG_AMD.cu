@@ -5,6 +5,7 @@
 #include "csr2block.h"
 #include "blockspmv_cpu.h"
 #include "utils.h"
+#include "tile_partition.h"
 //#include <hipblas.h>
 #include <hip/hip_runtime.h>
 //#include <hipsparse.h>
@@ -1246,7 +1247,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     int rowA = n;
     int colA = ori;
     rowA = (rowA / BLOCK_SIZE) * BLOCK_SIZE;
-    Tile_matrix *matrix = (Tile_matrix *)malloc(sizeof(Tile_matrix));
+    Tile_matrix *matrix = (Tile_matrix *)calloc(1, sizeof(Tile_matrix));
     Tile_create(matrix,
                 rowA, colA, nnzR,
                 RowPtr,
@@ -1532,162 +1533,33 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     // int each_block_nnz = 8;
     // int each_block_nnz=640;
     printf("nnz_total=%d each_block_nnz=%d\n", nnz_total, each_block_nnz);
-    int cnt = 0;
-    int balance_row = 0;
-    int index = 1;
-    int i = 0;
-    int j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    int step = 0;
-    //int block_per_warp=60;//cage12 Dubcova2 Dubcova3
-    //int block_per_warp=70;//poisson3Da
-    int block_per_warp=180;//cage13 //appu 取得性能
-    //int block_per_warp=240; //appu
-    int cnt_block1=0;
-    int nnz_list[12]={16,32,64,96,128,256,512,1024,2048,4096,nnzR/SM_NUM};//2048根據不同的機器不同
-    while(1)
-    {
-    for(int k=0;k<12;k++)
-    {
-    each_block_nnz=nnz_list[k+1];
-    i = 0;
-    j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    step = 0;
-    cnt_block1=0;
-    while (i < j)
-    {
-        if (((non_each_block[i] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[i];
-            i++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[i] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            i++;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-        if (((non_each_block[j] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[j];
-            j--;
-            cnt_block1++;
-        }
-        else if (((non_each_block[j] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            j--;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-    }
-    if(index<SM_NUM&&index!=tilem-1&&index!=tilem+1&&index!=tilem)
-    break;
-    }
-    printf("index=%d\n",index);
-    if(index<SM_NUM&&index!=tilem-1&&index!=tilem+1&&index!=tilem)
-    break;
-    block_per_warp=block_per_warp*2;
-    }   
-    printf("index=%d each_block_nnz=%d\n", index, each_block_nnz);
-    int vector_each_warp_16;
-    int vector_total_16;
+    // merge-path split of the tile sequence into contiguous work units, one per resident warp, or about
+    // block_nnz nnz each when it is given
+    int resident_warps = deviceProp.multiProcessorCount * deviceProp.maxThreadsPerMultiProcessor / WARP_SIZE;
+    tile_partition part;
+    tile_partition_create(&part, matrix->blknnz, tilenum, tile_partition_gpu_nparts(nnz_total, tilenum, resident_warps, block_nnz), 0);
+    int index = part.nparts;
+    each_block_nnz = nnz_total / index;
+    printf("index=%d each_block_nnz=%d max_tiles=%d imbalance=%.3f\n", index, each_block_nnz, part.max_tiles, part.imbalance);
     int vector_each_warp_32;
     int vector_total_32;
-    if (index < tilem)
+    // the row-block-per-warp kernels when every row block gets a warp, the 32-row vector split otherwise
+    int rowblk_warps = tile_partition_gpu_rowblk_warps(tilem);
+    if (index < rowblk_warps)
     {
-        printf("index=%d tilem=%d\n", index, tilem);
-        vector_each_warp_16 = ceil((double)(tilem) / (double)(index));
-        vector_total_16 = tilem / vector_each_warp_16;
-        printf("index=%d tilem=%d vector_each_warp=%d vector_total=%d\n", index, tilem, vector_each_warp_16, vector_total_16);
-        int tilem_32 = ceil((double)tilem / 2);
-        vector_each_warp_32 = vector_each_warp_16*2;
-        vector_total_32 = tilem_32 / vector_each_warp_32;
-        vector_total_32 = (vector_total_32/WARP_PER_BLOCK+1)*WARP_PER_BLOCK;
-        //vector_total_32 = (vector_total_32/WARP_PER_BLOCK)*WARP_PER_BLOCK;
+        tile_partition_gpu_vector(index, tilem, &vector_each_warp_32, &vector_total_32);
         printf("index=%d tilem=%d vector_each_warp_32=%d vector_total_32=%d\n", index, tilem, vector_each_warp_32, vector_total_32);
     }
-    // if(index<tilem||index>6912) return;
-    if (index > SM_NUM)
+    if (tilem == 0)
         return;
     int *balance_tile_ptr_new = (int *)malloc(sizeof(int) * (index + 1));
-    memset(balance_tile_ptr_new, 0, sizeof(int) * (index + 1));
+    memcpy(balance_tile_ptr_new, part.part_ptr, sizeof(int) * (index + 1));
     int *balance_tile_ptr_shared_end = (int *)malloc(sizeof(int) * (index + 1));
     memset(balance_tile_ptr_shared_end, 0, sizeof(int) * (index + 1));
-    i = 0;
-    j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    step = 0;
-    cnt_block1=0;
-    while (i < j)
-    {
-        if (((non_each_block[i] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[i];
-            index_each_block_new[step] = index_each_block[i];
-            row_each_block_new[step] = row_each_block[i];
-            non_each_block_new[step] = non_each_block[i];
-            i++;
-            step++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[i] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            index_each_block_new[step] = index_each_block[i];
-            row_each_block_new[step] = row_each_block[i];
-            non_each_block_new[step] = non_each_block[i];
-            i++;
-            step++;
-            balance_tile_ptr_new[index] = step;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-         if (((non_each_block[j] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[j];
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            j--;
-            step++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[j] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            j--;
-            step++;
-            balance_tile_ptr_new[index] = step;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-        if (i == j)
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            step++;
-            balance_tile_ptr_new[index] = step;
-        }
-        if (i > j)
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            balance_tile_ptr_new[index] = step;
-        }
-        // printf("i=%d j=%d step=%d\n",i,j,step);
-    }
+    tile_partition_destroy(&part);
+    memcpy(index_each_block_new, index_each_block, sizeof(int) * (tilenum + 1));
+    memcpy(row_each_block_new, row_each_block, sizeof(int) * (tilenum + 1));
+    memcpy(non_each_block_new, non_each_block, sizeof(int) * (tilenum + 1));
     int *d_balance_tile_ptr_new;
     hipMalloc((void **)&d_balance_tile_ptr_new, sizeof(int) * (index + 1));
     hipMemcpy(d_balance_tile_ptr_new, balance_tile_ptr_new, sizeof(int) * (index + 1), hipMemcpyHostToDevice);
@@ -1802,7 +1674,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     gettimeofday(&t1, NULL);
     // while (iterations < 1 && snew > threshold)
     {
-        if (index < tilem)
+        if (index < rowblk_warps)
         {
             int num_blocks_nnz_balance = ceil((double)(index) / (double)(num_threads / WARP_SIZE));
             printf("index<tilem\n");
@@ -1878,7 +1750,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
             int num_blocks_nnz_balance = ceil((double)(index) / (double)(num_threads / WARP_SIZE));
             
             //扩大容量
-            int tilem_new=(tilem/WARP_PER_BLOCK+2)*WARP_PER_BLOCK;
+            int tilem_new=rowblk_warps;
             int re_size=(tilem_new)*BLOCK_SIZE;
             printf("tilem=%d tilem_new=%d tilem/WARP_PER_BLOCK=%d tilem_new/WARP_PER_BLOCK=%d\n",tilem,tilem_new,tilem/WARP_PER_BLOCK,tilem_new/WARP_PER_BLOCK);
             int *d_block_signal_new;
@@ -2067,6 +1939,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     hipFree(d_row_each_block);
     hipFree(d_index_each_block);
     hipFree(d_balance_tile_ptr_new);
+    Tile_destroy(matrix);
     free(matrix);
     free(ptroffset1);
     free(ptroffset2);
@@ -2075,15 +1948,6 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     free(blkcoostylerowidx);
     free(blkcoostylerowidx_colstart);
     free(blkcoostylerowidx_colstop);
-    free(tile_ptr);
-    free(tile_columnidx);
-    free(tile_nnz);
-    free(csr_offset);
-    free(csrptr_offset);
-    free(Blockcsr_Val);
-    free(Blockcsr_Val_Low);
-    free(csr_compressedIdx);
-    free(Blockcsr_Ptr);
     free(r);
     free(nonzero_row_new);
     free(blockrowid_new);
@@ -2102,7 +1966,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
 int main(int argc, char **argv)
 {
     char *filename = argv[1];
-    int block_nnz = atoi(argv[2]);
+    int block_nnz = argc > 2 ? atoi(argv[2]) : 0;
     // char *file_rhs = argv[2];
     int m, n, nnzR, isSymmetric;
     mmio_info(&m,&n,&nnzR,&isSymmetric, filename);
@@ -0,0 +1,103 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "csr2block.h"
+#include "blockspmv_cpu.h"
+#include "utils.h"
+#include "cg_cpu.h"
+#include "cg_block_cpu.h"
+#include "cg_pipe_cpu.h"
+#include "reorder.h"
+#include "refine_cpu.h"
+#include "./biio2.0/src/biio.h"
+#include "common.h"
+
+#define epsilon 1e-6
+
+#define IMAX 1000
+
+int main(int argc, char **argv)
+{
+    char *filename = argv[1];
+    int maxiter = argc > 2 ? atoi(argv[2]) : IMAX;
+    int nrhs = argc > 3 ? atoi(argv[3]) : 1;
+    int m, n, isSymmetric;
+    MAT_PTR_TYPE nnzR;
+    MAT_PTR_TYPE *RowPtr;
+    int *ColIdx;
+    MAT_VAL_TYPE *Val;
+#if MAT_PTR_64
+    read_Dmatrix(&m, &n, &nnzR, &RowPtr, &ColIdx, &Val, &isSymmetric, filename);
+#else
+    read_Dmatrix_32(&m, &n, &nnzR, &RowPtr, &ColIdx, &Val, &isSymmetric, filename);
+#endif
+    if (m != n)
+    {
+        printf("unequal\n");
+        return 0;
+    }
+#if PRIM_BENCH
+    prim_bench(ColIdx, Val, nnzR < INT_MAX ? (int)nnzR : INT_MAX - 1, PRIM_BENCH);
+#endif
+    int ori = n;
+    int iter = 0;
+    if (nrhs > 1)
+    {
+        // load case j has x_j(i) = 1 + j / (i + 1), the right-hand sides are interleaved
+        MAT_VAL_TYPE *X = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * n * nrhs);
+        MAT_VAL_TYPE *Y_golden = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * m * nrhs);
+        memset(Y_golden, 0, sizeof(MAT_VAL_TYPE) * m * nrhs);
+        for (int i = 0; i < n; i++)
+            for (int j = 0; j < nrhs; j++)
+                X[i * nrhs + j] = 1 + (double)j / (i + 1);
+        for (int i = 0; i < n; i++)
+            for (MAT_PTR_TYPE k = RowPtr[i]; k < RowPtr[i + 1]; k++)
+                if (ColIdx[k] < n)
+                    for (int j = 0; j < nrhs; j++)
+                        Y_golden[i * nrhs + j] += Val[k] * X[ColIdx[k] * nrhs + j];
+
+        reorder ro;
+        int tile_size = reorder_tile_size(REORDER, n, ori, RowPtr, ColIdx, 0);
+        reorder_create(&ro, REORDER, n, ori, RowPtr, &ColIdx, &Val, tile_size);
+        reorder_forward(&ro, Y_golden, nrhs);
+        cg_solve_block_cpu(RowPtr, ColIdx, Val, X, Y_golden, n, nrhs, &iter, maxiter, epsilon, filename, nnzR, ori, tile_size);
+        reorder_backward(&ro, X, nrhs);
+        reorder_destroy(&ro);
+
+        free(X);
+        free(Y_golden);
+    }
+    else
+    {
+        MAT_VAL_TYPE *X = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * (n));
+        MAT_VAL_TYPE *Y_golden = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * (m));
+        memset(Y_golden, 0, sizeof(MAT_VAL_TYPE) * (m));
+        for (int i = 0; i < n; i++)
+        {
+            X[i] = 1;
+        }
+        for (int i = 0; i < n; i++)
+            for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+                Y_golden[i] += Val[j] * (ColIdx[j] < n ? X[ColIdx[j]] : 0);
+
+        reorder ro;
+        int tile_size = reorder_tile_size(REORDER, n, ori, RowPtr, ColIdx, blockspmv_cpu_simd_level() == SIMD_AVX512);
+        reorder_create(&ro, REORDER, n, ori, RowPtr, &ColIdx, &Val, tile_size);
+        reorder_forward(&ro, Y_golden, 1);
+#if REFINE
+        refine_solve_cpu(REFINE_CG, RowPtr, ColIdx, Val, X, Y_golden, n, &iter, maxiter, epsilon, filename, nnzR, ori, tile_size);
+#elif CG_PIPELINED
+        cg_solve_pipe_cpu(RowPtr, ColIdx, Val, X, Y_golden, n, &iter, maxiter, epsilon, filename, nnzR, ori, tile_size);
+#else
+        cg_solve_cpu(RowPtr, ColIdx, Val, X, Y_golden, n, &iter, maxiter, epsilon, filename, nnzR, ori, tile_size);
+#endif
+        reorder_backward(&ro, X, 1);
+        reorder_destroy(&ro);
+
+        free(X);
+        free(Y_golden);
+    }
+    free(RowPtr);
+    free(ColIdx);
+    free(Val);
+    return 0;
+}
@@ -4,6 +4,7 @@
 #include "csr2block.h"
 #include "blockspmv_cpu.h"
 #include "utils.h"
+#include "tile_partition.h"
 #include <cublas_v2.h>
 #include <cuda_runtime.h>
 #include <cusparse.h>
@@ -2137,9 +2138,10 @@ __forceinline__ __global__ void stir_spmv_cuda_kernel_newcsr_nnz_balance_below_t
             //     d_y_d[global_id] = 0.0;
             // }
             //__threadfence_system();
-            if (global_id < tilem)
+            // strided over the balance_row warps, there may be fewer of their threads than row blocks
+            for (int b = global_id; b < tilem; b += balance_row * WARP_SIZE)
             {
-                d_block_signal[global_id] = d_ori_block_signal[global_id]; //放在这里 开maxrregcount=32不会卡死 但是寄存器占用率会变成50%
+                d_block_signal[b] = d_ori_block_signal[b]; //放在这里 开maxrregcount=32不会卡死 但是寄存器占用率会变成50%
             }
             __threadfence();
             //__threadfence_system();
@@ -2197,8 +2199,8 @@ __forceinline__ __global__ void stir_spmv_cuda_kernel_newcsr_nnz_balance_below_t
                 //     //while (d_block_signal[(off + u)] != index_dot);
                 // }
 
-                //下面这个等待保证性能
-                for(u = 0; u < vector_each_warp; u++)
+                // all 2 * vector_each_warp row blocks of the warp's rows, the first half alone let it read q early
+                for(u = 0; u < vector_each_warp * 2; u++)
                 {
                     int off=blki_blc * vector_each_warp*2;
                     //index_dot=iter*d_ori_block_signal[(offset + u)];
@@ -3985,7 +3987,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     int rowA = n;
     int colA = ori;
     rowA = (rowA / BLOCK_SIZE) * BLOCK_SIZE;
-    Tile_matrix *matrix = (Tile_matrix *)malloc(sizeof(Tile_matrix));
+    Tile_matrix *matrix = (Tile_matrix *)calloc(1, sizeof(Tile_matrix));
     Tile_create(matrix,
                 rowA, colA, nnzR,
                 RowPtr,
@@ -4265,223 +4267,33 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     // int each_block_nnz = 8;
     // int each_block_nnz=640;
     printf("nnz_total=%d each_block_nnz=%d\n", nnz_total, each_block_nnz);
-    int cnt = 0;
-    int balance_row = 0;
-    int index = 1;
-    // int block_per_warp=248;
-    // int cnt_block1=0;
-    // 朴素的划分方式
-    //  for (int i = 0; i < tilenum; i++) {
-    //      cnt+=non_each_block[i];
-    //      cnt_block1+=1;
-    //      //printf("nnz=%d ", non_each_block[i]);
-    //      if(cnt>=each_block_nnz||cnt_block1>=block_per_warp)
-    //      {
-    //          //printf("cnt=%d\n",cnt);
-    //          balance_row++;
-    //          cnt=0;
-    //          cnt_block1=0;
-    //      }
-    //     //  if(cnt<each_block_nnz&&i==tilenum-1&&cnt!=0)
-    //     //  {
-    //     //      balance_row++;
-    //     //  }
-    //     if(cnt<each_block_nnz&&i==tilenum-1&&cnt!=0&&cnt_block1<block_per_warp)
-    //     {
-    //         balance_row++;
-    //     }
-        
-    //  }
-    //  printf("balance_row=%d\n",balance_row);
-    //  int *balance_tile_ptr=(int *)malloc(sizeof(int)*(balance_row+1));
-    //  memset(balance_tile_ptr,0,sizeof(int)*(balance_row+1));
-    //  cnt=0;
-    //  cnt_block1=0;
-    //  for (int i = 0; i < tilenum; i++) {
-    //      //printf("%d\n",non_each_block[i]);
-    //      cnt+=non_each_block[i];
-    //      cnt_block1+=1;
-
-    //      if(cnt>=each_block_nnz||cnt_block1>=block_per_warp)
-    //      {
-    //          balance_tile_ptr[index]=i+1;
-    //          index++;
-    //          cnt=0;
-    //          cnt_block1=0;
-    //      }
-    //      if(cnt<each_block_nnz&&i==tilenum-1&&cnt!=0&&cnt_block1<block_per_warp)
-    //      {
-    //          balance_tile_ptr[index]=i+1;
-    //      }
-    //  }
-    //  for (int i = 0; i < index; i++)
-    //  {
-    //     cnt=0;
-    //     for (int j = balance_tile_ptr[i]; j < balance_tile_ptr[i + 1]; j++)
-    //     {
-    //         cnt += non_each_block[j];
-    //         //int blkj=index_each_block[j];
-    //         //printf("%d ",tile_columnidx[blkj]);
-    //     }
-    //     printf("i=%d nnz_each_block=%d block_num=%d\n",i,cnt,balance_tile_ptr[i+1]-balance_tile_ptr[i]);
-    //     //printf("\n");
-    //  }
-    //  printf("index=%d\n",index);
-    // 使用双指针的方式 重新进行分配
-    //int block_per_warp=60;//cage12 Dubcova2 Dubcova3
-    //int block_per_warp=70;//poisson3Da
-    //int block_per_warp=150;
-    int block_per_warp=180;//cage13 //appu 取得性能
-    //int block_per_warp=240; //appu
-    //block_per_warp=240;
-    int i = 0;
-    int j = tilenum - 1;
-    int step = 0;
-    int cnt_block1=0;
-    //block_per_warp=4000;
-    // int nnz_list[12]={16,32,64,96,128,256,512,1024,2048,4096,nnzR/6912};
-    // while(1)
-    // {
-    // for(int k=0;k<12;k++)
-    // {
-    // each_block_nnz=nnz_list[k];
-    // i = 0;
-    // j = tilenum - 1;
-    // cnt = 0;
-    // index = 1;
-    // step = 0;
-    // cnt_block1=0;
-    while (i < j)
-    {
-        if (((non_each_block[i] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[i];
-            i++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[i] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            i++;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-        if (((non_each_block[j] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[j];
-            j--;
-            cnt_block1++;
-        }
-        else if (((non_each_block[j] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            j--;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-    }
-    // if(index<6912)
-    // break;
-    // }
-    // printf("index=%d\n");
-    // if(index<6912)
-    // break;
-    // block_per_warp=block_per_warp*2;
-    // }
-    printf("index=%d each_block_nnz=%d\n", index, each_block_nnz);
-    int vector_each_warp_16;
-    int vector_total_16;
+    // merge-path split of the tile sequence into contiguous work units, one per resident warp, or about
+    // block_nnz nnz each when it is given
+    int resident_warps = deviceProp.multiProcessorCount * deviceProp.maxThreadsPerMultiProcessor / WARP_SIZE;
+    tile_partition part;
+    tile_partition_create(&part, matrix->blknnz, tilenum, tile_partition_gpu_nparts(nnz_total, tilenum, resident_warps, block_nnz), 0);
+    int index = part.nparts;
+    each_block_nnz = nnz_total / index;
+    printf("index=%d each_block_nnz=%d max_tiles=%d imbalance=%.3f\n", index, each_block_nnz, part.max_tiles, part.imbalance);
     int vector_each_warp_32;
     int vector_total_32;
-    if (index < tilem)
+    // the row-block-per-warp kernels when every row block gets a warp, the 32-row vector split otherwise
+    int rowblk_warps = tile_partition_gpu_rowblk_warps(tilem);
+    if (index < rowblk_warps)
     {
-        printf("index=%d tilem=%d\n", index, tilem);
-        vector_each_warp_16 = ceil((double)(tilem) / (double)(index));
-        vector_total_16 = tilem / vector_each_warp_16;
-        printf("index=%d tilem=%d vector_each_warp=%d vector_total=%d\n", index, tilem, vector_each_warp_16, vector_total_16);
-        int tilem_32 = ceil((double)tilem / 2);
-        vector_each_warp_32 = vector_each_warp_16*2;
-        vector_total_32 = tilem_32 / vector_each_warp_32;
-        vector_total_32 = (vector_total_32/WARP_PER_BLOCK+1)*WARP_PER_BLOCK;
-        //vector_total_32 = (vector_total_32/WARP_PER_BLOCK)*WARP_PER_BLOCK;
+        tile_partition_gpu_vector(index, tilem, &vector_each_warp_32, &vector_total_32);
         printf("index=%d tilem=%d vector_each_warp_32=%d vector_total_32=%d\n", index, tilem, vector_each_warp_32, vector_total_32);
     }
-    // if(index<tilem||index>6912) return;
-    if (index > 6912||index==0||tilem==0)
+    if (tilem == 0)
         return;
     int *balance_tile_ptr_new = (int *)malloc(sizeof(int) * (index + 1));
-    memset(balance_tile_ptr_new, 0, sizeof(int) * (index + 1));
+    memcpy(balance_tile_ptr_new, part.part_ptr, sizeof(int) * (index + 1));
     int *balance_tile_ptr_shared_end = (int *)malloc(sizeof(int) * (index + 1));
     memset(balance_tile_ptr_shared_end, 0, sizeof(int) * (index + 1));
-    i = 0;
-    j = tilenum - 1;
-    cnt = 0;
-    index = 1;
-    step = 0;
-    cnt_block1=0;
-    while (i < j)
-    {
-        if (((non_each_block[i] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[i];
-            index_each_block_new[step] = index_each_block[i];
-            row_each_block_new[step] = row_each_block[i];
-            non_each_block_new[step] = non_each_block[i];
-            i++;
-            step++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[i] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            index_each_block_new[step] = index_each_block[i];
-            row_each_block_new[step] = row_each_block[i];
-            non_each_block_new[step] = non_each_block[i];
-            i++;
-            step++;
-            balance_tile_ptr_new[index] = step;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-         if (((non_each_block[j] + cnt) < each_block_nnz)&&((cnt_block1+1)<block_per_warp))
-        {
-            cnt += non_each_block[j];
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            j--;
-            step++;
-            cnt_block1++;
-        }
-        else if (((non_each_block[j] + cnt) >= each_block_nnz)||((cnt_block1+1)>=block_per_warp))
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            j--;
-            step++;
-            balance_tile_ptr_new[index] = step;
-            index++;
-            cnt = 0;
-            cnt_block1=0;
-        }
-        if (i == j)
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            step++;
-            balance_tile_ptr_new[index] = step;
-        }
-        if (i > j)
-        {
-            index_each_block_new[step] = index_each_block[j];
-            row_each_block_new[step] = row_each_block[j];
-            non_each_block_new[step] = non_each_block[j];
-            balance_tile_ptr_new[index] = step;
-        }
-        // printf("i=%d j=%d step=%d\n",i,j,step);
-    }
+    tile_partition_destroy(&part);
+    memcpy(index_each_block_new, index_each_block, sizeof(int) * (tilenum + 1));
+    memcpy(row_each_block_new, row_each_block, sizeof(int) * (tilenum + 1));
+    memcpy(non_each_block_new, non_each_block, sizeof(int) * (tilenum + 1));
     // 朴素的划分方式
     //  int *d_balance_tile_ptr;
     //  cudaMalloc((void **)&d_balance_tile_ptr, sizeof(int)*(balance_row+1));
@@ -4662,7 +4474,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
         //                                                                         signal_dot,signal_final,signal_final1,d_ori_block_signal,
         //                                                                        k_alpha,k_snew,k_x,k_r,k_sold,k_beta,k_threshold,
         //                                                                         d_balance_tile_ptr,d_row_each_block,d_index_each_block,balance_row,d_non_each_block_offset);
-        if (index < tilem)
+        if (index < rowblk_warps)
         {
             int num_blocks_nnz_balance = ceil((double)(index) / (double)(num_threads / WARP_SIZE));
             cudaMemset(d_block_signal,0,sizeof(int) * (tilem + 1));
@@ -4735,8 +4547,6 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
         else
         {
             printf("index>tilem\n");
-            if(index==tilem)
-            index=tilem+1;
             // 经过双指针重新分配 每个warp计算固定的非零元数目 待修改寄存器的占用率为62.5%
             cudaMemset(d_block_signal,0,sizeof(int) * (tilem + 1));
             int num_blocks_nnz_balance = ceil((double)(index) / (double)(num_threads / WARP_SIZE));
@@ -4761,7 +4571,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
             //                                                                        d_balance_tile_ptr_new,d_row_each_block,d_index_each_block,index,d_non_each_block_offset,d_balance_tile_ptr_shared_end);
             //tilem=(tilem/WARP_PER_BLOCK)*WARP_PER_BLOCK;
             //扩大容量
-            int tilem_new=(tilem/WARP_PER_BLOCK+2)*WARP_PER_BLOCK;
+            int tilem_new=rowblk_warps;
             int re_size=(tilem_new)*BLOCK_SIZE;
             printf("tilem=%d tilem_new=%d tilem/WARP_PER_BLOCK=%d tilem_new/WARP_PER_BLOCK=%d\n",tilem,tilem_new,tilem/WARP_PER_BLOCK,tilem_new/WARP_PER_BLOCK);
             int *d_block_signal_new;
@@ -4916,6 +4726,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     cudaFree(d_ptroffset2);
     cudaFree(d_x);
     cudaFree(d_y);
+    Tile_destroy(matrix);
     free(matrix);
     free(ptroffset1);
     free(ptroffset2);
@@ -4924,20 +4735,11 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     free(blkcoostylerowidx);
     free(blkcoostylerowidx_colstart);
     free(blkcoostylerowidx_colstop);
-    free(tile_ptr);
-    free(tile_columnidx);
-    free(tile_nnz);
-    free(csr_offset);
-    free(csrptr_offset);
-    free(Blockcsr_Val);
-    free(Blockcsr_Val_Low);
-    free(csr_compressedIdx);
-    free(Blockcsr_Ptr);
 }
 int main(int argc, char **argv)
 {
     char *filename = argv[1];
-    int block_nnz = atoi(argv[2]);
+    int block_nnz = argc > 2 ? atoi(argv[2]) : 0;
     // char *file_rhs = argv[2];
     int m, n, nnzR, isSymmetric;
     int *RowPtr;
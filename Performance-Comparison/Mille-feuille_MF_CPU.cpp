@@ -0,0 +1,127 @@
+#include <stdio.h>
+#include <sys/time.h>
+#include "utils.h"
+#include "mf_solver.h"
+#include "./biio2.0/src/biio.h"
+#include "common.h"
+
+#define epsilon 1e-6
+
+#define IMAX 1000
+
+// the true residual may trail the recurrence one by the rounding of the packed tiles
+#define RES_SLACK 100
+
+// ||b - Ax|| / ||b|| on the CSR input
+double mf_true_relres(int n, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *b, double *x)
+{
+    double rr = 0, bb = 0;
+    for (int i = 0; i < n; i++)
+    {
+        double r = b[i];
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            r -= Val[j] * x[ColIdx[j]];
+        rr += r * r;
+        bb += b[i] * b[i];
+    }
+    return bb > 0 ? sqrt(rr / bb) : sqrt(rr);
+}
+
+// solve with opts and check the solution against the CSR, returns 1 when it holds
+int mf_check(mf_handle *h, mf_opts *opts, int n, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *b, double *x, const char *step)
+{
+    const char *names[] = {"cg", "cg_pipe", "bicgstab"};
+    if (!opts->use_x0)
+        memset(x, 0, sizeof(double) * n);
+    int iter = mf_solve(h, b, x, opts);
+    double relres = mf_true_relres(n, RowPtr, ColIdx, Val, b, x);
+    int ok = iter >= 0 && iter < opts->maxiter && relres <= RES_SLACK * opts->tol;
+    printf("%s method=%s use_x0=%d iter=%d relres=%e true_relres=%e time_solve=%.3f ms %s\n", step, names[opts->method], opts->use_x0, iter, h->relres,
+           relres, h->time_solve, ok ? "PASS" : "FAIL");
+    return ok;
+}
+
+// mf_solver.h end to end: one mf_setup, repeated mf_solve calls with every method, from zero and from the
+// previous x, then mf_update with values that the packed tiles no longer hold and the same solves again.
+// CG runs only on symmetric input. Exits with the number of failed checks
+int main(int argc, char **argv)
+{
+    char *filename = argv[1];
+    int maxiter = argc > 2 ? atoi(argv[2]) : IMAX;
+    int m, n, isSymmetric;
+    MAT_PTR_TYPE nnzR;
+    MAT_PTR_TYPE *RowPtr;
+    int *ColIdx;
+    MAT_VAL_TYPE *Val;
+#if MAT_PTR_64
+    read_Dmatrix(&m, &n, &nnzR, &RowPtr, &ColIdx, &Val, &isSymmetric, filename);
+#else
+    read_Dmatrix_32(&m, &n, &nnzR, &RowPtr, &ColIdx, &Val, &isSymmetric, filename);
+#endif
+    if (m != n)
+    {
+        printf("unequal\n");
+        return 0;
+    }
+    double *x = (double *)malloc(sizeof(double) * n);
+    double *b = (double *)malloc(sizeof(double) * n);
+    for (int i = 0; i < n; i++)
+    {
+        b[i] = 0;
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            b[i] += Val[j];
+    }
+
+    mf_handle *h = mf_setup(n, RowPtr, ColIdx, Val, nnzR, filename);
+    printf("mf_setup n=%d nnzR=%lld tile_size=%d tile_cache=%s time_setup=%.3f ms\n", h->n, (long long)nnzR, h->op.tile_size,
+           h->op.cache_state == TILE_CACHE_OK ? "hit" : "miss", h->op.time_setup);
+    mf_opts opts = mf_opts_default();
+    opts.maxiter = maxiter;
+    opts.tol = epsilon;
+    int first_method = isSymmetric ? MF_CG : MF_BICGSTAB;
+    int failed = 0;
+    for (int method = first_method; method <= MF_BICGSTAB; method++)
+    {
+        opts.method = method;
+        opts.use_x0 = 0;
+        failed += !mf_check(h, &opts, n, RowPtr, ColIdx, Val, b, x, "solve");
+        failed += !mf_check(h, &opts, n, RowPtr, ColIdx, Val, b, x, "solve");
+        opts.use_x0 = 1;
+        failed += !mf_check(h, &opts, n, RowPtr, ColIdx, Val, b, x, "solve");
+    }
+
+#if TILE_REFRESH
+    // 1.5 A + I / 3 keeps a symmetric positive definite A so, and most packed tiles need a wider class for it
+    MAT_VAL_TYPE *Val_new = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * nnzR);
+    for (int i = 0; i < n; i++)
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            Val_new[j] = 1.5 * Val[j] + (ColIdx[j] == i ? 1.0 / 3 : 0);
+    for (int step = 0; step < 2; step++)
+    {
+        // the new values, then back to the old ones in the widened tiles
+        MAT_VAL_TYPE *Val_step = step ? Val : Val_new;
+        int update = mf_update(h, Val_step);
+        printf("mf_update %s\n", update == 0 ? "PASS" : "FAIL");
+        failed += update != 0;
+        for (int method = first_method; method <= MF_BICGSTAB; method++)
+        {
+            // from the solution for the previous values first
+            opts.method = method;
+            opts.use_x0 = 1;
+            failed += !mf_check(h, &opts, n, RowPtr, ColIdx, Val_step, b, x, "update");
+            opts.use_x0 = 0;
+            failed += !mf_check(h, &opts, n, RowPtr, ColIdx, Val_step, b, x, "update");
+        }
+    }
+    free(Val_new);
+#endif
+    printf("mf_solver %s, %d failed\n", failed ? "FAIL" : "PASS", failed);
+
+    mf_destroy(h);
+    free(x);
+    free(b);
+    free(RowPtr);
+    free(ColIdx);
+    free(Val);
+    return failed;
+}
@@ -0,0 +1,115 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+
+#include "common.h"
+#include <sys/mman.h>
+#include <unistd.h>
+
+// Bump allocator for the setup arrays. One anonymous mapping is sized up front and handed out in 64-byte
+// aligned pieces; there is no per-array free, the whole arena goes at once. Fresh pages come zeroed from the
+// kernel and are only backed on first touch, by the thread that writes them, so nothing is memset for zero
+// and untouched tails cost no memory. With ARENA_HUGEPAGE the mapping asks for transparent huge pages,
+// one fault per 2 MB instead of per 4 KB. A mapping that fails falls back to an aligned heap block.
+#define ARENA_ALIGN 64
+
+typedef struct
+{
+    unsigned char *base;
+    size_t size;
+    size_t used;
+    int mapped; // base is an mmap, not a heap block
+} arena;
+
+static inline size_t arena_bytes(size_t bytes)
+{
+    return (bytes + ARENA_ALIGN - 1) / ARENA_ALIGN * ARENA_ALIGN;
+}
+
+void arena_create(arena *a, size_t size)
+{
+    a->size = arena_bytes(size > 0 ? size : 1);
+    a->used = 0;
+    void *p = mmap(NULL, a->size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    a->mapped = p != MAP_FAILED;
+    if (a->mapped)
+    {
+#if ARENA_HUGEPAGE && defined(MADV_HUGEPAGE)
+        madvise(p, a->size, MADV_HUGEPAGE);
+#endif
+        a->base = (unsigned char *)p;
+    }
+    else
+    {
+        if (posix_memalign(&p, ARENA_ALIGN, a->size) != 0)
+            p = NULL;
+        if (p)
+            memset(p, 0, a->size);
+        a->base = (unsigned char *)p;
+    }
+}
+
+void arena_destroy(arena *a)
+{
+    if (a->base && a->mapped)
+        munmap(a->base, a->size);
+    else
+        free(a->base);
+    a->base = NULL;
+    a->size = 0;
+    a->used = 0;
+}
+
+// bytes from the arena, NULL when it is full
+static inline void *arena_alloc(arena *a, size_t bytes)
+{
+    size_t len = arena_bytes(bytes);
+    if (a->base == NULL || a->used + len > a->size)
+        return NULL;
+    void *p = a->base + a->used;
+    a->used += len;
+    return p;
+}
+
+// give back everything allocated since arena_mark returned mark
+static inline size_t arena_mark(arena *a)
+{
+    return a->used;
+}
+
+static inline void arena_rewind(arena *a, size_t mark)
+{
+    a->used = mark;
+}
+
+// an empty arena that holds at least size bytes, remapped only when it has to grow. Reused pages keep what
+// was written to them, so scratch taken from here is not zero
+void arena_reserve(arena *a, size_t size)
+{
+    a->used = 0;
+    if (a->base && a->size >= size)
+        return;
+    arena_destroy(a);
+    arena_create(a, size);
+}
+
+// return the whole pages of an array no longer needed to the kernel; the arena keeps the address range
+void arena_discard(arena *a, void *p, size_t bytes)
+{
+    if (!a->mapped || p == NULL)
+        return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)p + page - 1) / page * page;
+    uintptr_t stop = ((uintptr_t)p + bytes) / page * page;
+    if (stop > start)
+        madvise((void *)start, stop - start, MADV_DONTNEED);
+}
+
+// scratch shared by every setup in the process: Tile_create reserves and rewinds it, so repeated setups
+// (mf_setup in a time-stepping loop) find its pages already backed
+arena *setup_scratch()
+{
+    static arena scratch = {NULL, 0, 0, 0};
+    return &scratch;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef _BICGSTAB_CPU_H_
+#define _BICGSTAB_CPU_H_
+
+#include "common.h"
+#include "cg_cpu.h"
+
+// BiCGSTAB on op in one persistent parallel region. Each thread owns a row-block range of every vector, the
+// two SpMVs carry their dot products (rh.v, then t.s and t.t) and the vector updates of yminus_mult,
+// yminus_mult_new and yminus_final take one sweep each, the new rh.r and r.r ride on the x and r sweep.
+// Four barriers per iteration: after each SpMV and before each SpMV reads p or s. Starts from x0 (zero when
+// NULL), stops at ||r|| <= tol ||b|| or maxiter; x gets the solution and *res the final r.r.
+int bicgstab_cpu_iterate(cpu_tile_op *op, double *b, double *x, double *x0, int maxiter, double tol, double *res)
+{
+    Tile_matrix *matrix = op->matrix;
+    int rowA = op->rowA;
+    int tile_size = op->tile_size;
+    int nthreads = op->nthreads;
+    int *rowblk_start = op->rowblk_start;
+    double *k_x = op->vec[0];
+    double *k_rg = op->vec[1];
+    double *k_rh = op->vec[2];
+    double *k_pg = op->vec[3];
+    double *k_sg = op->vec[4];
+    double *k_vg = op->vec[5];
+    double *k_tg = op->vec[6];
+    // rh.v, then t.s and t.t, then rh.r and r.r, each in its own slot of the thread's PARTIAL_STRIDE line
+    double *dot_partial = op->partial[0];
+
+    // r = b - Ax, rh = r and p = r
+    double threshold = tol * tol * cpu_tile_op_start(op, 7, x0, b);
+    memcpy(k_rh, k_rg, sizeof(double) * rowA);
+    memcpy(k_pg, k_rg, sizeof(double) * rowA);
+    double s0 = 0;
+    for (int i = 0; i < rowA; i++)
+        s0 += k_rg[i] * k_rg[i];
+    double residual = s0;
+
+    cpu_signal signal_dot = {0, 0};
+    cpu_signal signal_final = {0, 0};
+    int iterations = 0;
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = rowblk_start[tid];
+        int blk_stop = rowblk_start[tid + 1];
+        int row_start = blk_start * tile_size;
+        int row_stop = blk_stop * tile_size < rowA ? blk_stop * tile_size : rowA;
+        double *partial = dot_partial + tid * PARTIAL_STRIDE;
+        double r1 = s0;
+        double residual_local = s0;
+        int iter_local = 0;
+
+        while (iter_local < maxiter && residual_local > threshold)
+        {
+            // v = Ap, rh.v
+            partial[0] = cpu_tile_op_spmv(op, blk_start, blk_stop, k_pg, k_vg, k_rh);
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // alpha = r1 / rh.v, s = r - alpha v
+            double rv = 0;
+            for (int t = 0; t < nthreads; t++)
+                rv += dot_partial[t * PARTIAL_STRIDE];
+            double alpha = r1 / rv;
+            for (int i = row_start; i < row_stop; i++)
+                k_sg[i] = k_rg[i] - alpha * k_vg[i];
+            cpu_signal_wait(&signal_final, nthreads);
+
+            // t = As, t.s and t.t, this t.t reads t back while its row block is still in L1
+            double ts = 0, tt = 0;
+            if (matrix->coototal || TILE_FORMAT)
+            {
+                // t is only complete once the deferred entries are in
+                ts = cpu_tile_op_spmv(op, blk_start, blk_stop, k_sg, k_tg, k_sg);
+                for (int i = row_start; i < row_stop; i++)
+                    tt += k_tg[i] * k_tg[i];
+            }
+            else
+            {
+                for (int blki = blk_start; blki < blk_stop; blki++)
+                {
+                    ts += op->spmv_rowblk(matrix, blki, rowA, k_sg, k_tg, k_sg);
+                    int blk_row_stop = (blki + 1) * tile_size < rowA ? (blki + 1) * tile_size : rowA;
+                    for (int i = blki * tile_size; i < blk_row_stop; i++)
+                        tt += k_tg[i] * k_tg[i];
+                }
+            }
+            partial[1] = ts;
+            partial[2] = tt;
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // omega = t.s / t.t, x += alpha p + omega s, r = s - omega t, rh.r and r.r
+            ts = 0;
+            tt = 0;
+            for (int t = 0; t < nthreads; t++)
+            {
+                ts += dot_partial[t * PARTIAL_STRIDE + 1];
+                tt += dot_partial[t * PARTIAL_STRIDE + 2];
+            }
+            double omega = tt > 0 ? ts / tt : 0;
+            double rr = 0, rhr = 0;
+            for (int i = row_start; i < row_stop; i++)
+            {
+                k_x[i] += alpha * k_pg[i] + omega * k_sg[i];
+                k_rg[i] = k_sg[i] - omega * k_tg[i];
+                rhr += k_rh[i] * k_rg[i];
+                rr += k_rg[i] * k_rg[i];
+            }
+            partial[3] = rhr;
+            partial[4] = rr;
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // beta = (r1_new / r1)(alpha / omega), p = r + beta (p - omega v)
+            double r1_new = 0;
+            residual_local = 0;
+            for (int t = 0; t < nthreads; t++)
+            {
+                r1_new += dot_partial[t * PARTIAL_STRIDE + 3];
+                residual_local += dot_partial[t * PARTIAL_STRIDE + 4];
+            }
+            iter_local++;
+            // s = 0 leaves t = 0 and omega = 0, x is then exact and the next beta would divide by zero
+            if (omega == 0)
+                break;
+            double beta = (r1_new / r1) * (alpha / omega);
+            r1 = r1_new;
+            for (int i = row_start; i < row_stop; i++)
+                k_pg[i] = k_rg[i] + beta * (k_pg[i] - omega * k_vg[i]);
+            cpu_signal_wait(&signal_final, nthreads);
+        }
+        if (tid == 0)
+        {
+            iterations = iter_local;
+            residual = residual_local;
+        }
+    }
+    memcpy(x, k_x, sizeof(double) * rowA);
+    *res = residual;
+    return iterations;
+}
+
+// BiCGSTAB on the tile format: set up, solve once from x = 0, report to stdout and bicg_cpu_omp.csv, tear down
+void bicgstab_solve_cpu(MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *x, double *b, int n, int *iter, int maxiter, double threshold, char *filename, MAT_PTR_TYPE nnzR, int ori, int tile_size)
+{
+    struct timeval t1, t2;
+    cpu_tile_op op;
+    cpu_tile_op_create(&op, RowPtr, ColIdx, Val, n, ori, nnzR, filename, tile_size);
+    int rowA = op.rowA;
+    double time_format = op.time_setup;
+    cpu_tile_op_print(&op, "");
+
+    double residual = 0;
+    gettimeofday(&t1, NULL);
+    int iterations = bicgstab_cpu_iterate(&op, b, x, NULL, maxiter, threshold, &residual);
+    gettimeofday(&t2, NULL);
+    double time_bicg = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    double time_iter = iterations ? time_bicg / iterations : 0;
+    double Gflops_bicg = iterations ? ((4.0 * nnzR + 20.0 * rowA) * iterations) / (time_bicg * pow(10, 6)) : 0;
+    *iter = iterations;
+
+    double l2_norm = cpu_csr_relres(RowPtr, ColIdx, Val, rowA, x, b);
+    printf("iter=%d,time_bicg=%lf ms,time_iter=%lf ms,Gflops=%lf,time_format=%lf ms\n", iterations, time_bicg, time_iter, Gflops_bicg, time_format);
+    printf("%e\n", sqrt(residual));
+    printf("%e\n", l2_norm);
+
+    char *s = (char *)malloc(sizeof(char) * 256);
+    sprintf(s, "iter=%d,time_iter=%.3f,time_bicg=%.3f,nnzR=%lld,l2_norm=%e,time_format=%lf,gflops=%lf,nthreads=%d,simd=%s,tile_size=%d\n", iterations, time_iter, time_bicg, (long long)nnzR, l2_norm, time_format, Gflops_bicg, op.nthreads, blockspmv_cpu_simd_name(op.simd_level), op.tile_size);
+    FILE *file1 = fopen("bicg_cpu_omp.csv", "a");
+    if (file1 == NULL)
+    {
+        printf("open error!\n");
+    }
+    else
+    {
+        fwrite(filename, strlen(filename), 1, file1);
+        fwrite(",", strlen(","), 1, file1);
+        fwrite(s, strlen(s), 1, file1);
+        fclose(file1);
+    }
+    free(s);
+    cpu_tile_op_destroy(&op);
+}
+
+#endif
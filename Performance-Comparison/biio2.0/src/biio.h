@@ -18,6 +18,7 @@
 #include <fcntl.h>
 
 #include "mmio_highlevel.h"
+#include "mmio_parallel.h"
 
 int binary_read_csr(int *row, int *col, int64_t *nnz, int64_t **row_ptr, int **col_idx, double **val, char *filename)
 {
@@ -108,12 +109,17 @@ void read_Dmatrix_convert(int *row, int *col, int64_t *nnz, int64_t **row_ptr, i
     if (flag == -1)
     {
         INFO_LOG("read file name is %s\n", filename);
+#if MMIO_PARALLEL
+        mmio_parallel_read(row, col, nnz, row_ptr, col_idx, val, isSymmeticeR, filename);
+        INFO_LOG("row %d, col %d, nnz %ld\n", *row, *col, *nnz);
+#else
         mmio_info(row, col, nnz, isSymmeticeR, filename);
         INFO_LOG("row %d, col %d, nnz %ld\n", *row, *col, *nnz);
         *row_ptr = (int64_t *)malloc(sizeof(int64_t) * (*row + 1));
         *col_idx = (int *)malloc(sizeof(int) * (*nnz));
         *val = (double *)malloc(sizeof(double) * (*nnz));
         mmio_data(*row_ptr, *col_idx, *val, filename);
+#endif
         INFO_LOG("begin write binary file\n");
         binary_write_csr(*row, *col, *nnz, *row_ptr, *col_idx, *val, binary_name);
         INFO_LOG("end write binary file\n");
@@ -137,11 +143,15 @@ void read_Dmatrix(int *row, int *col, int64_t *nnz, int64_t **row_ptr, int **col
     else if (filename[name_len - 3] == 'm' && filename[name_len - 2] == 't' && filename[name_len - 1] == 'x')
     {
         INFO_LOG("read regular file %s\n", filename);
+#if MMIO_PARALLEL
+        mmio_parallel_read(row, col, nnz, row_ptr, col_idx, val, isSymmeticeR, filename);
+#else
         mmio_info(row, col, nnz, isSymmeticeR, filename);
         *row_ptr = (int64_t *)malloc(sizeof(int64_t) * (*row + 1));
         *col_idx = (int *)malloc(sizeof(int) * (*nnz));
         *val = (double *)malloc(sizeof(double) * (*nnz));
         mmio_data(*row_ptr, *col_idx, *val, filename);
+#endif
     }
     else
     {
@@ -165,11 +175,15 @@ void read_Dmatrix_32(int *row, int *col, int *nnz, int **row_ptr, int **col_idx,
     else if (filename[name_len - 3] == 'm' && filename[name_len - 2] == 't' && filename[name_len - 1] == 'x')
     {
         INFO_LOG("read regular file %s\n", filename);
+#if MMIO_PARALLEL
+        mmio_parallel_read(row, col, &_nnz, &_row_ptr, col_idx, val, isSymmeticeR, filename);
+#else
         mmio_info(row, col, &_nnz, isSymmeticeR, filename);
         _row_ptr = (int64_t *)malloc(sizeof(int64_t) * (*row + 1));
         *col_idx = (int *)malloc(sizeof(int) * _nnz);
         *val = (double *)malloc(sizeof(double) * _nnz);
         mmio_data(_row_ptr, *col_idx, *val, filename);
+#endif
     }
     else
     {
@@ -0,0 +1,63 @@
+#include <sys/time.h>
+#include "biio.h"
+
+// parse one .mtx with the fscanf reader and with mmio_parallel_read, check the CSR matches and report MB/s
+int main(int argc, char *argv[])
+{
+    char *filename = argv[1];
+    struct timeval t1, t2;
+    struct stat st;
+    if (stat(filename, &st) != 0)
+    {
+        printf("open error!\n");
+        return 0;
+    }
+    double mbytes = st.st_size / 1048576.0;
+
+    int row, col, isSymmeticeR;
+    int64_t nnz;
+    gettimeofday(&t1, NULL);
+    mmio_info(&row, &col, &nnz, &isSymmeticeR, filename);
+    int64_t *row_ptr = (int64_t *)malloc(sizeof(int64_t) * (row + 1));
+    int *col_idx = (int *)malloc(sizeof(int) * nnz);
+    double *val = (double *)malloc(sizeof(double) * nnz);
+    mmio_data(row_ptr, col_idx, val, filename);
+    gettimeofday(&t2, NULL);
+    double time_serial = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+
+    int row_p, col_p, isSymmeticeR_p;
+    int64_t nnz_p;
+    int64_t *row_ptr_p;
+    int *col_idx_p;
+    double *val_p;
+    gettimeofday(&t1, NULL);
+    int ret = mmio_parallel_read(&row_p, &col_p, &nnz_p, &row_ptr_p, &col_idx_p, &val_p, &isSymmeticeR_p, filename);
+    gettimeofday(&t2, NULL);
+    if (ret != 0)
+    {
+        printf("mmio_parallel_read error %d\n", ret);
+        return 1;
+    }
+    double time_parallel = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+
+    int same = row == row_p && col == col_p && nnz == nnz_p && isSymmeticeR == isSymmeticeR_p &&
+               !memcmp(row_ptr, row_ptr_p, sizeof(int64_t) * (row + 1)) &&
+               !memcmp(col_idx, col_idx_p, sizeof(int) * nnz) &&
+               !memcmp(val, val_p, sizeof(double) * nnz);
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    printf("%d,%d,%ld,%.1lf MB\n", row, col, nnz, mbytes);
+    printf("fscanf:   %lf ms, %lf MB/s\n", time_serial, mbytes / (time_serial / 1000.0));
+    printf("parallel: %lf ms, %lf MB/s, num_thread=%d, speedup=%lf\n", time_parallel, mbytes / (time_parallel / 1000.0), nthreads, time_serial / time_parallel);
+    printf("%s\n", same ? "CSR identical" : "CSR MISMATCH");
+
+    free(row_ptr);
+    free(col_idx);
+    free(val);
+    free(row_ptr_p);
+    free(col_idx_p);
+    free(val_p);
+    return !same;
+}
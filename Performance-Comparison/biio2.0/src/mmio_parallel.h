@@ -0,0 +1,391 @@
+#ifndef _MMIO_PARALLEL_
+#define _MMIO_PARALLEL_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+// read .mtx through mmio_parallel_read instead of the fscanf loop in mmio_data
+#ifndef MMIO_PARALLEL
+#define MMIO_PARALLEL 1
+#endif
+
+// row histogram counters per matrix row the CSR build may allocate across all chunks
+#ifndef MMIO_ROW_SCRATCH
+#define MMIO_ROW_SCRATCH 2
+#endif
+
+// Parallel Matrix Market reader. The mapped file is cut at newlines into one chunk per thread, every chunk
+// parses its entries with the hand-written readers below, and CSR is built with per-chunk row histograms,
+// so the entries of a row keep their file order and the arrays match mmio_info + mmio_data exactly. A chunk's
+// histogram only spans the rows its entries touch, which for a row-sorted file is about m / nthreads rows.
+// When the spans add up to more than MMIO_ROW_SCRATCH * m rows (unsorted files, symmetric files whose chunks
+// reach most rows through the mirrored entries), the histogram and the placement run as one chunk over all
+// entries instead; only the parsing stays parallel then.
+
+static const double mmio_pow10[23] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+                                      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+static inline int mmio_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char *mmio_skip_space(const char *p, const char *end)
+{
+    while (p < end && mmio_is_space(*p))
+        p++;
+    return p;
+}
+
+static inline const char *mmio_parse_int(const char *p, const char *end, int *out)
+{
+    p = mmio_skip_space(p, end);
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    long long v = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+        v = v * 10 + (*p++ - '0');
+    *out = (int)(neg ? -v : v);
+    return p;
+}
+
+// Exact when the decimal mantissa fits in 53 bits and the power of ten is at most 22: both operands are
+// then exact doubles and one IEEE multiply or divide rounds correctly, which is what strtod returns.
+// Everything else (long mantissas, large exponents, inf/nan) goes through strtod on a copy of the token.
+static inline const char *mmio_parse_double(const char *p, const char *end, double *out)
+{
+    p = mmio_skip_space(p, end);
+    const char *token = p;
+    int neg = 0;
+    if (p < end && (*p == '-' || *p == '+'))
+        neg = *p++ == '-';
+    uint64_t mant = 0;
+    int ndigit = 0, exp10 = 0, any = 0;
+    while (p < end && *p >= '0' && *p <= '9')
+    {
+        if (mant || *p != '0')
+            ndigit++;
+        mant = mant * 10 + (*p++ - '0');
+        any = 1;
+    }
+    if (p < end && *p == '.')
+    {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (mant || *p != '0')
+                ndigit++;
+            mant = mant * 10 + (*p++ - '0');
+            exp10--;
+            any = 1;
+        }
+    }
+    if (any && p < end && (*p == 'e' || *p == 'E'))
+    {
+        int eneg = 0, e = 0;
+        p++;
+        if (p < end && (*p == '-' || *p == '+'))
+            eneg = *p++ == '-';
+        while (p < end && *p >= '0' && *p <= '9')
+        {
+            if (e < 100000)
+                e = e * 10 + (*p - '0');
+            p++;
+        }
+        exp10 += eneg ? -e : e;
+    }
+    if (any && ndigit <= 19 && mant <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22 && (p == end || !((*p | 32) >= 'a' && (*p | 32) <= 'z')))
+    {
+        double v = (double)mant;
+        v = exp10 < 0 ? v / mmio_pow10[-exp10] : v * mmio_pow10[exp10];
+        *out = neg ? -v : v;
+        return p;
+    }
+
+    char buf[128];
+    const char *stop = token;
+    while (stop < end && !mmio_is_space(*stop) && *stop != '\n')
+        stop++;
+    int len = stop - token < 127 ? stop - token : 127;
+    memcpy(buf, token, len);
+    buf[len] = '\0';
+    *out = strtod(buf, NULL);
+    return stop;
+}
+
+static inline const char *mmio_next_line(const char *p, const char *end)
+{
+    const char *nl = (const char *)memchr(p, '\n', end - p);
+    return nl == NULL ? end : nl + 1;
+}
+
+static inline int mmio_blank_line(const char *p, const char *end)
+{
+    p = mmio_skip_space(p, end);
+    return p == end || *p == '\n';
+}
+
+static inline int mmio_has_word(const char *line, const char *end, const char *word)
+{
+    int len = strlen(word);
+    for (const char *p = line; p + len <= end; p++)
+        if (strncasecmp(p, word, len) == 0)
+            return 1;
+    return 0;
+}
+
+// CSR of filename with 64-bit row pointers; *csrRowPtr, *csrColIdx and *csrVal are malloc'ed here
+int mmio_parallel_read(int *m, int *n, int64_t *nnz, int64_t **csrRowPtr, int **csrColIdx, double **csrVal, int *isSymmetric, char *filename)
+{
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+    size_t size = st.st_size;
+    char *base = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return -1;
+    madvise(base, size, MADV_SEQUENTIAL);
+    const char *end = base + size;
+
+    // banner, same rules as mm_read_banner: coordinate storage, symmetric and hermitian get expanded
+    const char *line_end = mmio_next_line(base, end);
+    if (strncmp(base, "%%MatrixMarket", 14) != 0 || !mmio_has_word(base, line_end, "coordinate"))
+    {
+        printf("Could not process Matrix Market banner.\n");
+        munmap(base, size);
+        return -2;
+    }
+    int isPattern = mmio_has_word(base, line_end, "pattern");
+    int isInteger = mmio_has_word(base, line_end, "integer");
+    int isSymmetric_tmp = (mmio_has_word(base, line_end, "symmetric") && !mmio_has_word(base, line_end, "skew-symmetric")) ||
+                          mmio_has_word(base, line_end, "hermitian");
+
+    // comments, then "M N nnz"
+    const char *p = line_end;
+    while (p < end && (*p == '%' || mmio_blank_line(p, end)))
+        p = mmio_next_line(p, end);
+    int m_tmp, n_tmp;
+    long long nnz_report = -1;
+    if (p < end)
+    {
+        int64_t nnz_tmp = 0;
+        p = mmio_parse_int(p, end, &m_tmp);
+        p = mmio_parse_int(p, end, &n_tmp);
+        p = mmio_skip_space(p, end);
+        while (p < end && *p >= '0' && *p <= '9')
+            nnz_tmp = nnz_tmp * 10 + (*p++ - '0');
+        nnz_report = nnz_tmp;
+    }
+    if (nnz_report < 0)
+    {
+        munmap(base, size);
+        return -4;
+    }
+    const char *data = mmio_next_line(p, end);
+
+    int nthreads = 1;
+#ifdef _OPENMP
+    nthreads = omp_get_max_threads();
+#endif
+    // a chunk owns every line that starts inside [chunk_start[t], chunk_start[t + 1])
+    const char **chunk_start = (const char **)malloc(sizeof(char *) * (nthreads + 1));
+    int64_t *chunk_entry = (int64_t *)malloc(sizeof(int64_t) * (nthreads + 1));
+    memset(chunk_entry, 0, sizeof(int64_t) * (nthreads + 1));
+    chunk_start[0] = data;
+    chunk_start[nthreads] = end;
+    for (int t = 1; t < nthreads; t++)
+    {
+        const char *q = data + (size_t)(end - data) * t / nthreads;
+        q = q == data ? data : mmio_next_line(q - 1, end);
+        chunk_start[t] = q < chunk_start[t - 1] ? chunk_start[t - 1] : q;
+    }
+
+    int *csrRowIdx_tmp = (int *)malloc(nnz_report * sizeof(int));
+    int *csrColIdx_tmp = (int *)malloc(nnz_report * sizeof(int));
+    double *csrVal_tmp = (double *)malloc(nnz_report * sizeof(double));
+    // rows [row_lo[t], row_hi[t]] touched by chunk t, its histogram at row_count + count_base[t]
+    int *row_lo = (int *)malloc(sizeof(int) * nthreads);
+    int *row_hi = (int *)malloc(sizeof(int) * nthreads);
+    size_t *count_base = (size_t *)malloc(sizeof(size_t) * (nthreads + 1));
+    int *row_count = NULL;
+    int nchunks = nthreads;
+    int64_t *row_ptr = (int64_t *)malloc(sizeof(int64_t) * (m_tmp + 1));
+    memset(row_ptr, 0, sizeof(int64_t) * (m_tmp + 1));
+
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = 0;
+#ifdef _OPENMP
+        tid = omp_get_thread_num();
+#endif
+        // entries per chunk, so each chunk knows where its first entry goes
+        int64_t count = 0;
+        for (const char *q = chunk_start[tid]; q < chunk_start[tid + 1]; q = mmio_next_line(q, end))
+            count += !mmio_blank_line(q, end);
+        chunk_entry[tid + 1] = count;
+#pragma omp barrier
+#pragma omp single
+        for (int t = 0; t < nthreads; t++)
+            chunk_entry[t + 1] += chunk_entry[t];
+
+        int lo = m_tmp, hi = -1;
+        int64_t i = chunk_entry[tid];
+        for (const char *q = chunk_start[tid]; q < chunk_start[tid + 1] && i < nnz_report; q = mmio_next_line(q, end))
+        {
+            if (mmio_blank_line(q, end))
+                continue;
+            int idxi, idxj, ival;
+            double fval;
+            q = mmio_parse_int(q, end, &idxi);
+            q = mmio_parse_int(q, end, &idxj);
+            if (isPattern)
+                fval = 1.0;
+            else if (isInteger)
+            {
+                q = mmio_parse_int(q, end, &ival);
+                fval = ival;
+            }
+            else
+                q = mmio_parse_double(q, end, &fval); // real part only for complex, as mmio_data
+            idxi--;
+            idxj--;
+            csrRowIdx_tmp[i] = idxi;
+            csrColIdx_tmp[i] = idxj;
+            csrVal_tmp[i] = fval;
+            lo = idxi < lo ? idxi : lo;
+            hi = idxi > hi ? idxi : hi;
+            if (isSymmetric_tmp)
+            {
+                lo = idxj < lo ? idxj : lo;
+                hi = idxj > hi ? idxj : hi;
+            }
+            i++;
+        }
+        row_lo[tid] = lo;
+        row_hi[tid] = hi;
+#pragma omp barrier
+#pragma omp single
+        {
+            count_base[0] = 0;
+            for (int t = 0; t < nthreads; t++)
+                count_base[t + 1] = count_base[t] + (row_hi[t] >= row_lo[t] ? row_hi[t] - row_lo[t] + 1 : 0);
+            if (count_base[nthreads] > (size_t)MMIO_ROW_SCRATCH * m_tmp)
+            {
+                // one chunk over every entry and row
+                nchunks = 1;
+                chunk_entry[1] = chunk_entry[nthreads];
+                row_lo[0] = 0;
+                row_hi[0] = m_tmp - 1;
+                count_base[1] = m_tmp;
+            }
+            row_count = (int *)malloc(sizeof(int) * count_base[nchunks]);
+            memset(row_count, 0, sizeof(int) * count_base[nchunks]);
+        }
+
+        int *count_local = tid < nchunks ? row_count + count_base[tid] - row_lo[tid] : NULL;
+        int64_t stop = tid < nchunks ? (chunk_entry[tid + 1] < nnz_report ? chunk_entry[tid + 1] : nnz_report) : 0;
+        for (int64_t e = tid < nchunks ? chunk_entry[tid] : 0; e < stop; e++)
+        {
+            count_local[csrRowIdx_tmp[e]]++;
+            if (isSymmetric_tmp && csrRowIdx_tmp[e] != csrColIdx_tmp[e])
+                count_local[csrColIdx_tmp[e]]++;
+        }
+#pragma omp barrier
+
+        // row lengths, then per-chunk cursors inside each row in chunk (file) order
+#pragma omp for
+        for (int r = 0; r < m_tmp; r++)
+        {
+            int len = 0;
+            for (int t = 0; t < nchunks; t++)
+            {
+                if (r < row_lo[t] || r > row_hi[t])
+                    continue;
+                int *c = row_count + count_base[t] + (r - row_lo[t]);
+                int cnt = *c;
+                *c = len;
+                len += cnt;
+            }
+            row_ptr[r] = len;
+        }
+#pragma omp single
+        {
+            int64_t old_val = row_ptr[0], new_val;
+            row_ptr[0] = 0;
+            for (int r = 1; r <= m_tmp; r++)
+            {
+                new_val = row_ptr[r];
+                row_ptr[r] = old_val + row_ptr[r - 1];
+                old_val = new_val;
+            }
+            *csrColIdx = (int *)malloc(row_ptr[m_tmp] * sizeof(int));
+            *csrVal = (double *)malloc(row_ptr[m_tmp] * sizeof(double));
+        }
+
+        int *col_out = *csrColIdx;
+        double *val_out = *csrVal;
+        for (int64_t e = tid < nchunks ? chunk_entry[tid] : 0; e < stop; e++)
+        {
+            int ri = csrRowIdx_tmp[e];
+            int ci = csrColIdx_tmp[e];
+            int64_t offset = row_ptr[ri] + count_local[ri]++;
+            col_out[offset] = ci;
+            val_out[offset] = csrVal_tmp[e];
+            if (isSymmetric_tmp && ri != ci)
+            {
+                offset = row_ptr[ci] + count_local[ci]++;
+                col_out[offset] = ri;
+                val_out[offset] = csrVal_tmp[e];
+            }
+        }
+    }
+
+    int64_t nread = chunk_entry[nchunks];
+    free(chunk_start);
+    free(chunk_entry);
+    free(csrRowIdx_tmp);
+    free(csrColIdx_tmp);
+    free(csrVal_tmp);
+    free(row_lo);
+    free(row_hi);
+    free(count_base);
+    free(row_count);
+    munmap(base, size);
+    if (nread < nnz_report)
+    {
+        printf("Premature end of Matrix Market data.\n");
+        free(row_ptr);
+        free(*csrColIdx);
+        free(*csrVal);
+        *csrColIdx = NULL;
+        *csrVal = NULL;
+        return -5;
+    }
+
+    *m = m_tmp;
+    *n = n_tmp;
+    *nnz = row_ptr[m_tmp];
+    *isSymmetric = isSymmetric_tmp;
+    *csrRowPtr = row_ptr;
+    return 0;
+}
+
+#endif
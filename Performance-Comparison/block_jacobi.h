@@ -0,0 +1,191 @@
+#ifndef _BLOCK_JACOBI_H_
+#define _BLOCK_JACOBI_H_
+
+#include "common.h"
+#include "format.h"
+#include "encode.h"
+#include "tile_precision.h"
+
+// Block-Jacobi preconditioner on the diagonal tiles (tile_columnidx == blki). Each tile is expanded to a
+// dense tile_size x tile_size block, Cholesky factorized and inverted once, and M^(-1) r is then a dense
+// product per row block. A block whose factorization breaks down falls back to the inverse of its
+// diagonal. With BJ_FLOAT the inverses are kept in float and the products still accumulate in double.
+#if BJ_FLOAT
+#define BJ_VAL_TYPE MAT_VAL_LOW_TYPE
+#else
+#define BJ_VAL_TYPE MAT_VAL_TYPE
+#endif
+
+typedef struct
+{
+    int tile_size;
+    int tilem;
+    BJ_VAL_TYPE *inv;
+} block_jacobi;
+
+// tile blkj of class PREC, values at tile_vals, into dense
+template <int TS, int PREC>
+static inline void block_jacobi_extract_tile(Tile_matrix *matrix, int blki, int blkj, int rowlength, const unsigned char *tile_vals, double *dense)
+{
+    int *blknnz = matrix->blknnz;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
+    MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+    MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+        for (int rj = Blockcsr_Ptr[csrcount + ri]; rj < stop; rj++)
+        {
+            int ci = tile_idx_get<TS>(matrix->csr_compressedIdx, csroffset + rj);
+            if (ci < rowlength)
+                dense[ri * rowlength + ci] = packed_load<PREC>(tile_vals, rj);
+        }
+    }
+}
+
+// the diagonal tile of row block blki as a dense row-major rowlength x rowlength block, zero if absent
+template <int TS>
+void block_jacobi_extract(Tile_matrix *matrix, int blki, int rowlength, double *dense)
+{
+    memset(dense, 0, sizeof(double) * TS * TS);
+    for (int blkj = matrix->tile_ptr[blki]; blkj < matrix->tile_ptr[blki + 1]; blkj++)
+    {
+        if (matrix->tile_columnidx[blkj] != blki)
+            continue;
+        int prec = matrix->Blockcsr_Val_Packed ? matrix->tile_prec[blkj] : PREC_FP64;
+        const unsigned char *tile_vals = matrix->Blockcsr_Val_Packed ? matrix->Blockcsr_Val_Packed + tile_packed_start(matrix, blki, blkj)
+                                                                     : (const unsigned char *)(matrix->Blockcsr_Val + tile_csr_start(matrix, blki, blkj));
+        switch (prec)
+        {
+        case PREC_INT8:
+            block_jacobi_extract_tile<TS, PREC_INT8>(matrix, blki, blkj, rowlength, tile_vals, dense);
+            break;
+        case PREC_FP16:
+            block_jacobi_extract_tile<TS, PREC_FP16>(matrix, blki, blkj, rowlength, tile_vals, dense);
+            break;
+        case PREC_FP32:
+            block_jacobi_extract_tile<TS, PREC_FP32>(matrix, blki, blkj, rowlength, tile_vals, dense);
+            break;
+        default:
+            block_jacobi_extract_tile<TS, PREC_FP64>(matrix, blki, blkj, rowlength, tile_vals, dense);
+        }
+        break;
+    }
+}
+
+// overwrite the SPD block a (n x n) with its inverse through a = L L^T, returns 0 if a pivot is not positive
+int block_jacobi_invert(double *a, int n, double *work)
+{
+    double *l = work;
+    memset(l, 0, sizeof(double) * n * n);
+    for (int j = 0; j < n; j++)
+    {
+        double diag = a[j * n + j];
+        for (int k = 0; k < j; k++)
+            diag -= l[j * n + k] * l[j * n + k];
+        if (!(diag > 0))
+            return 0;
+        l[j * n + j] = sqrt(diag);
+        for (int i = j + 1; i < n; i++)
+        {
+            double v = a[i * n + j];
+            for (int k = 0; k < j; k++)
+                v -= l[i * n + k] * l[j * n + k];
+            l[i * n + j] = v / l[j * n + j];
+        }
+    }
+    // L^(-1) in place of the lower triangle, then a = L^(-T) L^(-1)
+    for (int j = 0; j < n; j++)
+    {
+        l[j * n + j] = 1.0 / l[j * n + j];
+        for (int i = j + 1; i < n; i++)
+        {
+            double v = 0;
+            for (int k = j; k < i; k++)
+                v -= l[i * n + k] * l[k * n + j];
+            l[i * n + j] = v / l[i * n + i];
+        }
+    }
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j <= i; j++)
+        {
+            double v = 0;
+            for (int k = i; k < n; k++)
+                v += l[k * n + i] * l[k * n + j];
+            a[i * n + j] = v;
+            a[j * n + i] = v;
+        }
+    return 1;
+}
+
+template <int TS>
+void block_jacobi_setup(block_jacobi *bj, Tile_matrix *matrix, int rowA)
+{
+    double *dense = (double *)malloc(sizeof(double) * TS * TS);
+    double *work = (double *)malloc(sizeof(double) * TS * TS);
+    for (int blki = 0; blki < bj->tilem; blki++)
+    {
+        int rowlength = blki == bj->tilem - 1 ? rowA - (bj->tilem - 1) * TS : TS;
+        block_jacobi_extract<TS>(matrix, blki, rowlength, dense);
+        if (!block_jacobi_invert(dense, rowlength, work))
+        {
+            block_jacobi_extract<TS>(matrix, blki, rowlength, dense);
+            for (int i = 0; i < rowlength; i++)
+                for (int j = 0; j < rowlength; j++)
+                    dense[i * rowlength + j] = i == j && dense[i * rowlength + i] != 0 ? 1.0 / dense[i * rowlength + i] : (i == j);
+        }
+        // stored at a TS x TS stride, the entries past rowlength stay zero
+        for (int i = 0; i < TS; i++)
+            for (int j = 0; j < TS; j++)
+                bj->inv[(size_t)blki * TS * TS + i * TS + j] = i < rowlength && j < rowlength ? dense[i * rowlength + j] : 0;
+    }
+    free(dense);
+    free(work);
+}
+
+// (re)compute the inverses from the current values of matrix, also after a tile_refresh_apply
+void block_jacobi_factor(block_jacobi *bj, Tile_matrix *matrix, int rowA)
+{
+    if (bj->tile_size == 8)
+        block_jacobi_setup<8>(bj, matrix, rowA);
+    else if (bj->tile_size == 32)
+        block_jacobi_setup<32>(bj, matrix, rowA);
+    else
+        block_jacobi_setup<16>(bj, matrix, rowA);
+}
+
+void block_jacobi_create(block_jacobi *bj, Tile_matrix *matrix, int rowA)
+{
+    int tile_size = matrix->tile_size;
+    bj->tile_size = tile_size;
+    bj->tilem = matrix->tilem;
+    bj->inv = (BJ_VAL_TYPE *)malloc(sizeof(BJ_VAL_TYPE) * (size_t)matrix->tilem * tile_size * tile_size);
+    block_jacobi_factor(bj, matrix, rowA);
+}
+
+void block_jacobi_destroy(block_jacobi *bj)
+{
+    free(bj->inv);
+}
+
+// z = M^(-1) r on the rows of block blki, returns r.z over them; T is the vector type, sums run in double
+template <typename T>
+static inline double block_jacobi_apply(block_jacobi *bj, int blki, int rowlength, const T *r, T *z)
+{
+    int ts = bj->tile_size;
+    const T *r_blk = r + blki * ts;
+    T *z_blk = z + blki * ts;
+    double rz = 0;
+    for (int i = 0; i < rowlength; i++)
+    {
+        const BJ_VAL_TYPE *inv_row = bj->inv + (size_t)blki * ts * ts + i * ts;
+        double sum = 0;
+        for (int j = 0; j < rowlength; j++)
+            sum += inv_row[j] * r_blk[j];
+        z_blk[i] = sum;
+        rz += (double)r_blk[i] * sum;
+    }
+    return rz;
+}
+
+#endif
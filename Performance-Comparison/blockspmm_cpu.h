@@ -0,0 +1,85 @@
+#ifndef _BLOCKSPMM_CPU_H_
+#define _BLOCKSPMM_CPU_H_
+
+#include "common.h"
+#include "format.h"
+#include "encode.h"
+#include "tile_precision.h"
+
+// Y += tile blkj of class PREC, values at tile_vals, times its window of X
+template <int TS, int PREC>
+static inline void blockspmm_tile(Tile_matrix *matrix, int blki, int blkj, int rowlength, int nrhs, const unsigned char *tile_vals, const MAT_VAL_TYPE *x_win,
+                                  MAT_VAL_TYPE *y_blk)
+{
+    int *blknnz = matrix->blknnz;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
+    MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+    MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        MAT_VAL_TYPE *y_row = y_blk + ri * nrhs;
+        int start = Blockcsr_Ptr[csrcount + ri];
+        int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+        for (int rj = start; rj < stop; rj++)
+        {
+            MAT_VAL_TYPE val = packed_load<PREC>(tile_vals, rj);
+            const MAT_VAL_TYPE *x_row = x_win + tile_idx_get<TS>(csr_compressedIdx, csroffset + rj) * nrhs;
+            for (int j = 0; j < nrhs; j++)
+                y_row[j] += val * x_row[j];
+        }
+    }
+}
+
+// Y = A * X for nrhs vectors stored interleaved, entry (i, j) at i * nrhs + j. Each nonzero is decoded
+// once and applied to a whole row of X, so a tile streams its indices and values once for all nrhs
+// vectors while its TS x nrhs window of X and the TS x nrhs rows of Y stay in L1.
+template <int TS>
+void blockspmm_cpu_rowblk(Tile_matrix *matrix,
+                          int blki,
+                          int rowA,
+                          int nrhs,
+                          MAT_VAL_TYPE *X,
+                          MAT_VAL_TYPE *Y)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    unsigned char *Blockcsr_Val_Packed = matrix->Blockcsr_Val_Packed;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+    MAT_VAL_TYPE *y_blk = Y + (size_t)blki * TS * nrhs;
+    memset(y_blk, 0, sizeof(MAT_VAL_TYPE) * rowlength * nrhs);
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        MAT_VAL_TYPE *x_win = X + (size_t)tile_columnidx[blkj] * TS * nrhs;
+        int prec = Blockcsr_Val_Packed ? matrix->tile_prec[blkj] : PREC_FP64;
+        const unsigned char *tile_vals = Blockcsr_Val_Packed ? Blockcsr_Val_Packed + tile_packed_start(matrix, blki, blkj)
+                                                             : (const unsigned char *)(Blockcsr_Val + tile_csr_start(matrix, blki, blkj));
+        switch (prec)
+        {
+        case PREC_INT8:
+            blockspmm_tile<TS, PREC_INT8>(matrix, blki, blkj, rowlength, nrhs, tile_vals, x_win, y_blk);
+            break;
+        case PREC_FP16:
+            blockspmm_tile<TS, PREC_FP16>(matrix, blki, blkj, rowlength, nrhs, tile_vals, x_win, y_blk);
+            break;
+        case PREC_FP32:
+            blockspmm_tile<TS, PREC_FP32>(matrix, blki, blkj, rowlength, nrhs, tile_vals, x_win, y_blk);
+            break;
+        default:
+            blockspmm_tile<TS, PREC_FP64>(matrix, blki, blkj, rowlength, nrhs, tile_vals, x_win, y_blk);
+        }
+    }
+}
+
+typedef void (*blockspmm_rowblk_kernel)(Tile_matrix *matrix, int blki, int rowA, int nrhs, MAT_VAL_TYPE *X, MAT_VAL_TYPE *Y);
+
+blockspmm_rowblk_kernel blockspmm_cpu_select(int tile_size)
+{
+    return tile_size == 8 ? blockspmm_cpu_rowblk<8> : (tile_size == 32 ? blockspmm_cpu_rowblk<32> : blockspmm_cpu_rowblk<16>);
+}
+
+#endif
@@ -1,4 +1,11 @@
+#ifndef _BLOCKSPMV_CPU_H_
+#define _BLOCKSPMV_CPU_H_
+
 #include "common.h"
+#include "format.h"
+#include "encode.h"
+
+template <int TS>
 void blockspmv_cpu(Tile_matrix *matrix,
                   int *ptroffset1,
                   int *ptroffset2,
@@ -26,7 +33,7 @@ void blockspmv_cpu(Tile_matrix *matrix,
     unsigned char *blknnznnz = matrix->blknnznnz;
     MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
     unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
-    unsigned char *Blockcsr_Ptr = matrix->Blockcsr_Ptr;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
 
     int csroffset = 0;
     int csrcount = 0;
@@ -84,30 +91,101 @@ void blockspmv_cpu(Tile_matrix *matrix,
 
     for (int blki = 0; blki < tilem; blki++)
     {
-        int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
-        for (int ri = 0; ri < BLOCK_SIZE; ri++)
+        int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+        for (int ri = 0; ri < TS; ri++)
         {
-            y[blki * BLOCK_SIZE + ri] = 0;
+            y[blki * TS + ri] = 0;
         }
         for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
         {
-            int collength = tile_columnidx[blkj] == tilen - 1 ? colA - (tilen - 1) * BLOCK_SIZE : BLOCK_SIZE;
-            int x_offset = tile_columnidx[blkj] * BLOCK_SIZE;
+            int collength = tile_columnidx[blkj] == tilen - 1 ? colA - (tilen - 1) * TS : TS;
+            int x_offset = tile_columnidx[blkj] * TS;
             ptroffset1[blkj] = csroffset;
             ptroffset2[blkj] = csrcount;
             for (int ri = 0; ri < rowlength; ri++)
             {
                 MAT_VAL_TYPE sum = 0;
-                int stop = ri == rowlength - 1 ? (blknnz[blkj + 1] - blknnz[blkj]) : Blockcsr_Ptr[ri + 1 + csrcount];
+                int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
                 for (int rj = Blockcsr_Ptr[csrcount + ri]; rj < stop; rj++)
                 {
-                    int csrcol = (csroffset + rj) % 2 == 0 ? (csr_compressedIdx[(csroffset + rj) / 2] & num_f) >> 4 : csr_compressedIdx[(csroffset + rj) / 2] & num_b;
+                    int csrcol = tile_idx_get<TS>(csr_compressedIdx, csroffset + rj);
                     sum += x[x_offset + csrcol] * Blockcsr_Val[csroffset + rj];
                 }
-                y[blki * BLOCK_SIZE + ri] += sum;
+                y[blki * TS + ri] += sum;
             }
-            csroffset += blknnz[blkj + 1] - blknnz[blkj];
+            csroffset += tile_span(blknnz, blkj);
             csrcount += rowlength;
         }
     }
-}
\ No newline at end of file
+}
+
+// the 16-wide layout the GPU drivers build
+void blockspmv_cpu(Tile_matrix *matrix,
+                  int *ptroffset1,
+                  int *ptroffset2,
+                  int *rowblkblock,
+                  unsigned int **blkcoostylerowidx,
+                  int **blkcoostylerowidx_colstart,
+                  int **blkcoostylerowidx_colstop,
+                  int rowA, int colA, MAT_PTR_TYPE nnzA,
+                  MAT_PTR_TYPE *csrRowPtrA,
+                  int *csrColIdxA,
+                  MAT_VAL_TYPE *csrValA,
+                  MAT_VAL_TYPE *x,
+                  MAT_VAL_TYPE *y,
+                  MAT_VAL_TYPE *y_golden
+)
+{
+    blockspmv_cpu<BLOCK_SIZE>(matrix, ptroffset1, ptroffset2, rowblkblock, blkcoostylerowidx, blkcoostylerowidx_colstart, blkcoostylerowidx_colstop,
+                              rowA, colA, nnzA, csrRowPtrA, csrColIdxA, csrValA, x, y, y_golden);
+}
+
+// y = A * x restricted to the TS-row block blki, rows accumulate in registers across the tiles of the block;
+// returns w.y over the block's rows
+template <int TS>
+MAT_VAL_TYPE blockspmv_cpu_rowblk(Tile_matrix *matrix,
+                                  int blki,
+                                  int rowA,
+                                  MAT_VAL_TYPE *x,
+                                  MAT_VAL_TYPE *y,
+                                  MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    int *blknnz = matrix->blknnz;
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+    MAT_VAL_TYPE sum[TS];
+    for (int ri = 0; ri < TS; ri++)
+        sum[ri] = 0;
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        int x_offset = tile_columnidx[blkj] * TS;
+        MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+        MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+        for (int ri = 0; ri < rowlength; ri++)
+        {
+            int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+            for (int rj = Blockcsr_Ptr[csrcount + ri]; rj < stop; rj++)
+            {
+                int csrcol = tile_idx_get<TS>(csr_compressedIdx, csroffset + rj);
+                sum[ri] += x[x_offset + csrcol] * Blockcsr_Val[csroffset + rj];
+            }
+        }
+    }
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        y[blki * TS + ri] = sum[ri];
+        dot += w[blki * TS + ri] * sum[ri];
+    }
+    return dot;
+}
+
+#endif
@@ -0,0 +1,493 @@
+#ifndef _BLOCKSPMV_CPU_SIMD_H_
+#define _BLOCKSPMV_CPU_SIMD_H_
+
+#include <immintrin.h>
+#include "common.h"
+#include "format.h"
+#include "blockspmv_cpu.h"
+#include "tile_precision.h"
+
+#define SIMD_SCALAR 0
+#define SIMD_AVX2 1
+#define SIMD_AVX512 2
+
+// every row-block kernel also returns w.y over the rows it wrote, summed while y is still in registers, so
+// the CG and BiCGSTAB dot products that follow an SpMV need no extra sweep over y
+typedef MAT_VAL_TYPE (*blockspmv_rowblk_kernel)(Tile_matrix *matrix, int blki, int rowA, MAT_VAL_TYPE *x, MAT_VAL_TYPE *y, MAT_VAL_TYPE *w);
+
+// Both kernels keep the 16-entry x window of a tile in registers and select from it with the decoded
+// nibbles, so x must be readable up to tilen * BLOCK_SIZE. One row of a tile holds at most 16 nnz,
+// which with an odd start needs 17 nibbles: a 16-byte load of csr_compressedIdx (padded in Tile_create)
+// yields 32 and covers it.
+
+// rows shorter than SIMD_ROW_TH stay on the scalar nibble loop, the decode and select cost more than they save there
+static inline MAT_VAL_TYPE short_row_scalar(const unsigned char *compressed, const MAT_VAL_TYPE *val, const MAT_VAL_TYPE *x_win, MAT_PTR_TYPE pos, int len)
+{
+    MAT_VAL_TYPE sum = 0;
+    for (MAT_PTR_TYPE rj = pos; rj < pos + len; rj++)
+    {
+        int csrcol = rj % 2 == 0 ? (compressed[rj / 2] & num_f) >> 4 : compressed[rj / 2] & num_b;
+        sum += x_win[csrcol] * val[rj];
+    }
+    return sum;
+}
+
+// expand 16 packed bytes to 32 column indices, high nibble first, starting at nibble (pos & 1)
+__attribute__((target("avx2"))) static inline __m128i decode_nibble_row(const unsigned char *compressed, MAT_PTR_TYPE pos)
+{
+    const __m128i lo_mask = _mm_set1_epi8(num_b);
+    __m128i packed = _mm_loadu_si128((const __m128i *)(compressed + pos / 2));
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(packed, 4), lo_mask);
+    __m128i lo = _mm_and_si128(packed, lo_mask);
+    __m128i idx0 = _mm_unpacklo_epi8(hi, lo);
+    __m128i idx1 = _mm_unpackhi_epi8(hi, lo);
+    return (pos & 1) ? _mm_alignr_epi8(idx1, idx0, 1) : idx0;
+}
+
+__attribute__((target("avx512f"))) MAT_VAL_TYPE blockspmv_cpu_rowblk_avx512(Tile_matrix *matrix,
+                                                                            int blki,
+                                                                            int rowA,
+                                                                            MAT_VAL_TYPE *x,
+                                                                            MAT_VAL_TYPE *y,
+                                                                            MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    int *blknnz = matrix->blknnz;
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    unsigned char *Blockcsr_Ptr = matrix->Blockcsr_Ptr;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
+    __m512d acc[BLOCK_SIZE];
+    MAT_VAL_TYPE sum[BLOCK_SIZE];
+    for (int ri = 0; ri < BLOCK_SIZE; ri++)
+    {
+        acc[ri] = _mm512_setzero_pd();
+        sum[ri] = 0;
+    }
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        MAT_VAL_TYPE *x_win = x + tile_columnidx[blkj] * BLOCK_SIZE;
+        __m512d x_lo = _mm512_loadu_pd(x_win);
+        __m512d x_hi = _mm512_loadu_pd(x_win + 8);
+        MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+        MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+        for (int ri = 0; ri < rowlength; ri++)
+        {
+            int start = Blockcsr_Ptr[csrcount + ri];
+            int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+            int len = stop - start;
+            if (len <= 0)
+                continue;
+            MAT_PTR_TYPE pos = csroffset + start;
+            if (len < SIMD_ROW_TH)
+            {
+                sum[ri] += short_row_scalar(csr_compressedIdx, Blockcsr_Val, x_win, pos, len);
+                continue;
+            }
+            __m128i idx = decode_nibble_row(csr_compressedIdx, pos);
+
+            __mmask8 m = len >= 8 ? 0xFF : (__mmask8)((1 << len) - 1);
+            __m512d xv = _mm512_permutex2var_pd(x_lo, _mm512_cvtepu8_epi64(idx), x_hi);
+            __m512d v = _mm512_maskz_loadu_pd(m, Blockcsr_Val + pos);
+            acc[ri] = _mm512_mask3_fmadd_pd(v, xv, acc[ri], m);
+            if (len > 8)
+            {
+                m = len >= 16 ? 0xFF : (__mmask8)((1 << (len - 8)) - 1);
+                xv = _mm512_permutex2var_pd(x_lo, _mm512_cvtepu8_epi64(_mm_srli_si128(idx, 8)), x_hi);
+                v = _mm512_maskz_loadu_pd(m, Blockcsr_Val + pos + 8);
+                acc[ri] = _mm512_mask3_fmadd_pd(v, xv, acc[ri], m);
+            }
+        }
+    }
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        MAT_VAL_TYPE yi = sum[ri] + _mm512_reduce_add_pd(acc[ri]);
+        y[blki * BLOCK_SIZE + ri] = yi;
+        dot += w[blki * BLOCK_SIZE + ri] * yi;
+    }
+    return dot;
+}
+
+// pick x_win[idx] for four 64-bit indices out of the four registers holding the 16-entry window
+__attribute__((target("avx2"))) static inline __m256d select_x_window_avx2(__m256d x0, __m256d x1, __m256d x2, __m256d x3, __m256i ci)
+{
+    __m256i low = _mm256_slli_epi64(_mm256_and_si256(ci, _mm256_set1_epi64x(3)), 1);
+    __m256i perm = _mm256_or_si256(low, _mm256_slli_epi64(_mm256_add_epi64(low, _mm256_set1_epi64x(1)), 32));
+    __m256d s0 = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(x0), perm));
+    __m256d s1 = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(x1), perm));
+    __m256d s2 = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(x2), perm));
+    __m256d s3 = _mm256_castps_pd(_mm256_permutevar8x32_ps(_mm256_castpd_ps(x3), perm));
+    __m256d bit2 = _mm256_castsi256_pd(_mm256_slli_epi64(ci, 61));
+    __m256d bit3 = _mm256_castsi256_pd(_mm256_slli_epi64(ci, 60));
+    return _mm256_blendv_pd(_mm256_blendv_pd(s0, s1, bit2), _mm256_blendv_pd(s2, s3, bit2), bit3);
+}
+
+__attribute__((target("avx2,fma"))) static inline __m256d fma_chunk_avx2(__m256d acc, __m256d x0, __m256d x1, __m256d x2, __m256d x3,
+                                                                         __m128i idx, const MAT_VAL_TYPE *val, int rem)
+{
+    __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(rem), _mm256_setr_epi64x(0, 1, 2, 3));
+    __m256d xv = _mm256_and_pd(select_x_window_avx2(x0, x1, x2, x3, _mm256_cvtepu8_epi64(idx)), _mm256_castsi256_pd(mask));
+    return _mm256_fmadd_pd(_mm256_maskload_pd(val, mask), xv, acc);
+}
+
+__attribute__((target("avx2,fma"))) MAT_VAL_TYPE blockspmv_cpu_rowblk_avx2(Tile_matrix *matrix,
+                                                                           int blki,
+                                                                           int rowA,
+                                                                           MAT_VAL_TYPE *x,
+                                                                           MAT_VAL_TYPE *y,
+                                                                           MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    int *blknnz = matrix->blknnz;
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    unsigned char *Blockcsr_Ptr = matrix->Blockcsr_Ptr;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
+    __m256d acc[BLOCK_SIZE];
+    MAT_VAL_TYPE sum[BLOCK_SIZE];
+    for (int ri = 0; ri < BLOCK_SIZE; ri++)
+    {
+        acc[ri] = _mm256_setzero_pd();
+        sum[ri] = 0;
+    }
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        MAT_VAL_TYPE *x_win = x + tile_columnidx[blkj] * BLOCK_SIZE;
+        __m256d x0 = _mm256_loadu_pd(x_win);
+        __m256d x1 = _mm256_loadu_pd(x_win + 4);
+        __m256d x2 = _mm256_loadu_pd(x_win + 8);
+        __m256d x3 = _mm256_loadu_pd(x_win + 12);
+        MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+        MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+        for (int ri = 0; ri < rowlength; ri++)
+        {
+            int start = Blockcsr_Ptr[csrcount + ri];
+            int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+            int len = stop - start;
+            if (len <= 0)
+                continue;
+            MAT_PTR_TYPE pos = csroffset + start;
+            if (len < SIMD_ROW_TH)
+            {
+                sum[ri] += short_row_scalar(csr_compressedIdx, Blockcsr_Val, x_win, pos, len);
+                continue;
+            }
+            __m128i idx = decode_nibble_row(csr_compressedIdx, pos);
+            MAT_VAL_TYPE *val = Blockcsr_Val + pos;
+
+            acc[ri] = fma_chunk_avx2(acc[ri], x0, x1, x2, x3, idx, val, len);
+            if (len > 4)
+                acc[ri] = fma_chunk_avx2(acc[ri], x0, x1, x2, x3, _mm_srli_si128(idx, 4), val + 4, len - 4);
+            if (len > 8)
+                acc[ri] = fma_chunk_avx2(acc[ri], x0, x1, x2, x3, _mm_srli_si128(idx, 8), val + 8, len - 8);
+            if (len > 12)
+                acc[ri] = fma_chunk_avx2(acc[ri], x0, x1, x2, x3, _mm_srli_si128(idx, 12), val + 12, len - 12);
+        }
+    }
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc[ri]), _mm256_extractf128_pd(acc[ri], 1));
+        MAT_VAL_TYPE yi = sum[ri] + _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+        y[blki * BLOCK_SIZE + ri] = yi;
+        dot += w[blki * BLOCK_SIZE + ri] * yi;
+    }
+    return dot;
+}
+
+// Packed-value variants. The rows of one tile share its precision class, so the kernels switch once per
+// tile into an always-inlined tile body with prec as a constant and the loads below fold to one path.
+// Full-width loads may run past the row (the stream has PACKED_TAIL_PAD bytes of tail), the extra lanes
+// are masked out of the FMA.
+static inline MAT_VAL_TYPE short_row_packed(const unsigned char *compressed, int prec, const unsigned char *tile_vals, const MAT_VAL_TYPE *x_win, MAT_PTR_TYPE csroffset, int start, int len)
+{
+    MAT_VAL_TYPE sum = 0;
+    for (int rj = start; rj < start + len; rj++)
+    {
+        MAT_PTR_TYPE pos = csroffset + rj;
+        int csrcol = pos % 2 == 0 ? (compressed[pos / 2] & num_f) >> 4 : compressed[pos / 2] & num_b;
+        sum += x_win[csrcol] * packed_val(prec, tile_vals, rj);
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f"), always_inline)) static inline __m512d load8_packed_avx512(int prec, const unsigned char *vals)
+{
+    switch (prec)
+    {
+    case PREC_INT8:
+        return _mm512_cvtepi32_pd(_mm256_cvtepi8_epi32(_mm_loadl_epi64((const __m128i *)vals)));
+    case PREC_FP16:
+        return _mm512_cvtps_pd(_mm512_castps512_ps256(_mm512_cvtph_ps(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)vals)))));
+    case PREC_FP32:
+        return _mm512_cvtps_pd(_mm256_loadu_ps((const float *)vals));
+    default:
+        return _mm512_loadu_pd((const double *)vals);
+    }
+}
+
+__attribute__((target("avx512f"), always_inline)) static inline void packed_tile_avx512(int prec, Tile_matrix *matrix, int blki, int blkj, int rowlength,
+                                                                                        MAT_VAL_TYPE *x, __m512d *acc, MAT_VAL_TYPE *sum)
+{
+    int *blknnz = matrix->blknnz;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    unsigned char *Blockcsr_Ptr = matrix->Blockcsr_Ptr;
+    MAT_VAL_TYPE *x_win = x + matrix->tile_columnidx[blkj] * BLOCK_SIZE;
+    __m512d x_lo = _mm512_loadu_pd(x_win);
+    __m512d x_hi = _mm512_loadu_pd(x_win + 8);
+    MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+    MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+    int bytes = prec_bytes[prec];
+    const unsigned char *tile_vals = matrix->Blockcsr_Val_Packed + tile_packed_start(matrix, blki, blkj);
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        int start = Blockcsr_Ptr[csrcount + ri];
+        int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+        int len = stop - start;
+        if (len <= 0)
+            continue;
+        if (len < SIMD_ROW_TH)
+        {
+            sum[ri] += short_row_packed(csr_compressedIdx, prec, tile_vals, x_win, csroffset, start, len);
+            continue;
+        }
+        __m128i idx = decode_nibble_row(csr_compressedIdx, csroffset + start);
+        const unsigned char *row_vals = tile_vals + start * bytes;
+
+        __mmask8 m = len >= 8 ? 0xFF : (__mmask8)((1 << len) - 1);
+        __m512d xv = _mm512_permutex2var_pd(x_lo, _mm512_cvtepu8_epi64(idx), x_hi);
+        acc[ri] = _mm512_mask3_fmadd_pd(load8_packed_avx512(prec, row_vals), xv, acc[ri], m);
+        if (len > 8)
+        {
+            m = len >= 16 ? 0xFF : (__mmask8)((1 << (len - 8)) - 1);
+            xv = _mm512_permutex2var_pd(x_lo, _mm512_cvtepu8_epi64(_mm_srli_si128(idx, 8)), x_hi);
+            acc[ri] = _mm512_mask3_fmadd_pd(load8_packed_avx512(prec, row_vals + 8 * bytes), xv, acc[ri], m);
+        }
+    }
+}
+
+__attribute__((target("avx512f"))) MAT_VAL_TYPE blockspmv_cpu_rowblk_packed_avx512(Tile_matrix *matrix,
+                                                                                   int blki,
+                                                                                   int rowA,
+                                                                                   MAT_VAL_TYPE *x,
+                                                                                   MAT_VAL_TYPE *y,
+                                                                                   MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    char *tile_prec = matrix->tile_prec;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
+    __m512d acc[BLOCK_SIZE];
+    MAT_VAL_TYPE sum[BLOCK_SIZE];
+    for (int ri = 0; ri < BLOCK_SIZE; ri++)
+    {
+        acc[ri] = _mm512_setzero_pd();
+        sum[ri] = 0;
+    }
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        switch (tile_prec[blkj])
+        {
+        case PREC_INT8:
+            packed_tile_avx512(PREC_INT8, matrix, blki, blkj, rowlength, x, acc, sum);
+            break;
+        case PREC_FP16:
+            packed_tile_avx512(PREC_FP16, matrix, blki, blkj, rowlength, x, acc, sum);
+            break;
+        case PREC_FP32:
+            packed_tile_avx512(PREC_FP32, matrix, blki, blkj, rowlength, x, acc, sum);
+            break;
+        default:
+            packed_tile_avx512(PREC_FP64, matrix, blki, blkj, rowlength, x, acc, sum);
+        }
+    }
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        MAT_VAL_TYPE yi = sum[ri] + _mm512_reduce_add_pd(acc[ri]);
+        y[blki * BLOCK_SIZE + ri] = yi;
+        dot += w[blki * BLOCK_SIZE + ri] * yi;
+    }
+    return dot;
+}
+
+__attribute__((target("avx2,f16c"), always_inline)) static inline __m256d load4_packed_avx2(int prec, const unsigned char *vals)
+{
+    int word;
+    switch (prec)
+    {
+    case PREC_INT8:
+        memcpy(&word, vals, sizeof(int));
+        return _mm256_cvtepi32_pd(_mm_cvtepi8_epi32(_mm_cvtsi32_si128(word)));
+    case PREC_FP16:
+        return _mm256_cvtps_pd(_mm_cvtph_ps(_mm_loadl_epi64((const __m128i *)vals)));
+    case PREC_FP32:
+        return _mm256_cvtps_pd(_mm_loadu_ps((const float *)vals));
+    default:
+        return _mm256_loadu_pd((const double *)vals);
+    }
+}
+
+__attribute__((target("avx2,fma,f16c"), always_inline)) static inline __m256d fma_chunk_packed_avx2(__m256d acc, __m256d x0, __m256d x1, __m256d x2, __m256d x3,
+                                                                                                   __m128i idx, int prec, const unsigned char *vals, int rem)
+{
+    __m256d mask = _mm256_castsi256_pd(_mm256_cmpgt_epi64(_mm256_set1_epi64x(rem), _mm256_setr_epi64x(0, 1, 2, 3)));
+    __m256d xv = _mm256_and_pd(select_x_window_avx2(x0, x1, x2, x3, _mm256_cvtepu8_epi64(idx)), mask);
+    return _mm256_fmadd_pd(_mm256_and_pd(load4_packed_avx2(prec, vals), mask), xv, acc);
+}
+
+__attribute__((target("avx2,fma,f16c"), always_inline)) static inline void packed_tile_avx2(int prec, Tile_matrix *matrix, int blki, int blkj, int rowlength,
+                                                                                            MAT_VAL_TYPE *x, __m256d *acc, MAT_VAL_TYPE *sum)
+{
+    int *blknnz = matrix->blknnz;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    unsigned char *Blockcsr_Ptr = matrix->Blockcsr_Ptr;
+    MAT_VAL_TYPE *x_win = x + matrix->tile_columnidx[blkj] * BLOCK_SIZE;
+    __m256d x0 = _mm256_loadu_pd(x_win);
+    __m256d x1 = _mm256_loadu_pd(x_win + 4);
+    __m256d x2 = _mm256_loadu_pd(x_win + 8);
+    __m256d x3 = _mm256_loadu_pd(x_win + 12);
+    MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+    MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+    int bytes = prec_bytes[prec];
+    const unsigned char *tile_vals = matrix->Blockcsr_Val_Packed + tile_packed_start(matrix, blki, blkj);
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        int start = Blockcsr_Ptr[csrcount + ri];
+        int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+        int len = stop - start;
+        if (len <= 0)
+            continue;
+        if (len < SIMD_ROW_TH)
+        {
+            sum[ri] += short_row_packed(csr_compressedIdx, prec, tile_vals, x_win, csroffset, start, len);
+            continue;
+        }
+        __m128i idx = decode_nibble_row(csr_compressedIdx, csroffset + start);
+        const unsigned char *row_vals = tile_vals + start * bytes;
+
+        acc[ri] = fma_chunk_packed_avx2(acc[ri], x0, x1, x2, x3, idx, prec, row_vals, len);
+        if (len > 4)
+            acc[ri] = fma_chunk_packed_avx2(acc[ri], x0, x1, x2, x3, _mm_srli_si128(idx, 4), prec, row_vals + 4 * bytes, len - 4);
+        if (len > 8)
+            acc[ri] = fma_chunk_packed_avx2(acc[ri], x0, x1, x2, x3, _mm_srli_si128(idx, 8), prec, row_vals + 8 * bytes, len - 8);
+        if (len > 12)
+            acc[ri] = fma_chunk_packed_avx2(acc[ri], x0, x1, x2, x3, _mm_srli_si128(idx, 12), prec, row_vals + 12 * bytes, len - 12);
+    }
+}
+
+__attribute__((target("avx2,fma,f16c"))) MAT_VAL_TYPE blockspmv_cpu_rowblk_packed_avx2(Tile_matrix *matrix,
+                                                                                       int blki,
+                                                                                       int rowA,
+                                                                                       MAT_VAL_TYPE *x,
+                                                                                       MAT_VAL_TYPE *y,
+                                                                                       MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    char *tile_prec = matrix->tile_prec;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
+    __m256d acc[BLOCK_SIZE];
+    MAT_VAL_TYPE sum[BLOCK_SIZE];
+    for (int ri = 0; ri < BLOCK_SIZE; ri++)
+    {
+        acc[ri] = _mm256_setzero_pd();
+        sum[ri] = 0;
+    }
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        switch (tile_prec[blkj])
+        {
+        case PREC_INT8:
+            packed_tile_avx2(PREC_INT8, matrix, blki, blkj, rowlength, x, acc, sum);
+            break;
+        case PREC_FP16:
+            packed_tile_avx2(PREC_FP16, matrix, blki, blkj, rowlength, x, acc, sum);
+            break;
+        case PREC_FP32:
+            packed_tile_avx2(PREC_FP32, matrix, blki, blkj, rowlength, x, acc, sum);
+            break;
+        default:
+            packed_tile_avx2(PREC_FP64, matrix, blki, blkj, rowlength, x, acc, sum);
+        }
+    }
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        __m128d s = _mm_add_pd(_mm256_castpd256_pd128(acc[ri]), _mm256_extractf128_pd(acc[ri], 1));
+        MAT_VAL_TYPE yi = sum[ri] + _mm_cvtsd_f64(_mm_add_sd(s, _mm_unpackhi_pd(s, s)));
+        y[blki * BLOCK_SIZE + ri] = yi;
+        dot += w[blki * BLOCK_SIZE + ri] * yi;
+    }
+    return dot;
+}
+
+// widest kernel the CPUID bits allow, capped by SIMD_LEVEL_MAX
+int blockspmv_cpu_simd_level(void)
+{
+    __builtin_cpu_init();
+    if (SIMD_LEVEL_MAX >= SIMD_AVX512 && __builtin_cpu_supports("avx512f"))
+        return SIMD_AVX512;
+    if (SIMD_LEVEL_MAX >= SIMD_AVX2 && __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+        return SIMD_AVX2;
+    return SIMD_SCALAR;
+}
+
+// the SIMD kernels are written for 16-wide tiles, 8 and 32 run the scalar kernel of their size
+blockspmv_rowblk_kernel blockspmv_cpu_select(int level, int tile_size)
+{
+    if (tile_size == 8)
+        return blockspmv_cpu_rowblk<8>;
+    if (tile_size == 32)
+        return blockspmv_cpu_rowblk<32>;
+    switch (level)
+    {
+    case SIMD_AVX512:
+        return blockspmv_cpu_rowblk_avx512;
+    case SIMD_AVX2:
+        return blockspmv_cpu_rowblk_avx2;
+    default:
+        return blockspmv_cpu_rowblk<16>;
+    }
+}
+
+blockspmv_rowblk_kernel blockspmv_cpu_select_packed(int level, int tile_size)
+{
+    if (tile_size == 8)
+        return blockspmv_cpu_rowblk_packed<8>;
+    if (tile_size == 32)
+        return blockspmv_cpu_rowblk_packed<32>;
+    switch (level)
+    {
+    case SIMD_AVX512:
+        return blockspmv_cpu_rowblk_packed_avx512;
+    case SIMD_AVX2:
+        return blockspmv_cpu_rowblk_packed_avx2;
+    default:
+        return blockspmv_cpu_rowblk_packed<16>;
+    }
+}
+
+const char *blockspmv_cpu_simd_name(int level)
+{
+    return level == SIMD_AVX512 ? "avx512" : (level == SIMD_AVX2 ? "avx2" : "scalar");
+}
+
+#endif
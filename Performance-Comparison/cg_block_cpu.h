@@ -0,0 +1,200 @@
+#ifndef _CG_BLOCK_CPU_H_
+#define _CG_BLOCK_CPU_H_
+
+#include "common.h"
+#include "cg_cpu.h"
+#include "blockspmm_cpu.h"
+
+// CG on nrhs right-hand sides at once: one SpMM per iteration feeds nrhs independent CG recurrences, each
+// with its own alpha, beta and stopping test. A column that has converged gets alpha = 0 and keeps its x
+// and r, the loop ends when every column has converged. b and x hold the vectors interleaved, entry
+// (i, j) at i * nrhs + j.
+void cg_solve_block_cpu(MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *x, double *b, int n, int nrhs, int *iter, int maxiter, double threshold, char *filename, MAT_PTR_TYPE nnzR, int ori, int tile_size)
+{
+    struct timeval t1, t2, t5, t6;
+    int rowA = n;
+    int colA = ori;
+
+    gettimeofday(&t5, NULL);
+    Tile_matrix *matrix = (Tile_matrix *)calloc(1, sizeof(Tile_matrix));
+    tile_cache_map cache_map = {NULL, 0};
+    int cache_state = cg_cpu_tile_setup(matrix, &cache_map, RowPtr, ColIdx, Val, rowA, colA, nnzR, filename, tile_size, 0);
+    tile_size = matrix->tile_size;
+    int tilem = matrix->tilem;
+    int tilen = matrix->tilen;
+    int nthreads = omp_get_max_threads();
+    int *rowblk_start = (int *)malloc(sizeof(int) * (nthreads + 1));
+    double imbalance = cpu_rowblk_partition(matrix, rowA, nthreads, rowblk_start);
+    blockspmm_rowblk_kernel spmm_rowblk = blockspmm_cpu_select(tile_size);
+    gettimeofday(&t6, NULL);
+    double time_format = (t6.tv_sec - t5.tv_sec) * 1000.0 + (t6.tv_usec - t5.tv_usec) / 1000.0;
+    printf("num_thread=%d nrhs=%d tile_size=%d tilem=%d tilen=%d tilenum=%d n=%d tile_cache=%s imbalance=%.3f\n", nthreads, nrhs, tile_size, tilem, tilen, matrix->tilenum, rowA,
+           cache_state == TILE_CACHE_OK ? "hit" : (cache_state == TILE_CACHE_STALE ? "stale" : "miss"), imbalance);
+
+    // D is read through tile_columnidx, so it spans every column block and stays zero past rowA
+    int vec_len = (tilem > tilen ? tilem : tilen) * tile_size;
+    size_t blk_len = (size_t)vec_len * nrhs;
+    double *k_x = (double *)malloc(sizeof(double) * blk_len);
+    double *k_r = (double *)malloc(sizeof(double) * blk_len);
+    double *k_d = (double *)malloc(sizeof(double) * blk_len);
+    double *k_q = (double *)malloc(sizeof(double) * blk_len);
+    memset(k_x, 0, sizeof(double) * blk_len);
+    memset(k_r, 0, sizeof(double) * blk_len);
+    memset(k_d, 0, sizeof(double) * blk_len);
+    memset(k_q, 0, sizeof(double) * blk_len);
+    // one nrhs-wide slot of partials per thread, padded to PARTIAL_STRIDE
+    int stride = (nrhs + PARTIAL_STRIDE - 1) / PARTIAL_STRIDE * PARTIAL_STRIDE;
+    double *dot_partial = (double *)malloc(sizeof(double) * nthreads * stride);
+    double *snew_partial = (double *)malloc(sizeof(double) * nthreads * stride);
+    memset(dot_partial, 0, sizeof(double) * nthreads * stride);
+    memset(snew_partial, 0, sizeof(double) * nthreads * stride);
+
+    // R = B - AX (R = B since X = 0), and D = R
+    memcpy(k_r, b, sizeof(double) * rowA * nrhs);
+    memcpy(k_d, k_r, sizeof(double) * rowA * nrhs);
+    double *snew = (double *)malloc(sizeof(double) * nrhs);
+    double *limit = (double *)malloc(sizeof(double) * nrhs);
+    for (int j = 0; j < nrhs; j++)
+        snew[j] = 0;
+    for (int i = 0; i < rowA; i++)
+        for (int j = 0; j < nrhs; j++)
+            snew[j] += k_r[i * nrhs + j] * k_r[i * nrhs + j];
+    for (int j = 0; j < nrhs; j++)
+        limit[j] = threshold * threshold * snew[j];
+
+    cpu_signal signal_dot = {0, 0};
+    cpu_signal signal_final = {0, 0};
+    int iterations = 0;
+    gettimeofday(&t1, NULL);
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = rowblk_start[tid];
+        int blk_stop = rowblk_start[tid + 1];
+        size_t row_start = (size_t)blk_start * tile_size * nrhs;
+        size_t row_stop = (size_t)(blk_stop * tile_size < rowA ? blk_stop * tile_size : rowA) * nrhs;
+        double *dot_local = dot_partial + tid * stride;
+        double *snew_mine = snew_partial + tid * stride;
+        double *snew_local = (double *)malloc(sizeof(double) * nrhs * 3);
+        double *alpha = snew_local + nrhs;
+        double *beta = snew_local + 2 * nrhs;
+        memcpy(snew_local, snew, sizeof(double) * nrhs);
+        int active = 0;
+        for (int j = 0; j < nrhs; j++)
+            active += snew_local[j] > limit[j];
+        int iter_local = 0;
+
+        while (iter_local < maxiter && active)
+        {
+            // Q = AD
+            for (int blki = blk_start; blki < blk_stop; blki++)
+                spmm_rowblk(matrix, blki, rowA, nrhs, k_d, k_q);
+            deferred_coo_spmm(matrix, blk_start * tile_size, (int)(row_stop / nrhs), nrhs, k_d, k_q);
+            for (int j = 0; j < nrhs; j++)
+                dot_local[j] = 0;
+            for (size_t i = row_start; i < row_stop; i += nrhs)
+                for (int j = 0; j < nrhs; j++)
+                    dot_local[j] += k_d[i + j] * k_q[i + j];
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // alpha_j = snew_j / d_j.q_j on the columns still running, X += alpha D, R -= alpha Q
+            for (int j = 0; j < nrhs; j++)
+            {
+                double dq = 0;
+                for (int t = 0; t < nthreads; t++)
+                    dq += dot_partial[t * stride + j];
+                alpha[j] = snew_local[j] > limit[j] ? snew_local[j] / dq : 0;
+                snew_mine[j] = 0;
+            }
+            for (size_t i = row_start; i < row_stop; i += nrhs)
+                for (int j = 0; j < nrhs; j++)
+                {
+                    k_x[i + j] += alpha[j] * k_d[i + j];
+                    k_r[i + j] -= alpha[j] * k_q[i + j];
+                    snew_mine[j] += k_r[i + j] * k_r[i + j];
+                }
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // beta_j = snew_j / sold_j, D = R + beta D
+            active = 0;
+            for (int j = 0; j < nrhs; j++)
+            {
+                double sold = snew_local[j];
+                snew_local[j] = 0;
+                for (int t = 0; t < nthreads; t++)
+                    snew_local[j] += snew_partial[t * stride + j];
+                beta[j] = snew_local[j] / sold;
+                active += snew_local[j] > limit[j];
+            }
+            for (size_t i = row_start; i < row_stop; i += nrhs)
+                for (int j = 0; j < nrhs; j++)
+                    k_d[i + j] = k_r[i + j] + beta[j] * k_d[i + j];
+            cpu_signal_wait(&signal_final, nthreads);
+            iter_local++;
+        }
+        if (tid == 0)
+        {
+            iterations = iter_local;
+            memcpy(snew, snew_local, sizeof(double) * nrhs);
+        }
+        free(snew_local);
+    }
+    gettimeofday(&t2, NULL);
+    double time_cg = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    double time_iter = iterations ? time_cg / iterations : 0;
+    double Gflops_cg = iterations ? ((2.0 * nnzR + 10.0 * rowA) * nrhs * iterations) / (time_cg * pow(10, 6)) : 0;
+    *iter = iterations;
+    memcpy(x, k_x, sizeof(double) * rowA * nrhs);
+
+    // the worst ||b_j - Ax_j|| / ||b_j|| on the CSR input
+    double l2_norm = 0;
+    double rr_max = 0;
+    for (int j = 0; j < nrhs; j++)
+    {
+        double sum = 0;
+        double sum_ori = 0;
+        for (int i = 0; i < rowA; i++)
+        {
+            double ax = 0;
+            for (MAT_PTR_TYPE k = RowPtr[i]; k < RowPtr[i + 1]; k++)
+                ax += Val[k] * (ColIdx[k] < rowA ? x[ColIdx[k] * nrhs + j] : 0);
+            sum += (b[i * nrhs + j] - ax) * (b[i * nrhs + j] - ax);
+            sum_ori += b[i * nrhs + j] * b[i * nrhs + j];
+        }
+        l2_norm = fmax(l2_norm, sqrt(sum) / sqrt(sum_ori));
+        rr_max = fmax(rr_max, sqrt(snew[j]));
+    }
+    printf("iter=%d,time_cg=%lf ms,time_iter=%lf ms,time_per_rhs=%lf ms,Gflops=%lf,time_format=%lf ms\n", iterations, time_cg, time_iter, time_cg / nrhs, Gflops_cg, time_format);
+    printf("%e\n", rr_max);
+    printf("%e\n", l2_norm);
+
+    char *s = (char *)malloc(sizeof(char) * 256);
+    sprintf(s, "nrhs=%d,iter=%d,time_iter=%.3f,time_cg=%.3f,nnzR=%lld,l2_norm=%e,time_format=%lf,gflops=%lf,nthreads=%d,tile_size=%d\n", nrhs, iterations, time_iter, time_cg, (long long)nnzR, l2_norm, time_format, Gflops_cg, nthreads, tile_size);
+    FILE *file1 = fopen("cg_cpu_block.csv", "a");
+    if (file1 == NULL)
+    {
+        printf("open error!\n");
+    }
+    else
+    {
+        fwrite(filename, strlen(filename), 1, file1);
+        fwrite(",", strlen(","), 1, file1);
+        fwrite(s, strlen(s), 1, file1);
+        fclose(file1);
+    }
+    free(s);
+
+    free(k_x);
+    free(k_r);
+    free(k_d);
+    free(k_q);
+    free(dot_partial);
+    free(snew_partial);
+    free(snew);
+    free(limit);
+    free(rowblk_start);
+    cg_cpu_tile_release(matrix, &cache_map, cache_state);
+    free(matrix);
+}
+
+#endif
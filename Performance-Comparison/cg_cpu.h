@@ -0,0 +1,698 @@
+#ifndef _CG_CPU_H_
+#define _CG_CPU_H_
+
+#include <sched.h>
+#include "common.h"
+#include "csr2block.h"
+#include "blockspmv_cpu.h"
+#include "blockspmv_cpu_simd.h"
+#include "tile_cache.h"
+#include "spmv_bypass.h"
+#include "tile_partition.h"
+#include "tile_size.h"
+#include "block_jacobi.h"
+#include "tile_format.h"
+#include "deferred_coo.h"
+#include "tile_refresh.h"
+#include "numa_place.h"
+#include "utils.h"
+
+// host counterpart of signal_dot/signal_final: a counter the threads arrive on and a phase the last one flips
+typedef struct
+{
+    int count;
+    int phase;
+} cpu_signal;
+
+void cpu_signal_wait(cpu_signal *signal, int nthreads)
+{
+    int my_phase, arrived, cur;
+#pragma omp flush
+#pragma omp atomic read seq_cst
+    my_phase = signal->phase;
+#pragma omp atomic capture seq_cst
+    arrived = ++signal->count;
+    if (arrived == nthreads)
+    {
+#pragma omp atomic write seq_cst
+        signal->count = 0;
+#pragma omp atomic update seq_cst
+        signal->phase++;
+    }
+    else
+    {
+        int spin = 0;
+        do
+        {
+#pragma omp atomic read seq_cst
+            cur = signal->phase;
+            if (++spin == SPIN_YIELD_TH)
+            {
+                spin = 0;
+                sched_yield();
+            }
+        } while (cur == my_phase);
+    }
+#pragma omp flush
+}
+
+// sum the per-thread partials in thread order so every thread gets the same bits
+double cpu_partial_sum(double *partial, int nthreads)
+{
+    double sum = 0;
+    for (int t = 0; t < nthreads; t++)
+        sum += partial[t * PARTIAL_STRIDE];
+    return sum;
+}
+
+// split the row blocks into nthreads contiguous ranges of about equal nnz, returns the imbalance ratio
+double cpu_rowblk_partition(Tile_matrix *matrix, int rowA, int nthreads, int *rowblk_start)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *rowblk_nnz = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (tilem + 1));
+    // deferred entries count toward the row block they are added to
+    for (int blki = 0; blki <= tilem; blki++)
+        rowblk_nnz[blki] = matrix->rowblk_base[blki] +
+                           (matrix->coototal ? matrix->deferredcoo_ptr[blki < tilem ? blki * matrix->tile_size : rowA] : 0);
+
+    tile_partition part;
+    tile_partition_create(&part, rowblk_nnz, tilem, nthreads, 0);
+    memcpy(rowblk_start, part.part_ptr, sizeof(int) * (nthreads + 1));
+    double imbalance = part.imbalance;
+    tile_partition_destroy(&part);
+    free(rowblk_nnz);
+    return imbalance;
+}
+
+// build the tile matrix of the CSR input at tile_size, or map it from the tile cache when that is current;
+// tile_size 0 takes a cached tiling of any size or else tile_size_select's, simd says whether the 16-wide
+// SIMD kernels will run. A NULL filename skips the cache. Returns the TILE_CACHE_* state
+int cg_cpu_tile_setup(Tile_matrix *matrix, tile_cache_map *cache_map, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val,
+                      int rowA, int colA, MAT_PTR_TYPE nnzR, char *filename, int tile_size, int simd)
+{
+    int cache_state = TILE_CACHE_MISSING;
+    double prec_tol = TILE_PRECISION ? TILE_PREC_TOL : -1;
+    int defer_th = deferred_coo_threshold(16);
+#if TILE_CACHE
+    char cache_name[512];
+    uint64_t source_hash = 0;
+    if (filename && !tile_cache_name(cache_name, sizeof(cache_name), filename))
+        filename = NULL;
+    if (filename)
+    {
+        source_hash = tile_cache_source_hash(rowA, colA, nnzR, RowPtr, ColIdx, Val);
+        cache_state = tile_cache_load(cache_name, matrix, cache_map, tile_size, rowA, colA, nnzR, prec_tol, defer_th, source_hash);
+    }
+#endif
+    if (cache_state != TILE_CACHE_OK)
+    {
+        if (tile_size == 0)
+            tile_size = tile_size_select(rowA, colA, RowPtr, ColIdx, simd);
+#if DEFERRED_COO
+        Tile_create_deferred(matrix, tile_size,
+                             rowA, colA, nnzR,
+                             RowPtr,
+                             ColIdx,
+                             Val,
+                             NULL, prec_tol);
+#else
+        Tile_create_sized(matrix, tile_size,
+                          rowA, colA, nnzR,
+                          RowPtr,
+                          ColIdx,
+                          Val,
+                          NULL, prec_tol, NULL);
+#endif
+#if TILE_CACHE
+        if (filename)
+            tile_cache_save(cache_name, matrix, rowA, colA, nnzR, prec_tol, defer_th, source_hash);
+#endif
+    }
+    return cache_state;
+}
+
+void cg_cpu_tile_release(Tile_matrix *matrix, tile_cache_map *cache_map, int cache_state)
+{
+    if (cache_state == TILE_CACHE_OK)
+    {
+        tile_cache_close(cache_map);
+    }
+    else
+    {
+        tile_pack_destroy(matrix);
+        Tile_destroy(matrix);
+    }
+}
+
+// Everything a solve needs that depends only on the matrix: the tiles, the row-block partition, the kernels,
+// the preconditioner and CPU_OP_VECS work vectors with their per-thread partials. cpu_tile_op_create builds
+// it once and every CG, pipelined CG or BiCGSTAB solve on the matrix reuses it without allocating.
+#define CPU_OP_VECS 8
+#define CPU_OP_PARTIALS 3
+
+typedef struct
+{
+    int rowA;
+    int colA;
+    MAT_PTR_TYPE nnzR;
+    Tile_matrix *matrix;
+    tile_cache_map cache_map;
+    int cache_state;
+    int tile_size;
+    int tilem;
+    int tilen;
+    int vec_len;
+    int nthreads;
+    int *rowblk_start;
+    double imbalance;
+    int simd_level;
+    double val_bytes;
+    blockspmv_rowblk_kernel spmv_rowblk;
+#if CG_BLOCK_JACOBI
+    block_jacobi bj;
+#endif
+#if TILE_FORMAT
+    tile_format tf;
+    tile_format_kernel spmv_format;
+#endif
+#if SPMV_BYPASS
+    spmv_bypass bypass;
+    int bypass_maxiter;
+    blockspmv_delta_kernel spmv_delta;
+#endif
+    double *vec[CPU_OP_VECS];
+    double *partial[CPU_OP_PARTIALS];
+    arena mem; // rowblk_start, vec and partial
+#if NUMA_PLACE
+    numa_place numa;
+#endif
+#if TILE_REFRESH
+    tile_refresh tr;
+    int tr_recorded;
+#endif
+    double time_setup;
+} cpu_tile_op;
+
+// n x ori CSR input, every row is kept: the last row and column blocks may be partial, the kernels stop at
+// rowA and the vectors are padded to whole tiles once, here. tile_size 0 lets cg_cpu_tile_setup choose
+void cpu_tile_op_create(cpu_tile_op *op, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, int n, int ori, MAT_PTR_TYPE nnzR, char *filename, int tile_size)
+{
+    struct timeval t5, t6;
+    gettimeofday(&t5, NULL);
+    int rowA = n;
+    op->rowA = rowA;
+    op->colA = ori;
+    op->nnzR = nnzR;
+    op->matrix = (Tile_matrix *)calloc(1, sizeof(Tile_matrix));
+    op->cache_map.base = NULL;
+    op->cache_map.length = 0;
+    op->cache_state = cg_cpu_tile_setup(op->matrix, &op->cache_map, RowPtr, ColIdx, Val, rowA, ori, nnzR, filename, tile_size, blockspmv_cpu_simd_level() == SIMD_AVX512);
+    Tile_matrix *matrix = op->matrix;
+    op->tile_size = matrix->tile_size;
+    op->tilem = matrix->tilem;
+    op->tilen = matrix->tilen;
+    op->nthreads = omp_get_max_threads();
+    // the vectors are read through tile_columnidx, so they span every column block and stay zero past rowA
+    op->vec_len = (op->tilem > op->tilen ? op->tilem : op->tilen) * op->tile_size;
+    size_t vec_bytes = sizeof(double) * op->vec_len;
+    size_t partial_bytes = sizeof(double) * op->nthreads * PARTIAL_STRIDE;
+    arena_create(&op->mem, arena_bytes(sizeof(int) * (op->nthreads + 1)) + CPU_OP_VECS * arena_bytes(vec_bytes) +
+                               CPU_OP_PARTIALS * arena_bytes(partial_bytes));
+    op->rowblk_start = (int *)arena_alloc(&op->mem, sizeof(int) * (op->nthreads + 1));
+    op->imbalance = cpu_rowblk_partition(matrix, rowA, op->nthreads, op->rowblk_start);
+    // the per-tile format kernels are scalar
+    op->simd_level = op->tile_size == 16 && !TILE_FORMAT ? blockspmv_cpu_simd_level() : SIMD_SCALAR;
+    op->spmv_rowblk = matrix->Blockcsr_Val_Packed ? blockspmv_cpu_select_packed(op->simd_level, op->tile_size) : blockspmv_cpu_select(op->simd_level, op->tile_size);
+    op->val_bytes = sizeof(MAT_VAL_TYPE);
+#if CG_BLOCK_JACOBI
+    block_jacobi_create(&op->bj, matrix, rowA);
+#endif
+#if TILE_FORMAT
+    tile_format_create(&op->tf, matrix, rowA, ori);
+    op->spmv_format = tile_format_select(op->tile_size);
+#endif
+
+#if TILE_REFRESH
+    op->tr_recorded = 0;
+#endif
+    // zero from the fresh arena pages
+    for (int v = 0; v < CPU_OP_VECS; v++)
+        op->vec[v] = (double *)arena_alloc(&op->mem, vec_bytes);
+    for (int p = 0; p < CPU_OP_PARTIALS; p++)
+        op->partial[p] = (double *)arena_alloc(&op->mem, partial_bytes);
+#if NUMA_PLACE
+    // the solvers keep this thread count, so the pinned threads keep their row blocks
+    numa_place_create(&op->numa, op->nthreads);
+    if (op->cache_state != TILE_CACHE_OK || tile_cache_writable(&op->cache_map))
+        numa_place_tiles(&op->numa, matrix, rowA, op->rowblk_start);
+    numa_place_vectors(&op->numa, op->vec, CPU_OP_VECS, op->vec_len, op->tile_size, op->rowblk_start);
+#endif
+#if SPMV_BYPASS
+    op->bypass_maxiter = 0;
+    op->spmv_delta = spmv_bypass_select(op->tile_size);
+#endif
+    gettimeofday(&t6, NULL);
+    op->time_setup = (t6.tv_sec - t5.tv_sec) * 1000.0 + (t6.tv_usec - t5.tv_usec) / 1000.0;
+}
+
+void cpu_tile_op_destroy(cpu_tile_op *op)
+{
+    arena_destroy(&op->mem);
+#if NUMA_PLACE
+    numa_place_destroy(&op->numa);
+#endif
+#if CG_BLOCK_JACOBI
+    block_jacobi_destroy(&op->bj);
+#endif
+#if TILE_FORMAT
+    tile_format_destroy(&op->tf);
+#endif
+#if SPMV_BYPASS
+    if (op->bypass_maxiter)
+        spmv_bypass_destroy(&op->bypass);
+#endif
+#if TILE_REFRESH
+    if (op->tr_recorded)
+    {
+        // a refresh that widened tiles of a cached matrix moved its packed stream to the heap
+        if (op->cache_state == TILE_CACHE_OK && op->tr.packed_owned)
+            free(op->matrix->Blockcsr_Val_Packed);
+        tile_refresh_destroy(&op->tr);
+    }
+#endif
+    cg_cpu_tile_release(op->matrix, &op->cache_map, op->cache_state);
+    free(op->matrix);
+}
+
+#if TILE_REFRESH
+// record where the CSR nonzeros of op were stored, for cpu_tile_op_refresh; RowPtr and ColIdx as given to create.
+// A matrix mapped from the tile cache is made writable in memory here. Returns 0 if that fails
+int cpu_tile_op_record(cpu_tile_op *op, MAT_PTR_TYPE *RowPtr, int *ColIdx)
+{
+    if (op->cache_state == TILE_CACHE_OK && !tile_cache_writable(&op->cache_map))
+        return 0;
+    tile_refresh_create(&op->tr, op->matrix, op->rowA, RowPtr, ColIdx, TILE_PRECISION ? TILE_PREC_TOL : -1,
+                        op->cache_state != TILE_CACHE_OK);
+    op->tr_recorded = 1;
+    return 1;
+}
+
+// new values Val on the pattern op was created with: scatter them into the tiles and the deferred CSR, then
+// refactor the block-Jacobi inverses and refill the per-tile formats. Returns tile_refresh_apply's count of
+// values a packed tile's precision class could not hold; those tiles were widened and op is exact either way
+int cpu_tile_op_refresh(cpu_tile_op *op, MAT_VAL_TYPE *Val)
+{
+    int misfit = tile_refresh_apply(&op->tr, op->matrix, Val);
+#if NUMA_PLACE
+    // the widened tiles got a new packed stream
+    if (misfit)
+        numa_place_tiles(&op->numa, op->matrix, op->rowA, op->rowblk_start);
+#endif
+#if CG_BLOCK_JACOBI
+    block_jacobi_factor(&op->bj, op->matrix, op->rowA);
+#endif
+#if TILE_FORMAT
+    // the format streams are laid out by precision class, widened tiles need them built again
+    if (misfit)
+    {
+        tile_format_destroy(&op->tf);
+        tile_format_create(&op->tf, op->matrix, op->rowA, op->colA);
+    }
+    else
+        tile_format_refresh(&op->tf, op->matrix, op->rowA);
+#endif
+    return misfit;
+}
+#endif
+
+#if NUMA_PLACE
+void cpu_tile_op_numa_report(cpu_tile_op *op);
+#endif
+
+// the setup summary, extra is appended to the first line
+void cpu_tile_op_print(cpu_tile_op *op, const char *extra)
+{
+    Tile_matrix *matrix = op->matrix;
+    printf("num_thread=%d tile_size=%d tilem=%d tilen=%d tilenum=%d n=%d simd=%s tile_cache=%s imbalance=%.3f%s\n", op->nthreads, op->tile_size, op->tilem, op->tilen, matrix->tilenum, op->rowA,
+           blockspmv_cpu_simd_name(op->simd_level), op->cache_state == TILE_CACHE_OK ? "hit" : (op->cache_state == TILE_CACHE_STALE ? "stale" : "miss"), op->imbalance, extra);
+    if (matrix->coototal)
+        printf("deferred_coo nnz=%lld (%.1f%% of nnz) th=%d\n", (long long)matrix->coototal, 100.0 * matrix->coototal / op->nnzR, deferred_coo_threshold(op->tile_size));
+    if (matrix->Blockcsr_Val_Packed)
+    {
+        long long prec_nnz[PREC_NUM];
+        tile_pack_stats(matrix, prec_nnz, &op->val_bytes);
+        printf("prec fp64=%lld fp32=%lld fp16=%lld int8=%lld val_bytes_per_nnz=%.2f\n", prec_nnz[PREC_FP64], prec_nnz[PREC_FP32], prec_nnz[PREC_FP16], prec_nnz[PREC_INT8], op->val_bytes);
+    }
+#if TILE_FORMAT
+    tile_format_bench(&op->tf, matrix, op->rowA, op->vec_len, TILE_FMT_BENCH);
+    tile_format_print(&op->tf);
+#endif
+#if NUMA_PLACE
+    cpu_tile_op_numa_report(op);
+#endif
+}
+
+// y = Ax on row blocks blk_start..blk_stop-1 with the tile sweep and then the deferred entries, returns w.y
+static inline double cpu_tile_op_spmv(cpu_tile_op *op, int blk_start, int blk_stop, double *x, double *y, double *w)
+{
+    double dot = 0;
+    for (int blki = blk_start; blki < blk_stop; blki++)
+#if TILE_FORMAT
+        dot += op->spmv_format(&op->tf, op->matrix, blki, op->rowA, x, y, w);
+#else
+        dot += op->spmv_rowblk(op->matrix, blki, op->rowA, x, y, w);
+#endif
+    int row_stop = blk_stop * op->tile_size < op->rowA ? blk_stop * op->tile_size : op->rowA;
+    return dot + deferred_coo_spmv(op->matrix, blk_start * op->tile_size, row_stop, x, y, w);
+}
+
+#if NUMA_PLACE
+// NUMA_BENCH SpMVs with every thread on its own row blocks. A thread's bytes are what it streams from the
+// matrix plus its rows of y; a node's bandwidth is the bytes of its threads over the slowest of them
+void cpu_tile_op_numa_report(cpu_tile_op *op)
+{
+    Tile_matrix *matrix = op->matrix;
+    numa_place *np = &op->numa;
+    int ts = op->tile_size;
+    double *bytes = (double *)calloc(op->nthreads, sizeof(double));
+    double *time = (double *)calloc(op->nthreads, sizeof(double));
+#pragma omp parallel num_threads(op->nthreads)
+    {
+        int t = omp_get_thread_num();
+        int b0 = op->rowblk_start[t], b1 = op->rowblk_start[t + 1];
+        int r0 = b0 * ts < op->rowA ? b0 * ts : op->rowA;
+        int r1 = b1 * ts < op->rowA ? b1 * ts : op->rowA;
+        MAT_PTR_TYPE v0 = matrix->rowblk_base[b0], v1 = matrix->rowblk_base[b1];
+        double b = matrix->Blockcsr_Val_Packed ? (double)(matrix->rowblk_packed_base[b1] - matrix->rowblk_packed_base[b0]) : (double)(v1 - v0) * sizeof(MAT_VAL_TYPE);
+        b += numa_idx_bytes(ts, v1) - numa_idx_bytes(ts, v0);
+        b += (double)(matrix->tile_ptr[b1] - matrix->tile_ptr[b0]) * (ts * (ts == 32 ? 2 : 1) + sizeof(int));
+        b += (double)(r1 - r0) * sizeof(double);
+        if (matrix->coototal)
+            b += (double)(matrix->deferredcoo_ptr[r1] - matrix->deferredcoo_ptr[r0]) * (sizeof(MAT_VAL_TYPE) + sizeof(int));
+        bytes[t] = b * NUMA_BENCH;
+#pragma omp barrier
+        double t0 = omp_get_wtime();
+        for (int r = 0; r < NUMA_BENCH; r++)
+            cpu_tile_op_spmv(op, b0, b1, op->vec[0], op->vec[1], op->vec[0]);
+        time[t] = omp_get_wtime() - t0;
+    }
+    int pinned = 0;
+    for (int t = 0; t < op->nthreads; t++)
+        pinned += np->thread_cpu[t] >= 0;
+    printf("numa nodes=%d pinned=%d/%d\n", np->nodes, pinned, op->nthreads);
+    double total_bytes = 0, total_time = 0;
+    for (int n = 0; n < np->nodes; n++)
+    {
+        double node_bytes = 0, node_time = 0;
+        int threads = 0, first = -1, blks = 0;
+        for (int t = 0; t < op->nthreads; t++)
+            if (np->thread_node[t] == n)
+            {
+                first = first < 0 ? t : first;
+                threads++;
+                blks += op->rowblk_start[t + 1] - op->rowblk_start[t];
+                node_bytes += bytes[t];
+                node_time = time[t] > node_time ? time[t] : node_time;
+            }
+        total_bytes += node_bytes;
+        total_time = node_time > total_time ? node_time : total_time;
+        printf("numa node%d cpus=%d threads=%d", n, np->node_cpus[n], threads);
+        if (threads)
+            printf(" (%d-%d) rowblks=%d mb=%.1f bw=%.2f GB/s", first, first + threads - 1, blks, node_bytes / NUMA_BENCH / 1e6, node_time > 0 ? node_bytes / node_time / 1e9 : 0);
+        printf("\n");
+    }
+    printf("numa total bw=%.2f GB/s\n", total_time > 0 ? total_bytes / total_time / 1e9 : 0);
+    free(bytes);
+    free(time);
+}
+#endif
+
+// r = b - Ax, or r = b when x is NULL; x must be vec_len long and zero past rowA. Returns ||b||^2
+double cpu_tile_op_residual(cpu_tile_op *op, double *x, double *b, double *r)
+{
+    double bb = 0;
+#pragma omp parallel num_threads(op->nthreads) reduction(+ : bb)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = op->rowblk_start[tid];
+        int blk_stop = op->rowblk_start[tid + 1];
+        int row_start = blk_start * op->tile_size;
+        int row_stop = blk_stop * op->tile_size < op->rowA ? blk_stop * op->tile_size : op->rowA;
+        if (x)
+            cpu_tile_op_spmv(op, blk_start, blk_stop, x, r, x);
+        for (int i = row_start; i < row_stop; i++)
+        {
+            r[i] = x ? b[i] - r[i] : b[i];
+            bb += b[i] * b[i];
+        }
+    }
+    return bb;
+}
+
+// copy the initial guess into k_x (zero without one), zero the other vectors the solver uses, and set k_r = b - A k_x
+double cpu_tile_op_start(cpu_tile_op *op, int nvec, double *x0, double *b)
+{
+    for (int v = 0; v < nvec; v++)
+        memset(op->vec[v], 0, sizeof(double) * op->vec_len);
+    if (x0)
+        memcpy(op->vec[0], x0, sizeof(double) * op->rowA);
+    return cpu_tile_op_residual(op, x0 ? op->vec[0] : NULL, b, op->vec[1]);
+}
+
+// ||b - Ax|| / ||b|| on the CSR input
+double cpu_csr_relres(MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, int rowA, double *x, double *b)
+{
+    double sum = 0;
+    double sum_ori = 0;
+    for (int i = 0; i < rowA; i++)
+    {
+        double ax = 0;
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            ax += Val[j] * (ColIdx[j] < rowA ? x[ColIdx[j]] : 0);
+        sum += (b[i] - ax) * (b[i] - ax);
+        sum_ori += b[i] * b[i];
+    }
+    return sqrt(sum) / sqrt(sum_ori);
+}
+
+// CG on op in one persistent parallel region, each thread owns a row-block range of q, x, r and d. Starts from
+// x0 (zero when NULL) and stops at ||r|| <= tol ||b|| or maxiter; x gets the solution, *res the final r.r
+int cg_cpu_iterate(cpu_tile_op *op, double *b, double *x, double *x0, int maxiter, double tol, double *res)
+{
+    int rowA = op->rowA;
+    int tile_size = op->tile_size;
+    int tilem = op->tilem;
+    int nthreads = op->nthreads;
+    int *rowblk_start = op->rowblk_start;
+    double *k_x = op->vec[0];
+    double *k_r = op->vec[1];
+    double *k_d = op->vec[2];
+    double *k_q = op->vec[3];
+    double *k_z = op->vec[4];
+    double *dot_partial = op->partial[0];
+    double *snew_partial = op->partial[1];
+#if SPMV_BYPASS
+    if (op->bypass_maxiter < maxiter)
+    {
+        if (op->bypass_maxiter)
+            spmv_bypass_destroy(&op->bypass);
+        spmv_bypass_create(&op->bypass, op->vec_len, op->tilen, nthreads, maxiter);
+        op->bypass_maxiter = maxiter;
+    }
+    spmv_bypass_reset(&op->bypass, op->vec_len, op->tilen, nthreads);
+    spmv_bypass *bypass = &op->bypass;
+    blockspmv_delta_kernel spmv_delta = op->spmv_delta;
+#endif
+
+    // r = b - Ax, and d = M^(-1)r
+    double threshold = tol * tol * cpu_tile_op_start(op, 5, x0, b);
+    double snew = 0;
+    for (int i = 0; i < rowA; i++)
+        snew += k_r[i] * k_r[i];
+#if CG_BLOCK_JACOBI
+    double rz = 0;
+    for (int blki = 0; blki < tilem; blki++)
+        rz += block_jacobi_apply(&op->bj, blki, blki == tilem - 1 ? rowA - (tilem - 1) * tile_size : tile_size, k_r, k_z);
+    memcpy(k_d, k_z, sizeof(double) * rowA);
+#else
+    memcpy(k_d, k_r, sizeof(double) * rowA);
+#endif
+
+    cpu_signal signal_dot = {0, 0};
+    cpu_signal signal_final = {0, 0};
+    int iterations = 0;
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = rowblk_start[tid];
+        int blk_stop = rowblk_start[tid + 1];
+        int row_start = blk_start * tile_size;
+        int row_stop = blk_stop * tile_size < rowA ? blk_stop * tile_size : rowA;
+        double snew_local = snew;
+#if CG_BLOCK_JACOBI
+        double rz_local = rz;
+#endif
+        int iter_local = 0;
+
+        while (iter_local < maxiter && snew_local > threshold)
+        {
+            // q = Ad
+#if SPMV_BYPASS
+            // or q += A(d - d_ref) over the column blocks that moved, unless most of them did
+            int full = iter_local % SPMV_BYPASS_REFRESH == 0 ||
+                       cpu_partial_sum(bypass->changed_partial, nthreads) > SPMV_BYPASS_FULL_TH * tilem;
+            int skipped = 0;
+            double dq = 0;
+            if (full)
+            {
+                dq = cpu_tile_op_spmv(op, blk_start, blk_stop, k_d, k_q, k_d);
+                spmv_bypass_sync(bypass, k_d, row_start, row_stop);
+            }
+            else
+            {
+                for (int blki = blk_start; blki < blk_stop; blki++)
+                    skipped += spmv_delta(op->matrix, blki, rowA, bypass->col_changed, bypass->dd, k_q);
+                deferred_coo_spmv_delta(op->matrix, row_start, row_stop, tile_size, bypass->col_changed, bypass->dd, k_q);
+                for (int i = row_start; i < row_stop; i++)
+                    dq += k_d[i] * k_q[i];
+            }
+            bypass->skip_partial[tid * PARTIAL_STRIDE] = skipped;
+#else
+            // d.q comes back from the kernels, summed per row block while q is in registers
+            double dq = cpu_tile_op_spmv(op, blk_start, blk_stop, k_d, k_q, k_d);
+#endif
+            dot_partial[tid * PARTIAL_STRIDE] = dq;
+            cpu_signal_wait(&signal_dot, nthreads);
+#if SPMV_BYPASS
+            if (tid == 0)
+            {
+                bypass->skipped[iter_local] = (int)cpu_partial_sum(bypass->skip_partial, nthreads);
+                bypass->full_spmv += full;
+            }
+#endif
+
+#if CG_BLOCK_JACOBI
+            // alpha = r.z / d.q, x += alpha d, r -= alpha q, and z = M^(-1)r on each row block while its r is in L1
+            double alpha = rz_local / cpu_partial_sum(dot_partial, nthreads);
+            double rr = 0, rz_part = 0;
+            for (int blki = blk_start; blki < blk_stop; blki++)
+            {
+                int blk_row_stop = (blki + 1) * tile_size < rowA ? (blki + 1) * tile_size : rowA;
+                for (int i = blki * tile_size; i < blk_row_stop; i++)
+                {
+                    k_x[i] += alpha * k_d[i];
+                    k_r[i] -= alpha * k_q[i];
+                    rr += k_r[i] * k_r[i];
+                }
+                rz_part += block_jacobi_apply(&op->bj, blki, blk_row_stop - blki * tile_size, k_r, k_z);
+            }
+            snew_partial[tid * PARTIAL_STRIDE] = rr;
+            snew_partial[tid * PARTIAL_STRIDE + 1] = rz_part;
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // beta = r.z / r.z_old, d = z + beta d
+            snew_local = cpu_partial_sum(snew_partial, nthreads);
+            double rz_old = rz_local;
+            rz_local = cpu_partial_sum(snew_partial + 1, nthreads);
+            double beta = rz_local / rz_old;
+            for (int i = row_start; i < row_stop; i++)
+                k_d[i] = k_z[i] + beta * k_d[i];
+#else
+            // alpha = snew / d.q, x += alpha d, r -= alpha q
+            double alpha = snew_local / cpu_partial_sum(dot_partial, nthreads);
+            double rr = 0;
+            for (int i = row_start; i < row_stop; i++)
+            {
+                k_x[i] += alpha * k_d[i];
+                k_r[i] -= alpha * k_q[i];
+                rr += k_r[i] * k_r[i];
+            }
+            snew_partial[tid * PARTIAL_STRIDE] = rr;
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // beta = snew / sold, d = r + beta d
+            double sold = snew_local;
+            snew_local = cpu_partial_sum(snew_partial, nthreads);
+            double beta = snew_local / sold;
+            for (int i = row_start; i < row_stop; i++)
+                k_d[i] = k_r[i] + beta * k_d[i];
+#endif
+#if SPMV_BYPASS
+            bypass->changed_partial[tid * PARTIAL_STRIDE] = spmv_bypass_mark(bypass, k_d, blk_start, blk_stop, tile_size, SPMV_BYPASS_TH * sqrt(snew_local));
+#endif
+            cpu_signal_wait(&signal_final, nthreads);
+            iter_local++;
+        }
+        if (tid == 0)
+        {
+            iterations = iter_local;
+            snew = snew_local;
+        }
+    }
+    memcpy(x, k_x, sizeof(double) * rowA);
+    *res = snew;
+    return iterations;
+}
+
+// CG on the tile format: set up, solve once from x = 0, report to stdout and cg_cpu_omp.csv, tear down
+void cg_solve_cpu(MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *x, double *b, int n, int *iter, int maxiter, double threshold, char *filename, MAT_PTR_TYPE nnzR, int ori, int tile_size)
+{
+    struct timeval t1, t2;
+    cpu_tile_op op;
+    cpu_tile_op_create(&op, RowPtr, ColIdx, Val, n, ori, nnzR, filename, tile_size);
+    int rowA = op.rowA;
+    double time_format = op.time_setup;
+    cpu_tile_op_print(&op, CG_BLOCK_JACOBI ? (BJ_FLOAT ? " precond=bjacobi-fp32" : " precond=bjacobi") : " precond=none");
+
+    double snew = 0;
+    gettimeofday(&t1, NULL);
+    int iterations = cg_cpu_iterate(&op, b, x, NULL, maxiter, threshold, &snew);
+    gettimeofday(&t2, NULL);
+    double time_cg = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    double time_iter = iterations ? time_cg / iterations : 0;
+    double Gflops_cg = iterations ? ((2.0 * nnzR + 10.0 * rowA) * iterations) / (time_cg * pow(10, 6)) : 0;
+    *iter = iterations;
+
+    double l2_norm = cpu_csr_relres(RowPtr, ColIdx, Val, rowA, x, b);
+    printf("iter=%d,time_cg=%lf ms,time_iter=%lf ms,Gflops=%lf,time_format=%lf ms\n", iterations, time_cg, time_iter, Gflops_cg, time_format);
+    printf("%e\n", sqrt(snew));
+    printf("%e\n", l2_norm);
+    double skip_per_iter = 0;
+#if SPMV_BYPASS
+    spmv_bypass *bypass = &op.bypass;
+    long long skipped_total = 0;
+    for (int it = 0; it < iterations; it++)
+        skipped_total += bypass->skipped[it];
+    skip_per_iter = iterations ? (double)skipped_total / iterations : 0;
+    printf("bypass tiles_skipped=%lld skip_per_iter=%.1f (%.1f%% of tilenum) full_spmv=%d/%d\n", skipped_total, skip_per_iter,
+           op.matrix->tilenum ? 100.0 * skip_per_iter / op.matrix->tilenum : 0, bypass->full_spmv, iterations);
+    FILE *file2 = fopen("cg_cpu_bypass.csv", "a");
+    if (file2 != NULL)
+    {
+        fprintf(file2, "%s,%d", filename, op.matrix->tilenum);
+        for (int it = 0; it < iterations; it++)
+            fprintf(file2, ",%d", bypass->skipped[it]);
+        fprintf(file2, "\n");
+        fclose(file2);
+    }
+#endif
+
+    char *s = (char *)malloc(sizeof(char) * 256);
+    sprintf(s, "iter=%d,time_iter=%.3f,time_cg=%.3f,nnzR=%lld,l2_norm=%e,time_format=%lf,gflops=%lf,nthreads=%d,simd=%s,val_bytes=%.2f,skip_per_iter=%.1f,tile_size=%d,precond=%d,tile_format=%d\n", iterations, time_iter, time_cg, (long long)nnzR, l2_norm, time_format, Gflops_cg, op.nthreads, blockspmv_cpu_simd_name(op.simd_level), op.val_bytes, skip_per_iter, op.tile_size, CG_BLOCK_JACOBI, TILE_FORMAT);
+    FILE *file1 = fopen("cg_cpu_omp.csv", "a");
+    if (file1 == NULL)
+    {
+        printf("open error!\n");
+    }
+    else
+    {
+        fwrite(filename, strlen(filename), 1, file1);
+        fwrite(",", strlen(","), 1, file1);
+        fwrite(s, strlen(s), 1, file1);
+        fclose(file1);
+    }
+    free(s);
+    cpu_tile_op_destroy(&op);
+}
+
+#endif
@@ -0,0 +1,183 @@
+#ifndef _CG_PIPE_CPU_H_
+#define _CG_PIPE_CPU_H_
+
+#include "common.h"
+#include "cg_cpu.h"
+
+// Pipelined CG (Ghysels and Vanroose) on op: r.r and w.r of an iteration are summed in the
+// sweep that updates r and w, and q = Aw of the next iteration runs right after the one barrier that
+// publishes them. w and the partials are double-buffered by iteration parity, so a thread that has passed
+// the barrier can write the next w while others still read the current one. Every CG_PIPE_REPLACE
+// iterations r = b - Ax, w = Ar, s = Ap and z = As are recomputed to drop the recurrence error. Starts from x0
+// (zero when NULL), stops at ||r|| <= tol ||b|| or maxiter; x gets the solution, *res the final r.r and
+// *replaced, when not NULL, the number of replacement steps taken.
+int cg_pipe_cpu_iterate(cpu_tile_op *op, double *b, double *x, double *x0, int maxiter, double tol, double *res, int *replaced)
+{
+    int rowA = op->rowA;
+    int tile_size = op->tile_size;
+    int nthreads = op->nthreads;
+    int *rowblk_start = op->rowblk_start;
+    double *k_x = op->vec[0];
+    double *k_r = op->vec[1];
+    double *k_p = op->vec[2];
+    double *k_s = op->vec[3];
+    double *k_z = op->vec[4];
+    double *k_q = op->vec[5];
+    double *k_w[2] = {op->vec[6], op->vec[7]};
+    // r.r in slot 0 and w.r in slot 1 of each thread's PARTIAL_STRIDE line, one array per parity
+    double *dot_partial[2] = {op->partial[0], op->partial[1]};
+
+    // r = b - Ax
+    double threshold = tol * tol * cpu_tile_op_start(op, 8, x0, b);
+    double s0 = 0;
+    for (int i = 0; i < rowA; i++)
+        s0 += k_r[i] * k_r[i];
+    double snew = s0;
+
+    cpu_signal signal_final = {0, 0};
+    cpu_signal signal_replace = {0, 0};
+    int iterations = 0;
+    int replace_count = 0;
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = rowblk_start[tid];
+        int blk_stop = rowblk_start[tid + 1];
+        int row_start = blk_start * tile_size;
+        int row_stop = blk_stop * tile_size < rowA ? blk_stop * tile_size : rowA;
+
+        // w = Ar, with w.r from the kernels
+        double wr = cpu_tile_op_spmv(op, blk_start, blk_stop, k_r, k_w[0], k_r);
+        double rr = 0;
+        for (int i = row_start; i < row_stop; i++)
+            rr += k_r[i] * k_r[i];
+        dot_partial[0][tid * PARTIAL_STRIDE] = rr;
+        dot_partial[0][tid * PARTIAL_STRIDE + 1] = wr;
+        cpu_signal_wait(&signal_final, nthreads);
+
+        double gamma_old = 0, alpha_old = 0;
+        double gamma = s0;
+        int iter_local = 0;
+        while (iter_local < maxiter)
+        {
+            int cur = iter_local & 1;
+            double *w = k_w[cur];
+            double *w_next = k_w[cur ^ 1];
+#if CG_PIPE_REPLACE
+            if (iter_local > 0 && iter_local % CG_PIPE_REPLACE == 0)
+            {
+                // r = b - Ax and s = Ap, then w = Ar and z = As, and the r.r and w.r of this iteration again
+                cpu_tile_op_spmv(op, blk_start, blk_stop, k_x, k_q, k_x);
+                cpu_tile_op_spmv(op, blk_start, blk_stop, k_p, k_s, k_p);
+                rr = 0;
+                for (int i = row_start; i < row_stop; i++)
+                {
+                    k_r[i] = b[i] - k_q[i];
+                    rr += k_r[i] * k_r[i];
+                }
+                cpu_signal_wait(&signal_replace, nthreads);
+                wr = cpu_tile_op_spmv(op, blk_start, blk_stop, k_r, w, k_r);
+                cpu_tile_op_spmv(op, blk_start, blk_stop, k_s, k_z, k_s);
+                dot_partial[cur][tid * PARTIAL_STRIDE] = rr;
+                dot_partial[cur][tid * PARTIAL_STRIDE + 1] = wr;
+                cpu_signal_wait(&signal_replace, nthreads);
+                if (tid == 0)
+                    replace_count++;
+            }
+#endif
+            gamma = 0;
+            double delta = 0;
+            for (int t = 0; t < nthreads; t++)
+            {
+                gamma += dot_partial[cur][t * PARTIAL_STRIDE];
+                delta += dot_partial[cur][t * PARTIAL_STRIDE + 1];
+            }
+            if (gamma <= threshold)
+                break;
+
+            // q = Aw, on the w the last barrier published
+            cpu_tile_op_spmv(op, blk_start, blk_stop, w, k_q, w);
+
+            double beta = iter_local ? gamma / gamma_old : 0;
+            double alpha = iter_local ? gamma / (delta - beta * gamma / alpha_old) : gamma / delta;
+            gamma_old = gamma;
+            alpha_old = alpha;
+
+            // z = q + beta z, s = w + beta s, p = r + beta p, x += alpha p, r -= alpha s, w -= alpha z
+            rr = 0;
+            wr = 0;
+            for (int i = row_start; i < row_stop; i++)
+            {
+                k_z[i] = k_q[i] + beta * k_z[i];
+                k_s[i] = w[i] + beta * k_s[i];
+                k_p[i] = k_r[i] + beta * k_p[i];
+                k_x[i] += alpha * k_p[i];
+                k_r[i] -= alpha * k_s[i];
+                w_next[i] = w[i] - alpha * k_z[i];
+                rr += k_r[i] * k_r[i];
+                wr += w_next[i] * k_r[i];
+            }
+            dot_partial[cur ^ 1][tid * PARTIAL_STRIDE] = rr;
+            dot_partial[cur ^ 1][tid * PARTIAL_STRIDE + 1] = wr;
+            cpu_signal_wait(&signal_final, nthreads);
+            iter_local++;
+        }
+        if (tid == 0)
+        {
+            iterations = iter_local;
+            snew = gamma;
+        }
+    }
+    memcpy(x, k_x, sizeof(double) * rowA);
+    *res = snew;
+    if (replaced)
+        *replaced = replace_count;
+    return iterations;
+}
+
+// Pipelined CG on the tile format: set up, solve once from x = 0, report to stdout and cg_cpu_pipe.csv, tear down
+void cg_solve_pipe_cpu(MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *x, double *b, int n, int *iter, int maxiter, double threshold, char *filename, MAT_PTR_TYPE nnzR, int ori, int tile_size)
+{
+    struct timeval t1, t2;
+    cpu_tile_op op;
+    cpu_tile_op_create(&op, RowPtr, ColIdx, Val, n, ori, nnzR, filename, tile_size);
+    int rowA = op.rowA;
+    double time_format = op.time_setup;
+    char extra[32];
+    sprintf(extra, " replace=%d", CG_PIPE_REPLACE);
+    cpu_tile_op_print(&op, extra);
+
+    double snew = 0;
+    int replaced = 0;
+    gettimeofday(&t1, NULL);
+    int iterations = cg_pipe_cpu_iterate(&op, b, x, NULL, maxiter, threshold, &snew, &replaced);
+    gettimeofday(&t2, NULL);
+    double time_cg = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    double time_iter = iterations ? time_cg / iterations : 0;
+    double Gflops_cg = iterations ? ((2.0 * nnzR + 16.0 * rowA) * iterations) / (time_cg * pow(10, 6)) : 0;
+    *iter = iterations;
+
+    double l2_norm = cpu_csr_relres(RowPtr, ColIdx, Val, rowA, x, b);
+    printf("iter=%d,time_cg=%lf ms,time_iter=%lf ms,Gflops=%lf,time_format=%lf ms,replaced=%d\n", iterations, time_cg, time_iter, Gflops_cg, time_format, replaced);
+    printf("%e\n", sqrt(snew));
+    printf("%e\n", l2_norm);
+
+    char *s = (char *)malloc(sizeof(char) * 256);
+    sprintf(s, "iter=%d,time_iter=%.3f,time_cg=%.3f,nnzR=%lld,l2_norm=%e,time_format=%lf,gflops=%lf,nthreads=%d,simd=%s,tile_size=%d,replace=%d\n", iterations, time_iter, time_cg, (long long)nnzR, l2_norm, time_format, Gflops_cg, op.nthreads, blockspmv_cpu_simd_name(op.simd_level), op.tile_size, CG_PIPE_REPLACE);
+    FILE *file1 = fopen("cg_cpu_pipe.csv", "a");
+    if (file1 == NULL)
+    {
+        printf("open error!\n");
+    }
+    else
+    {
+        fwrite(filename, strlen(filename), 1, file1);
+        fwrite(",", strlen(","), 1, file1);
+        fwrite(s, strlen(s), 1, file1);
+        fclose(file1);
+    }
+    free(s);
+    cpu_tile_op_destroy(&op);
+}
+
+#endif
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <math.h>
+#include <stdint.h>
+#include <limits.h>
 
 #include <sys/time.h>
 
@@ -26,9 +28,19 @@
 #endif
 
 
+// 64-bit CSR row pointers and global nonzero offsets on the CPU path, for operators beyond 2^31 nonzeros.
+// Per-tile offsets stay 32-bit against a 64-bit base per row block (format.h)
+#ifndef MAT_PTR_64
+#define MAT_PTR_64 0
+#endif
+
 #ifndef MAT_PTR_TYPE
+#if MAT_PTR_64
+#define MAT_PTR_TYPE int64_t
+#else
 #define MAT_PTR_TYPE int
 #endif
+#endif
 
 #ifndef WARP_SIZE
 #define WARP_SIZE 32
@@ -57,6 +69,11 @@
 #define COO_NNZ_TH 12
 #endif
 
+// split off-diagonal tiles under COO_NNZ_TH nonzeros into a global CSR remainder on the CPU path (deferred_coo.h)
+#ifndef DEFERRED_COO
+#define DEFERRED_COO 1
+#endif
+
 #ifndef PREFETCH_SMEM_TH
 #define PREFETCH_SMEM_TH 4
 //#define PREFETCH_SMEM_TH 1
@@ -74,3 +91,182 @@
 #ifndef FORMAT_CONVERSION
 #define FORMAT_CONVERSION 0
 #endif
+
+#ifndef SPIN_YIELD_TH
+#define SPIN_YIELD_TH 1024
+#endif
+
+#ifndef PARTIAL_STRIDE
+#define PARTIAL_STRIDE 8
+#endif
+
+#ifndef SIMD_LEVEL_MAX
+#define SIMD_LEVEL_MAX 2
+#endif
+
+#ifndef SIMD_ROW_TH
+#define SIMD_ROW_TH 4
+#endif
+
+#ifndef CONVERT_SCATTER
+#define CONVERT_SCATTER 1
+#endif
+
+// 1: keep the tile matrix of foo.mtx in foo.mft next to it and map it on the next run (tile_cache.h); off by
+// default so that a run does not write to the dataset directory
+#ifndef TILE_CACHE
+#define TILE_CACHE 0
+#endif
+
+#ifndef TILE_CACHE_VERIFY
+#define TILE_CACHE_VERIFY 1
+#endif
+
+#ifndef TILE_PRECISION
+#define TILE_PRECISION 1
+#endif
+
+#ifndef TILE_PREC_TOL
+#define TILE_PREC_TOL 0
+#endif
+
+#ifndef SPMV_BYPASS
+#define SPMV_BYPASS 0
+#endif
+
+#ifndef SPMV_BYPASS_TH
+#define SPMV_BYPASS_TH 1e-8
+#endif
+
+#ifndef SPMV_BYPASS_FULL_TH
+#define SPMV_BYPASS_FULL_TH 0.5
+#endif
+
+#ifndef SPMV_BYPASS_REFRESH
+#define SPMV_BYPASS_REFRESH 50
+#endif
+
+#ifndef CG_PIPELINED
+#define CG_PIPELINED 0
+#endif
+
+#ifndef CG_PIPE_REPLACE
+#define CG_PIPE_REPLACE 50
+#endif
+
+// 1: block-Jacobi preconditioning of the CPU CG with the inverted diagonal tiles (block_jacobi.h); off by
+// default so that the CG iterations compare with the GPU CG
+#ifndef CG_BLOCK_JACOBI
+#define CG_BLOCK_JACOBI 0
+#endif
+
+#ifndef BJ_FLOAT
+#define BJ_FLOAT 0
+#endif
+
+// mixed-precision iterative refinement in the CPU drivers: fp64 residual outside, MAT_VAL_LOW_TYPE CG or
+// BiCGSTAB inside (refine_cpu.h)
+#ifndef REFINE
+#define REFINE 0
+#endif
+
+#ifndef REFINE_INNER_TOL
+#define REFINE_INNER_TOL 1e-3
+#endif
+
+#ifndef REFINE_INNER_MAXITER
+#define REFINE_INNER_MAXITER 200
+#endif
+
+#ifndef REFINE_MAXOUTER
+#define REFINE_MAXOUTER 30
+#endif
+
+#ifndef REFINE_STALL
+#define REFINE_STALL 0.5
+#endif
+
+// 0 input order, 1 RCM, 2 greedy tile filling (reorder.h)
+#ifndef REORDER
+#define REORDER 0
+#endif
+
+// per-tile dense/ELL/COO/CSR storage for the CPU CG SpMV (tile_format.h)
+#ifndef TILE_FORMAT
+#define TILE_FORMAT 0
+#endif
+
+#ifndef TILE_FMT_DNS_TH
+#define TILE_FMT_DNS_TH 0.75
+#endif
+
+#ifndef TILE_FMT_BENCH
+#define TILE_FMT_BENCH 20
+#endif
+
+// record the CSR nonzero -> tile value slot map at setup so that new values on the same pattern can be
+// scattered in place (tile_refresh.h)
+#ifndef TILE_REFRESH
+#define TILE_REFRESH 1
+#endif
+
+// ask for transparent huge pages on the setup arenas (arena.h)
+#ifndef ARENA_HUGEPAGE
+#define ARENA_HUGEPAGE 1
+#endif
+
+// pin the CPU threads to NUMA nodes and move the tile arrays and solver vectors to the nodes of the threads
+// that own their row blocks (numa_place.h); NUMA_BENCH SpMVs measure the bandwidth per node
+#ifndef NUMA_PLACE
+#define NUMA_PLACE 0
+#endif
+
+#ifndef NUMA_BENCH
+#define NUMA_BENCH 20
+#endif
+
+// scans and sorts of the setup (utils.h) longer than PAR_PRIM_MIN run on all OpenMP threads; key-value
+// runs shorter than RADIX_SORT_MIN are insertion sorted instead of radix sorted
+#ifndef PAR_PRIM_MIN
+#define PAR_PRIM_MIN (1 << 16)
+#endif
+
+#ifndef RADIX_SORT_MIN
+#define RADIX_SORT_MIN 64
+#endif
+
+// > 0: the CPU mains time the parallel scan and sort against the serial ones on arrays of the matrix size,
+// PRIM_BENCH calls each
+#ifndef PRIM_BENCH
+#define PRIM_BENCH 0
+#endif
+
+#ifndef TILE_PART_WEIGHT
+#define TILE_PART_WEIGHT 16
+#endif
+
+#ifndef TILE_PART_TILE_FACTOR
+#define TILE_PART_TILE_FACTOR 2
+#endif
+
+#ifndef TILE_SIZE
+#define TILE_SIZE 0
+#endif
+
+#ifndef TILE_SIZE_TILE_COST
+#define TILE_SIZE_TILE_COST 64
+#endif
+
+#ifndef TILE_SIZE_ROW_COST
+#define TILE_SIZE_ROW_COST 1
+#endif
+
+#ifndef TILE_SIZE_SIMD_NNZ_COST
+#define TILE_SIZE_SIMD_NNZ_COST 0.3
+#endif
+
+// tile_size_select: cost of a deferred CSR nonzero (deferred_coo.h) against a scalar tile one, its 4-byte
+// column index and the gather from all of x
+#ifndef TILE_SIZE_COO_NNZ_COST
+#define TILE_SIZE_COO_NNZ_COST 1.5
+#endif
@@ -1,23 +1,31 @@
+#ifndef _CSR2BLOCK_H_
+#define _CSR2BLOCK_H_
+
 #include "common.h"
 #include "encode.h"
 #include "format.h"
 #include "utils.h"
+#include "tile_precision.h"
 
+template <int TS>
 void convert_step1(Tile_matrix *matrix,
                    int rowA,
                    int colA,
                    MAT_PTR_TYPE nnzA,
                    MAT_PTR_TYPE *csrRowPtrA,
                    int *csrColIdxA,
-                   MAT_VAL_TYPE *csrValA)
+                   MAT_VAL_TYPE *csrValA,
+                   const char *keep)
 {
 
     int tilem = matrix->tilem;
     int tilen = matrix->tilen;
-    int *tile_ptr = matrix->tile_ptr;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
 
     unsigned thread = omp_get_max_threads();
-    char *flag_g = (char *)malloc(thread * tilen * sizeof(char));
+    arena *scratch = setup_scratch();
+    size_t mark = arena_mark(scratch);
+    char *flag_g = (char *)arena_alloc(scratch, thread * tilen * sizeof(char));
 
 #pragma omp parallel for
     for (int blki = 0; blki < tilem; blki++)
@@ -25,11 +33,13 @@ void convert_step1(Tile_matrix *matrix,
         int thread_id = omp_get_thread_num();
         char *flag = flag_g + thread_id * tilen;
         memset(flag, 0, tilen * sizeof(char));
-        int start = blki * BLOCK_SIZE;
-        int end = blki == tilem - 1 ? rowA : (blki + 1) * BLOCK_SIZE;
-        for (int j = csrRowPtrA[start]; j < csrRowPtrA[end]; j++)
+        int start = blki * TS;
+        int end = blki == tilem - 1 ? rowA : (blki + 1) * TS;
+        for (MAT_PTR_TYPE j = csrRowPtrA[start]; j < csrRowPtrA[end]; j++)
         {
-            int jc = csrColIdxA[j] / BLOCK_SIZE;
+            if (keep && !keep[j])
+                continue;
+            int jc = csrColIdxA[j] / TS;
             if (flag[jc] == 0)
             {
                 flag[jc] = 1;
@@ -37,28 +47,32 @@ void convert_step1(Tile_matrix *matrix,
             }
         }
     }
-    free(flag_g);
+    arena_rewind(scratch, mark);
 }
 
+template <int TS>
 void convert_step2(Tile_matrix *matrix,
-                   unsigned char *tile_csr_ptr,
+                   typename tile_traits<TS>::ptr_type *tile_csr_ptr,
                    int rowA,
                    int colA,
                    MAT_PTR_TYPE nnzA,
                    MAT_PTR_TYPE *csrRowPtrA,
                    int *csrColIdxA,
-                   MAT_VAL_TYPE *csrValA)
+                   MAT_VAL_TYPE *csrValA,
+                   const char *keep)
 {
 
     int tilem = matrix->tilem;
     int tilen = matrix->tilen;
-    int *tile_ptr = matrix->tile_ptr;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
     int *tile_columnidx = matrix->tile_columnidx;
     int *tile_nnz = matrix->tile_nnz;
     unsigned thread = omp_get_max_threads();
-    char *col_temp_g = (char *)malloc((thread * tilen) * sizeof(char));
-    int *nnz_temp_g = (int *)malloc((thread * tilen) * sizeof(int));
-    unsigned char *ptr_per_tile_g = (unsigned char *)malloc((thread * tilen * BLOCK_SIZE) * sizeof(unsigned char));
+    arena *scratch = setup_scratch();
+    size_t mark = arena_mark(scratch);
+    char *col_temp_g = (char *)arena_alloc(scratch, (thread * tilen) * sizeof(char));
+    int *nnz_temp_g = (int *)arena_alloc(scratch, (thread * tilen) * sizeof(int));
+    unsigned char *ptr_per_tile_g = (unsigned char *)arena_alloc(scratch, (thread * tilen * TS) * sizeof(unsigned char));
 
 #pragma omp parallel for
     for (int blki = 0; blki < tilem; blki++)
@@ -68,21 +82,23 @@ void convert_step2(Tile_matrix *matrix,
         memset(col_temp, 0, tilen * sizeof(char));
         int *nnz_temp = nnz_temp_g + thread_id * tilen;
         memset(nnz_temp, 0, tilen * sizeof(int));
-        unsigned char *ptr_per_tile = ptr_per_tile_g + thread_id * tilen * BLOCK_SIZE;
-        memset(ptr_per_tile, 0, tilen * BLOCK_SIZE * sizeof(unsigned char));
+        unsigned char *ptr_per_tile = ptr_per_tile_g + thread_id * tilen * TS;
+        memset(ptr_per_tile, 0, tilen * TS * sizeof(unsigned char));
         int pre_tile = tile_ptr[blki];
-        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
-        int start = blki * BLOCK_SIZE;
-        int end = blki == tilem - 1 ? rowA : (blki + 1) * BLOCK_SIZE;
+        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+        int start = blki * TS;
+        int end = blki == tilem - 1 ? rowA : (blki + 1) * TS;
 
         for (int ri = 0; ri < rowlen; ri++)
         {
-            for (int j = csrRowPtrA[start + ri]; j < csrRowPtrA[start + ri + 1]; j++)
+            for (MAT_PTR_TYPE j = csrRowPtrA[start + ri]; j < csrRowPtrA[start + ri + 1]; j++)
             {
-                int jc = csrColIdxA[j] / BLOCK_SIZE;
+                if (keep && !keep[j])
+                    continue;
+                int jc = csrColIdxA[j] / TS;
                 col_temp[jc] = 1;
                 nnz_temp[jc]++;
-                ptr_per_tile[jc * BLOCK_SIZE + ri]++;
+                ptr_per_tile[jc * TS + ri]++;
             }
         }
 
@@ -95,19 +111,18 @@ void convert_step2(Tile_matrix *matrix,
                 tile_nnz[pre_tile + count] = nnz_temp[blkj];
                 for (int ri = 0; ri < rowlen; ri++)
                 {
-                    tile_csr_ptr[(pre_tile + count) * BLOCK_SIZE + ri] = ptr_per_tile[blkj * BLOCK_SIZE + ri];
+                    tile_csr_ptr[(size_t)(pre_tile + count) * TS + ri] = ptr_per_tile[blkj * TS + ri];
                 }
                 count++;
             }
         }
     }
-    free(col_temp_g);
-    free(nnz_temp_g);
-    free(ptr_per_tile_g);
+    arena_rewind(scratch, mark);
 }
 
+template <int TS>
 void convert_step3(Tile_matrix *matrix,
-                   unsigned char *tile_csr_ptr,
+                   typename tile_traits<TS>::ptr_type *tile_csr_ptr,
                    int rowA,
                    int colA,
                    MAT_PTR_TYPE nnzA,
@@ -132,12 +147,12 @@ void convert_step3(Tile_matrix *matrix,
     for (int blki = 0; blki < tilem; blki++)
     {
         int tilenum_per_row = tile_ptr[blki + 1] - tile_ptr[blki];
-        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
+        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
         for (int bi = 0; bi < tilenum_per_row; bi++)
         {
             int tile_id = tile_ptr[blki] + bi;
-            int collen = tile_columnidx[tile_id] == tilen - 1 ? colA - (tilen - 1) * BLOCK_SIZE : BLOCK_SIZE;
-            int nnztmp = tile_nnz[tile_id + 1] - tile_nnz[tile_id]; // the number of nnz of tile_id
+            int collen = tile_columnidx[tile_id] == tilen - 1 ? colA - (tilen - 1) * TS : TS;
+            int nnztmp = tile_span(tile_nnz, tile_id); // the number of nnz of tile_id
             int nnzthreshold = rowlen * collen * 0.75;
             {
                 Format[tile_id] = 0;
@@ -149,9 +164,9 @@ void convert_step3(Tile_matrix *matrix,
     }
 }
 
+template <int TS>
 void convert_step4(Tile_matrix *matrix,
-                   unsigned char *tile_csr_ptr,
-                   unsigned char *Blockcsr_Col,
+                   typename tile_traits<TS>::ptr_type *tile_csr_ptr,
                    int nnz_temp,
                    int tile_count_temp,
                    int rowA,
@@ -160,7 +175,8 @@ void convert_step4(Tile_matrix *matrix,
                    MAT_PTR_TYPE *csrRowPtrA,
                    int *csrColIdxA,
                    MAT_VAL_TYPE *csrValA,
-                   MAT_VAL_LOW_TYPE *csrValA_Low)
+                   MAT_VAL_LOW_TYPE *csrValA_Low,
+                   const char *keep)
 
 {
     int tilem = matrix->tilem;
@@ -172,17 +188,17 @@ void convert_step4(Tile_matrix *matrix,
     int *blknnz = matrix->blknnz;
     unsigned char *blknnznnz = matrix->blknnznnz;
     char *tilewidth = matrix->tilewidth;
-    int *csr_offset = matrix->csr_offset;
-    int *csrptr_offset = matrix->csrptr_offset;
     MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
     MAT_VAL_LOW_TYPE *Blockcsr_Val_Low = matrix->Blockcsr_Val_Low;
-    unsigned char *Blockcsr_Ptr = matrix->Blockcsr_Ptr;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
     unsigned char *Tile_csr_Col = matrix->Tile_csr_Col;
     unsigned thread = omp_get_max_threads();
-    unsigned char *csr_colidx_temp_g = (unsigned char *)malloc((thread * nnz_temp) * sizeof(unsigned char));
-    MAT_VAL_TYPE *csr_val_temp_g = (MAT_VAL_TYPE *)malloc((thread * nnz_temp) * sizeof(MAT_VAL_TYPE));
-    MAT_VAL_LOW_TYPE *csr_val_temp_g_Low = (MAT_VAL_LOW_TYPE *)malloc((thread * nnz_temp) * sizeof(MAT_VAL_LOW_TYPE));
-    int *tile_count_g = (int *)malloc(thread * tile_count_temp * sizeof(int));
+    arena *scratch = setup_scratch();
+    size_t mark = arena_mark(scratch);
+    unsigned char *csr_colidx_temp_g = (unsigned char *)arena_alloc(scratch, (thread * nnz_temp) * sizeof(unsigned char));
+    MAT_VAL_TYPE *csr_val_temp_g = (MAT_VAL_TYPE *)arena_alloc(scratch, (thread * nnz_temp) * sizeof(MAT_VAL_TYPE));
+    MAT_VAL_LOW_TYPE *csr_val_temp_g_Low = (MAT_VAL_LOW_TYPE *)arena_alloc(scratch, (thread * nnz_temp) * sizeof(MAT_VAL_LOW_TYPE));
+    int *tile_count_g = (int *)arena_alloc(scratch, thread * tile_count_temp * sizeof(int));
 
 #pragma omp parallel for
     for (int blki = 0; blki < tilem; blki++)
@@ -193,27 +209,28 @@ void convert_step4(Tile_matrix *matrix,
         MAT_VAL_TYPE *csr_val_temp = csr_val_temp_g + thread_id * nnz_temp;
         MAT_VAL_LOW_TYPE *csr_val_temp_low = csr_val_temp_g_Low + thread_id * nnz_temp;
         int *tile_count = tile_count_g + thread_id * tile_count_temp;
-        memset(csr_colidx_temp, 0, (nnz_temp) * sizeof(unsigned char));
-        memset(csr_val_temp, 0, (nnz_temp) * sizeof(MAT_VAL_TYPE));
-        memset(csr_val_temp_low, 0, (nnz_temp) * sizeof(MAT_VAL_LOW_TYPE));
+        // the temporaries are read only where this row block wrote them, the counts start at zero
         memset(tile_count, 0, (tile_count_temp) * sizeof(int));
         int tilenum_per_row = tile_ptr[blki + 1] - tile_ptr[blki];
-        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
-        int start = blki * BLOCK_SIZE;
-        int end = blki == tilem - 1 ? rowA : (blki + 1) * BLOCK_SIZE;
-        for (int blkj = csrRowPtrA[start]; blkj < csrRowPtrA[end]; blkj++)
+        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+        int start = blki * TS;
+        int end = blki == tilem - 1 ? rowA : (blki + 1) * TS;
+        for (MAT_PTR_TYPE blkj = csrRowPtrA[start]; blkj < csrRowPtrA[end]; blkj++)
         {
-            int jc_temp = csrColIdxA[blkj] / BLOCK_SIZE;
+            if (keep && !keep[blkj])
+                continue;
+            int jc_temp = csrColIdxA[blkj] / TS;
             for (int bi = 0; bi < tilenum_per_row; bi++)
             {
                 int tile_id = tile_ptr[blki] + bi;
                 int jc = tile_columnidx[tile_id];
-                int pre_nnz = tile_nnz[tile_id] - tile_nnz[tile_ptr[blki]];
+                int pre_nnz = (unsigned)tile_nnz[tile_id] - (unsigned)tile_nnz[tile_ptr[blki]];
                 if (jc == jc_temp)
                 {
                     csr_val_temp[pre_nnz + tile_count[bi]] = csrValA[blkj];
-                    csr_val_temp_low[pre_nnz + tile_count[bi]] = csrValA_Low[blkj];
-                    csr_colidx_temp[pre_nnz + tile_count[bi]] = csrColIdxA[blkj] - jc * BLOCK_SIZE;
+                    if (csrValA_Low)
+                        csr_val_temp_low[pre_nnz + tile_count[bi]] = csrValA_Low[blkj];
+                    csr_colidx_temp[pre_nnz + tile_count[bi]] = csrColIdxA[blkj] - jc * TS;
                     tile_count[bi]++;
                     break;
                 }
@@ -222,19 +239,19 @@ void convert_step4(Tile_matrix *matrix,
         for (int bi = 0; bi < tilenum_per_row; bi++)
         {
             int tile_id = tile_ptr[blki] + bi;
-            int pre_nnz = tile_nnz[tile_id] - tile_nnz[tile_ptr[blki]];
-            int nnztmp = tile_nnz[tile_id + 1] - tile_nnz[tile_id]; // blknnz[tile_id+1] - blknnz[tile_id] ;
-            int collen = tile_columnidx[tile_id] == tilen - 1 ? colA - (tilen - 1) * BLOCK_SIZE : BLOCK_SIZE;
+            int pre_nnz = (unsigned)tile_nnz[tile_id] - (unsigned)tile_nnz[tile_ptr[blki]];
+            int nnztmp = tile_span(tile_nnz, tile_id); // blknnz[tile_id+1] - blknnz[tile_id] ;
+            int collen = tile_columnidx[tile_id] == tilen - 1 ? colA - (tilen - 1) * TS : TS;
             int format = Format[tile_id];
             switch (format)
             {
             case 0:
             {
-                int offset = csr_offset[tile_id];
-                int ptr_offset = csrptr_offset[tile_id];
+                MAT_PTR_TYPE offset = tile_csr_start(matrix, blki, tile_id);
+                MAT_PTR_TYPE ptr_offset = tile_ptr_start(matrix, blki, tile_id);
 
-                unsigned char *ptr_temp = tile_csr_ptr + tile_id * BLOCK_SIZE;
-                exclusive_scan_char(ptr_temp, rowlen);
+                typename tile_traits<TS>::ptr_type *ptr_temp = tile_csr_ptr + (size_t)tile_id * TS;
+                exclusive_scan_small(ptr_temp, rowlen);
 
                 for (int ri = 0; ri < rowlen; ri++)
                 {
@@ -244,9 +261,12 @@ void convert_step4(Tile_matrix *matrix,
                     for (int k = start; k < stop; k++)
                     {
                         unsigned char colidx = csr_colidx_temp[pre_nnz + k];
-                        Blockcsr_Val[offset + k] = csr_val_temp[pre_nnz + k];
-                        Blockcsr_Val_Low[offset + k] = csr_val_temp_low[pre_nnz + k];
-                        Blockcsr_Col[offset + k] = csr_colidx_temp[pre_nnz + k];
+                        if (Blockcsr_Val)
+                            Blockcsr_Val[offset + k] = csr_val_temp[pre_nnz + k];
+                        if (Blockcsr_Val_Low)
+                            Blockcsr_Val_Low[offset + k] = csr_val_temp_low[pre_nnz + k];
+                        if (matrix->Blockcsr_Val_Packed)
+                            tile_pack_store(matrix, blki, tile_id, k, csr_val_temp[pre_nnz + k]);
                         Tile_csr_Col[offset + k] = csr_colidx_temp[pre_nnz + k];
                     }
                     Blockcsr_Ptr[ptr_offset + ri] = ptr_temp[ri];
@@ -258,12 +278,93 @@ void convert_step4(Tile_matrix *matrix,
             }
         }
     }
-    free(csr_colidx_temp_g);
-    free(csr_val_temp_g);
-    free(tile_count_g);
-    free(csr_val_temp_g_Low);
+    arena_rewind(scratch, mark);
 }
 
+// same layout as convert_step4 in O(nnz): rows arrive in order and a tile stores its rows back to back,
+// so each nonzero goes straight to its tile's write cursor, found through a column-block -> slot map
+template <int TS>
+void convert_step4_scatter(Tile_matrix *matrix,
+                           typename tile_traits<TS>::ptr_type *tile_csr_ptr,
+                           int tile_count_temp,
+                           int rowA,
+                           int colA,
+                           MAT_PTR_TYPE nnzA,
+                           MAT_PTR_TYPE *csrRowPtrA,
+                           int *csrColIdxA,
+                           MAT_VAL_TYPE *csrValA,
+                           MAT_VAL_LOW_TYPE *csrValA_Low,
+                           const char *keep)
+
+{
+    int tilem = matrix->tilem;
+    int tilen = matrix->tilen;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    char *Format = matrix->Format;
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    MAT_VAL_LOW_TYPE *Blockcsr_Val_Low = matrix->Blockcsr_Val_Low;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
+    unsigned char *Tile_csr_Col = matrix->Tile_csr_Col;
+    unsigned thread = omp_get_max_threads();
+    // every column block of a row block is written before it is read, so neither array needs clearing
+    arena *scratch = setup_scratch();
+    size_t mark = arena_mark(scratch);
+    int *slot_g = (int *)arena_alloc(scratch, (thread * tilen) * sizeof(int));
+    MAT_PTR_TYPE *cursor_g = (MAT_PTR_TYPE *)arena_alloc(scratch, (thread * tile_count_temp) * sizeof(MAT_PTR_TYPE));
+
+#pragma omp parallel for
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int thread_id = omp_get_thread_num();
+        int *slot = slot_g + thread_id * tilen;
+        MAT_PTR_TYPE *cursor = cursor_g + thread_id * tile_count_temp;
+        int rowlen = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+        int start = blki * TS;
+        int end = blki == tilem - 1 ? rowA : (blki + 1) * TS;
+
+        for (int bi = 0; bi < tile_ptr[blki + 1] - tile_ptr[blki]; bi++)
+        {
+            int tile_id = tile_ptr[blki] + bi;
+            slot[tile_columnidx[tile_id]] = Format[tile_id] == 0 ? bi : -1;
+            cursor[bi] = tile_csr_start(matrix, blki, tile_id);
+            if (Format[tile_id] == 0)
+            {
+                typename tile_traits<TS>::ptr_type *ptr_temp = tile_csr_ptr + (size_t)tile_id * TS;
+                exclusive_scan_small(ptr_temp, rowlen);
+                MAT_PTR_TYPE ptr_offset = tile_ptr_start(matrix, blki, tile_id);
+                for (int ri = 0; ri < rowlen; ri++)
+                    Blockcsr_Ptr[ptr_offset + ri] = ptr_temp[ri];
+            }
+        }
+
+        for (MAT_PTR_TYPE j = csrRowPtrA[start]; j < csrRowPtrA[end]; j++)
+        {
+            if (keep && !keep[j])
+                continue;
+            int jc = csrColIdxA[j] / TS;
+            int bi = slot[jc];
+            if (bi < 0)
+                continue;
+            MAT_PTR_TYPE k = cursor[bi]++;
+            unsigned char colidx = csrColIdxA[j] - jc * TS;
+            if (Blockcsr_Val)
+                Blockcsr_Val[k] = csrValA[j];
+            if (Blockcsr_Val_Low)
+                Blockcsr_Val_Low[k] = csrValA_Low[j];
+            if (matrix->Blockcsr_Val_Packed)
+            {
+                int tile_id = tile_ptr[blki] + bi;
+                tile_pack_store(matrix, blki, tile_id, k - tile_csr_start(matrix, blki, tile_id), csrValA[j]);
+            }
+            Tile_csr_Col[k] = colidx;
+        }
+    }
+    arena_rewind(scratch, mark);
+}
+
+// keep, when given, holds a flag per CSR entry and the tiles are built from the flagged entries only
+template <int TS>
 void Tile_create(Tile_matrix *matrix,
                  int rowA,
                  int colA,
@@ -271,71 +372,132 @@ void Tile_create(Tile_matrix *matrix,
                  MAT_PTR_TYPE *csrRowPtrA,
                  int *csrColIdxA,
                  MAT_VAL_TYPE *csrValA,
-                 MAT_VAL_LOW_TYPE *csrValA_Low)
+                 MAT_VAL_LOW_TYPE *csrValA_Low,
+                 double prec_tol,
+                 const char *keep)
 {
 
     struct timeval t1, t2;
     double time_conversion = 0;
+    typedef typename tile_traits<TS>::ptr_type ptr_type;
+
+    matrix->tile_size = TS;
+    matrix->tilem = rowA % TS == 0 ? rowA / TS : (rowA / TS) + 1;
+    matrix->tilen = colA % TS == 0 ? colA / TS : (colA / TS) + 1;
+    int tilem = matrix->tilem;
+    int tilen = matrix->tilen;
+    unsigned thread = omp_get_max_threads();
 
-    matrix->tilem = rowA % BLOCK_SIZE == 0 ? rowA / BLOCK_SIZE : (rowA / BLOCK_SIZE) + 1;
-    matrix->tilen = colA % BLOCK_SIZE == 0 ? colA / BLOCK_SIZE : (colA / BLOCK_SIZE) + 1;
-    matrix->tile_ptr = (int *)malloc((matrix->tilem + 1) * sizeof(int));
-    memset(matrix->tile_ptr, 0, (matrix->tilem + 1) * sizeof(int));
+    // the tile counts go to scratch until the tile count sizes the matrix arena
+    arena *scratch = setup_scratch();
+    arena_reserve(scratch, arena_bytes((tilem + 1) * sizeof(MAT_PTR_TYPE)) + arena_bytes(thread * tilen * sizeof(char)));
+    matrix->tile_ptr = (MAT_PTR_TYPE *)arena_alloc(scratch, (tilem + 1) * sizeof(MAT_PTR_TYPE));
+    memset(matrix->tile_ptr, 0, (tilem + 1) * sizeof(MAT_PTR_TYPE));
+    matrix->tile_prec = NULL;
+    matrix->tile_val_offset = NULL;
+    matrix->Blockcsr_Val_Packed = NULL;
+    matrix->packedsize = 0;
+    matrix->rowblk_packed_base = NULL;
 
 #if FORMAT_CONVERSION
     gettimeofday(&t1, NULL);
 #endif
-    convert_step1(matrix,
+    convert_step1<TS>(matrix,
                   rowA, colA, nnzA,
-                  csrRowPtrA, csrColIdxA, csrValA);
+                  csrRowPtrA, csrColIdxA, csrValA, keep);
 
 #if FORMAT_CONVERSION
     gettimeofday(&t2, NULL);
     time_conversion += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
 #endif
 
-    exclusive_scan(matrix->tile_ptr, matrix->tilem + 1);
-    matrix->tilenum = matrix->tile_ptr[matrix->tilem];
+    exclusive_scan(matrix->tile_ptr, tilem + 1);
+    matrix->tilenum = matrix->tile_ptr[tilem];
     int tilenum = matrix->tilenum;
 
-    matrix->tile_columnidx = (int *)malloc(tilenum * sizeof(int));
-    memset(matrix->tile_columnidx, 0, tilenum * sizeof(int));
-
-    matrix->tile_nnz = (int *)malloc((tilenum + 1) * sizeof(int));
-    memset(matrix->tile_nnz, 0, (tilenum + 1) * sizeof(int));
-    unsigned char *tile_csr_ptr = (unsigned char *)malloc((tilenum * BLOCK_SIZE) * sizeof(unsigned char));
-    memset(tile_csr_ptr, 0, (tilenum * BLOCK_SIZE) * sizeof(unsigned char));
+    // every nonzero lands in a CSR tile and every tile stores a pointer per row of its row block, so the
+    // sizes of all the arrays the matrix keeps are known here and one arena holds them. Each slot is written
+    // below, except tilewidth, which stays zero from the fresh pages. With prec_tol >= 0 the values only go to
+    // the packed stream (tile_precision.h) and Blockcsr_Val is not kept; Blockcsr_Val_Low is kept only when
+    // csrValA_Low is given
+    MAT_PTR_TYPE csrsize = csrRowPtrA[rowA] - csrRowPtrA[0];
+    if (keep)
+    {
+        csrsize = 0;
+#pragma omp parallel for reduction(+ : csrsize)
+        for (MAT_PTR_TYPE j = csrRowPtrA[0]; j < csrRowPtrA[rowA]; j++)
+            csrsize += keep[j] != 0;
+    }
+    MAT_PTR_TYPE csrptrlen = (MAT_PTR_TYPE)tilenum * TS;
+    if (tilem > 0)
+        csrptrlen -= (MAT_PTR_TYPE)(matrix->tile_ptr[tilem] - matrix->tile_ptr[tilem - 1]) * (tilem * TS - rowA);
+    MAT_PTR_TYPE compressed_csr_size = tile_idx_bytes<TS>(csrsize);
+    size_t ptr_bytes = (tilem + 1) * sizeof(MAT_PTR_TYPE);
+    size_t offset_bytes = (tilenum + 1) * sizeof(int);
+    size_t flag_bytes = (tilenum + 1) * sizeof(char);
+    arena_create(&matrix->mem, 2 * arena_bytes(ptr_bytes) + 5 * arena_bytes(offset_bytes) + 3 * arena_bytes(flag_bytes) +
+                                   arena_bytes(csrptrlen * sizeof(ptr_type)) + arena_bytes(compressed_csr_size + 16) +
+                                   arena_bytes(csrsize * sizeof(unsigned char)) +
+                                   (prec_tol < 0 ? arena_bytes(csrsize * sizeof(MAT_VAL_TYPE)) : 0) +
+                                   (csrValA_Low ? arena_bytes(csrsize * sizeof(MAT_VAL_LOW_TYPE)) : 0));
+    MAT_PTR_TYPE *tile_ptr = (MAT_PTR_TYPE *)arena_alloc(&matrix->mem, ptr_bytes);
+    memcpy(tile_ptr, matrix->tile_ptr, ptr_bytes);
+    matrix->tile_ptr = tile_ptr;
+    matrix->rowblk_base = (MAT_PTR_TYPE *)arena_alloc(&matrix->mem, ptr_bytes);
+    matrix->tile_columnidx = (int *)arena_alloc(&matrix->mem, offset_bytes);
+    matrix->tile_nnz = (int *)arena_alloc(&matrix->mem, offset_bytes);
+    matrix->blknnz = (int *)arena_alloc(&matrix->mem, offset_bytes);
+    matrix->csr_offset = (int *)arena_alloc(&matrix->mem, offset_bytes);
+    matrix->csrptr_offset = (int *)arena_alloc(&matrix->mem, offset_bytes);
+    matrix->Format = (char *)arena_alloc(&matrix->mem, flag_bytes);
+    matrix->blknnznnz = (unsigned char *)arena_alloc(&matrix->mem, flag_bytes);
+    matrix->tilewidth = (char *)arena_alloc(&matrix->mem, flag_bytes);
+    matrix->Blockcsr_Ptr = (unsigned char *)arena_alloc(&matrix->mem, csrptrlen * sizeof(ptr_type));
+    // 16 spare bytes so the SIMD kernels can load a full row of nibbles at the tail
+    matrix->csr_compressedIdx = (unsigned char *)arena_alloc(&matrix->mem, compressed_csr_size + 16);
+    matrix->Tile_csr_Col = (unsigned char *)arena_alloc(&matrix->mem, csrsize * sizeof(unsigned char));
+    matrix->Blockcsr_Val = prec_tol < 0 ? (MAT_VAL_TYPE *)arena_alloc(&matrix->mem, csrsize * sizeof(MAT_VAL_TYPE)) : NULL;
+    matrix->Blockcsr_Val_Low = csrValA_Low ? (MAT_VAL_LOW_TYPE *)arena_alloc(&matrix->mem, csrsize * sizeof(MAT_VAL_LOW_TYPE)) : NULL;
+
+    // the per-row-pointer scratch of steps 2 to 4, and the largest of their per-thread temporaries
+    int nnz_temp = 0;
+    int tile_count_temp = 0;
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int start = blki * TS;
+        int end = blki == tilem - 1 ? rowA : (blki + 1) * TS;
+        nnz_temp = nnz_temp < csrRowPtrA[end] - csrRowPtrA[start] ? csrRowPtrA[end] - csrRowPtrA[start] : nnz_temp;
+        tile_count_temp = tile_count_temp < tile_ptr[blki + 1] - tile_ptr[blki] ? tile_ptr[blki + 1] - tile_ptr[blki] : tile_count_temp;
+    }
+    size_t step2_bytes = arena_bytes(thread * tilen * sizeof(char)) + arena_bytes(thread * tilen * sizeof(int)) +
+                         arena_bytes(thread * tilen * TS * sizeof(unsigned char));
+#if CONVERT_SCATTER
+    size_t step4_bytes = arena_bytes(thread * tilen * sizeof(int)) + arena_bytes(thread * tile_count_temp * sizeof(MAT_PTR_TYPE));
+#else
+    size_t step4_bytes = arena_bytes(thread * nnz_temp * sizeof(unsigned char)) + arena_bytes(thread * nnz_temp * sizeof(MAT_VAL_TYPE)) +
+                         arena_bytes(thread * nnz_temp * sizeof(MAT_VAL_LOW_TYPE)) + arena_bytes(thread * tile_count_temp * sizeof(int));
+#endif
+    arena_reserve(scratch, arena_bytes((size_t)tilenum * TS * sizeof(ptr_type)) + (step2_bytes > step4_bytes ? step2_bytes : step4_bytes));
+    // rows past a partial last row block are never read, so this needs no clearing
+    ptr_type *tile_csr_ptr = (ptr_type *)arena_alloc(scratch, ((size_t)tilenum * TS) * sizeof(ptr_type));
 
 #if FORMAT_CONVERSION
     gettimeofday(&t1, NULL);
 #endif
-    convert_step2(matrix, tile_csr_ptr,
+    convert_step2<TS>(matrix, tile_csr_ptr,
                   rowA, colA, nnzA,
-                  csrRowPtrA, csrColIdxA, csrValA);
+                  csrRowPtrA, csrColIdxA, csrValA, keep);
 #if FORMAT_CONVERSION
     gettimeofday(&t2, NULL);
     time_conversion += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
 #endif
-    exclusive_scan(matrix->tile_nnz, tilenum + 1);
-
-    matrix->Format = (char *)malloc(tilenum * sizeof(char));
-    memset(matrix->Format, 0, tilenum * sizeof(char));
-    matrix->blknnz = (int *)malloc((tilenum + 1) * sizeof(int));
-    memset(matrix->blknnz, 0, (tilenum + 1) * sizeof(int));
-    matrix->blknnznnz = (unsigned char *)malloc((tilenum + 1) * sizeof(unsigned char));
-    memset(matrix->blknnznnz, 0, (tilenum + 1) * sizeof(unsigned char));
-    matrix->tilewidth = (char *)malloc(tilenum * sizeof(char));
-    memset(matrix->tilewidth, 0, tilenum * sizeof(char));
-    matrix->csr_offset = (int *)malloc((tilenum + 1) * sizeof(int));
-    memset(matrix->csr_offset, 0, (tilenum + 1) * sizeof(int));
-    matrix->csrptr_offset = (int *)malloc((tilenum + 1) * sizeof(int));
-    memset(matrix->csrptr_offset, 0, (tilenum + 1) * sizeof(int));
+    tile_offset_scan(matrix->tile_nnz, tilenum, matrix->tile_ptr, matrix->tilem, NULL);
 
 #if FORMAT_CONVERSION
     gettimeofday(&t1, NULL);
 #endif
 
-    convert_step3(matrix, tile_csr_ptr,
+    convert_step3<TS>(matrix, tile_csr_ptr,
                   rowA, colA, nnzA,
                   csrRowPtrA, csrColIdxA, csrValA);
 #if FORMAT_CONVERSION
@@ -343,80 +505,59 @@ void Tile_create(Tile_matrix *matrix,
     time_conversion += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
 #endif
 
-    exclusive_scan(matrix->csr_offset, tilenum + 1);
-    exclusive_scan(matrix->csrptr_offset, tilenum + 1);
-
-    matrix->csrsize = 0;
-    matrix->csrptrlen = 0;
-
-    for (int blki = 0; blki < matrix->tilem; blki++)
-    {
-        int rowlength = blki == matrix->tilem - 1 ? rowA - (matrix->tilem - 1) * BLOCK_SIZE : BLOCK_SIZE;
-        int rowbnum = matrix->tile_ptr[blki + 1] - matrix->tile_ptr[blki];
-        for (int bi = 0; bi < rowbnum; bi++)
-        {
-            int tile_id = matrix->tile_ptr[blki] + bi;
-            char format = matrix->Format[tile_id];
-            switch (format)
-            {
-            case 0: // csr
-                matrix->csrsize += matrix->blknnz[tile_id];
-                matrix->csrptrlen += rowlength;
-                break;
-
-            default:
-                break;
-            }
-        }
-    }
+    // every tile is CSR (convert_step3), so the totals of the two scans are the sizes of the CSR arrays
+    matrix->csrsize = tile_offset_scan(matrix->csr_offset, tilenum, matrix->tile_ptr, matrix->tilem, matrix->rowblk_base);
+    matrix->csrptrlen = tile_offset_scan(matrix->csrptr_offset, tilenum, matrix->tile_ptr, matrix->tilem, NULL);
 
+    matrix->blknnz[tilenum] = 0;
     for (int i = 0; i < tilenum + 1; i++)
         matrix->blknnznnz[i] = matrix->blknnz[i];
 
-    exclusive_scan(matrix->blknnz, tilenum + 1);
-
-    // CSR
-    matrix->Blockcsr_Val = (MAT_VAL_TYPE *)malloc((matrix->csrsize) * sizeof(MAT_VAL_TYPE));
-    memset(matrix->Blockcsr_Val, 0, (matrix->csrsize) * sizeof(MAT_VAL_TYPE));
-    matrix->Blockcsr_Val_Low = (MAT_VAL_LOW_TYPE *)malloc((matrix->csrsize) * sizeof(MAT_VAL_LOW_TYPE));
-    memset(matrix->Blockcsr_Val_Low, 0, (matrix->csrsize) * sizeof(MAT_VAL_LOW_TYPE));
-    unsigned char *Blockcsr_Col_tmp = (unsigned char *)malloc((matrix->csrsize) * sizeof(unsigned char));
-    memset(Blockcsr_Col_tmp, 0, (matrix->csrsize) * sizeof(unsigned char));
-    matrix->Blockcsr_Ptr = (unsigned char *)malloc((matrix->csrptrlen) * sizeof(unsigned char));
-    memset(matrix->Blockcsr_Ptr, 0, (matrix->csrptrlen) * sizeof(unsigned char));
-    int compressed_csr_size = matrix->csrsize % 2 == 0 ? matrix->csrsize / 2 : matrix->csrsize / 2 + 1;
-    matrix->csr_compressedIdx = (unsigned char *)malloc((compressed_csr_size) * sizeof(unsigned char));
-    memset(matrix->csr_compressedIdx, 0, (compressed_csr_size) * sizeof(unsigned char));
-    matrix->Tile_csr_Col = (unsigned char *)malloc((matrix->csrsize) * sizeof(unsigned char));
-    memset(matrix->Tile_csr_Col, 0, (matrix->csrsize) * sizeof(unsigned char));
-    
-
+    tile_offset_scan(matrix->blknnz, tilenum, matrix->tile_ptr, matrix->tilem, NULL);
+    memset(matrix->csr_compressedIdx + compressed_csr_size, 0, 16);
+    if (prec_tol >= 0)
+        tile_pack_layout(matrix, rowA, csrRowPtrA, csrColIdxA, csrValA, keep, prec_tol);
 
-    int nnz_temp = 0;
-    int tile_count_temp = 0;
-    for (int blki = 0; blki < matrix->tilem; blki++)
-    {
-        int start = blki * BLOCK_SIZE;
-        int end = blki == matrix->tilem - 1 ? rowA : (blki + 1) * BLOCK_SIZE;
-        nnz_temp = nnz_temp < csrRowPtrA[end] - csrRowPtrA[start] ? csrRowPtrA[end] - csrRowPtrA[start] : nnz_temp;
-        tile_count_temp = tile_count_temp < matrix->tile_ptr[blki + 1] - matrix->tile_ptr[blki] ? matrix->tile_ptr[blki + 1] - matrix->tile_ptr[blki] : tile_count_temp;
-    }
 #if FORMAT_CONVERSION
     gettimeofday(&t1, NULL);
 #endif
 
-    convert_step4(matrix, tile_csr_ptr,
-                  Blockcsr_Col_tmp,
+#if CONVERT_SCATTER
+    convert_step4_scatter<TS>(matrix, tile_csr_ptr,
+                          tile_count_temp,
+                          rowA, colA, nnzA,
+                          csrRowPtrA, csrColIdxA, csrValA,
+                          csrValA_Low, keep);
+#else
+    convert_step4<TS>(matrix, tile_csr_ptr,
                   nnz_temp, tile_count_temp,
                   rowA, colA, nnzA,
                   csrRowPtrA, csrColIdxA, csrValA,
-                  csrValA_Low);
+                  csrValA_Low, keep);
+#endif
+    tile_idx_encode<TS>(matrix->Tile_csr_Col, matrix->csr_compressedIdx, matrix->csrsize);
 
 #if FORMAT_CONVERSION
     gettimeofday(&t2, NULL);
-    time_conversion += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    double time_step4 = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    time_conversion += time_step4;
+    printf("time_conversion=%lf ms (step4 %s %lf ms)\n", time_conversion, CONVERT_SCATTER ? "scatter" : "search", time_step4);
 #endif
 
-    free(Blockcsr_Col_tmp);
-    free(tile_csr_ptr);
+    arena_rewind(scratch, 0);
 }
+
+// the 16-wide format the GPU kernels are written for
+void Tile_create(Tile_matrix *matrix,
+                 int rowA,
+                 int colA,
+                 MAT_PTR_TYPE nnzA,
+                 MAT_PTR_TYPE *csrRowPtrA,
+                 int *csrColIdxA,
+                 MAT_VAL_TYPE *csrValA,
+                 MAT_VAL_LOW_TYPE *csrValA_Low)
+{
+    Tile_create<BLOCK_SIZE>(matrix, rowA, colA, nnzA, csrRowPtrA, csrColIdxA, csrValA, csrValA_Low, -1, NULL);
+}
+
+#endif
@@ -194,7 +194,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     int rowA = n;
     int colA = ori;
     rowA = (rowA / BLOCK_SIZE) * BLOCK_SIZE;
-    Tile_matrix *matrix = (Tile_matrix *)malloc(sizeof(Tile_matrix));
+    Tile_matrix *matrix = (Tile_matrix *)calloc(1, sizeof(Tile_matrix));
     Tile_create(matrix,
                 rowA, colA, nnzR,
                 RowPtr,
@@ -565,6 +565,7 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     cudaFree(d_ptroffset2);
     cudaFree(d_x);
     cudaFree(d_y);
+    Tile_destroy(matrix);
     free(matrix);
     free(ptroffset1);
     free(ptroffset2);
@@ -573,15 +574,6 @@ extern "C" void cg_solve_inc(int *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_VA
     free(blkcoostylerowidx);
     free(blkcoostylerowidx_colstart);
     free(blkcoostylerowidx_colstop);
-    free(tile_ptr);
-    free(tile_columnidx);
-    free(tile_nnz);
-    free(csr_offset);
-    free(csrptr_offset);
-    free(Blockcsr_Val);
-    free(Blockcsr_Val_Low);
-    free(csr_compressedIdx);
-    free(Blockcsr_Ptr);
 }
 int main(int argc, char **argv)
 {
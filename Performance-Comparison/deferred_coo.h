@@ -0,0 +1,168 @@
+#ifndef _DEFERRED_COO_H_
+#define _DEFERRED_COO_H_
+
+#include "common.h"
+#include "format.h"
+#include "utils.h"
+#include "tile_size.h"
+
+// Deferred COO: an off-diagonal tile with fewer than deferred_coo_threshold nonzeros (COO_NNZ_TH scaled by
+// tile_size / 16, tile_size.h) costs its tile_columnidx entry, offsets and a whole row-pointer slice for a
+// handful of multiply-adds. Its entries are left out of the tiles and copied into one row-sorted CSR over the
+// global rows (deferredcoo_ptr, deferredcoo_colidx, deferredcoo_val, coototal entries) and every SpMV adds
+// them after its tile sweep, on the rows the thread owns. Diagonal tiles are always kept so that
+// block_jacobi_extract sees the whole diagonal block.
+
+// flag in keep the entries of row block blki that stay in tiles, counting nnz per column block through stamp
+static inline void deferred_coo_mark(int blki, int ts, int th, int row_stop, MAT_PTR_TYPE *RowPtr, int *ColIdx,
+                                     int *stamp, int *count, char *keep)
+{
+    for (MAT_PTR_TYPE j = RowPtr[blki * ts]; j < RowPtr[row_stop]; j++)
+    {
+        int blkj = ColIdx[j] / ts;
+        if (stamp[blkj] != blki)
+        {
+            stamp[blkj] = blki;
+            count[blkj] = 0;
+        }
+        count[blkj]++;
+    }
+    for (MAT_PTR_TYPE j = RowPtr[blki * ts]; j < RowPtr[row_stop]; j++)
+    {
+        int blkj = ColIdx[j] / ts;
+        keep[j] = blkj == blki || count[blkj] >= th;
+    }
+}
+
+// Tile_create_sized on the entries of the kept tiles, the rest into the matrix's deferred CSR. The tiles
+// are built straight from the input through a keep flag per entry, so only the deferred entries are copied
+void Tile_create_deferred(Tile_matrix *matrix,
+                          int tile_size,
+                          int rowA,
+                          int colA,
+                          MAT_PTR_TYPE nnzA,
+                          MAT_PTR_TYPE *csrRowPtrA,
+                          int *csrColIdxA,
+                          MAT_VAL_TYPE *csrValA,
+                          MAT_VAL_LOW_TYPE *csrValA_Low,
+                          double prec_tol)
+{
+    int ts = tile_size;
+    int th = deferred_coo_threshold(ts);
+    int tilem = (rowA + ts - 1) / ts;
+    int tilen = (colA + ts - 1) / ts;
+
+    char *keep = (char *)malloc(sizeof(char) * (csrRowPtrA[rowA] + 1));
+    MAT_PTR_TYPE *def_rowptr = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (rowA + 1));
+    int nthreads = omp_get_max_threads();
+    int *stamp_g = (int *)malloc(sizeof(int) * nthreads * tilen);
+    int *count_g = (int *)malloc(sizeof(int) * nthreads * tilen);
+    for (int i = 0; i < nthreads * tilen; i++)
+        stamp_g[i] = -1;
+
+    // deferred nnz per row
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int tid = omp_get_thread_num();
+        int row_stop = (blki + 1) * ts < rowA ? (blki + 1) * ts : rowA;
+        deferred_coo_mark(blki, ts, th, row_stop, csrRowPtrA, csrColIdxA, stamp_g + tid * tilen, count_g + tid * tilen, keep);
+        for (int i = blki * ts; i < row_stop; i++)
+        {
+            int def = 0;
+            for (MAT_PTR_TYPE j = csrRowPtrA[i]; j < csrRowPtrA[i + 1]; j++)
+                def += !keep[j];
+            def_rowptr[i] = def;
+        }
+    }
+    free(stamp_g);
+    free(count_g);
+    exclusive_scan(def_rowptr, rowA + 1);
+    MAT_PTR_TYPE coototal = def_rowptr[rowA];
+
+    int *def_colidx = (int *)malloc(sizeof(int) * (coototal + 1));
+    MAT_VAL_TYPE *def_val = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * (coototal + 1));
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int i = 0; i < rowA; i++)
+    {
+        MAT_PTR_TYPE kd = def_rowptr[i];
+        for (MAT_PTR_TYPE j = csrRowPtrA[i]; j < csrRowPtrA[i + 1]; j++)
+        {
+            if (!keep[j])
+            {
+                def_colidx[kd] = csrColIdxA[j];
+                def_val[kd++] = csrValA[j];
+            }
+        }
+    }
+
+    Tile_create_sized(matrix, tile_size, rowA, colA, nnzA, csrRowPtrA, csrColIdxA, csrValA, csrValA_Low, prec_tol, keep);
+    matrix->coototal = coototal;
+    matrix->deferredcoo_ptr = def_rowptr;
+    matrix->deferredcoo_colidx = def_colidx;
+    matrix->deferredcoo_val = def_val;
+    matrix->deferredcoo_val_Low = NULL;
+    free(keep);
+}
+
+// y += A_deferred x on rows row_start..row_stop-1, after the tile sweep wrote them; returns w.(A_deferred x)
+static inline MAT_VAL_TYPE deferred_coo_spmv(Tile_matrix *matrix, int row_start, int row_stop, MAT_VAL_TYPE *x, MAT_VAL_TYPE *y, MAT_VAL_TYPE *w)
+{
+    const MAT_PTR_TYPE *ptr = matrix->deferredcoo_ptr;
+    const int *colidx = matrix->deferredcoo_colidx;
+    const MAT_VAL_TYPE *val = matrix->deferredcoo_val;
+    MAT_VAL_TYPE dot = 0;
+    if (!matrix->coototal)
+        return dot;
+    for (int i = row_start; i < row_stop; i++)
+    {
+        MAT_VAL_TYPE sum = 0;
+#pragma omp simd reduction(+ : sum)
+        for (MAT_PTR_TYPE j = ptr[i]; j < ptr[i + 1]; j++)
+            sum += val[j] * x[colidx[j]];
+        y[i] += sum;
+        dot += w[i] * sum;
+    }
+    return dot;
+}
+
+// deferred_coo_spmv for nrhs interleaved vectors, as blockspmm_cpu_rowblk stores them
+static inline void deferred_coo_spmm(Tile_matrix *matrix, int row_start, int row_stop, int nrhs, MAT_VAL_TYPE *X, MAT_VAL_TYPE *Y)
+{
+    const MAT_PTR_TYPE *ptr = matrix->deferredcoo_ptr;
+    if (!matrix->coototal)
+        return;
+    for (int i = row_start; i < row_stop; i++)
+    {
+        MAT_VAL_TYPE *y_row = Y + (size_t)i * nrhs;
+        for (MAT_PTR_TYPE j = ptr[i]; j < ptr[i + 1]; j++)
+        {
+            MAT_VAL_TYPE v = matrix->deferredcoo_val[j];
+            const MAT_VAL_TYPE *x_row = X + (size_t)matrix->deferredcoo_colidx[j] * nrhs;
+#pragma omp simd
+            for (int k = 0; k < nrhs; k++)
+                y_row[k] += v * x_row[k];
+        }
+    }
+}
+
+// y += A_deferred dd over the entries whose column block is flagged in col_changed, for the SpMV bypass
+static inline void deferred_coo_spmv_delta(Tile_matrix *matrix, int row_start, int row_stop, int tile_size, char *col_changed, MAT_VAL_TYPE *dd, MAT_VAL_TYPE *y)
+{
+    const MAT_PTR_TYPE *ptr = matrix->deferredcoo_ptr;
+    if (!matrix->coototal)
+        return;
+    for (int i = row_start; i < row_stop; i++)
+    {
+        MAT_VAL_TYPE sum = 0;
+        for (MAT_PTR_TYPE j = ptr[i]; j < ptr[i + 1]; j++)
+        {
+            int col = matrix->deferredcoo_colidx[j];
+            if (col_changed[col / tile_size])
+                sum += matrix->deferredcoo_val[j] * dd[col];
+        }
+        y[i] += sum;
+    }
+}
+
+#endif
@@ -1,7 +1,11 @@
+#ifndef _ENCODE_H_
+#define _ENCODE_H_
+
 #include"common.h"
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 
 # define INDEX_DATA_TYPE unsigned char
@@ -71,6 +75,87 @@ void decode(INDEX_DATA_TYPE *str, INDEX_DATA_TYPE *res, int res_len)
     }
 }
 
+// Tile-local column indices for a TS-wide tile: 3-bit fields packed low bit first for 8, the nibble
+// layout of encode() for 16, and one byte each for 32. Blockcsr_Ptr holds row starts inside a tile,
+// which reach 31 * 32 for 32-wide tiles and need 16 bits there.
+template <int TS>
+struct tile_traits
+{
+    typedef unsigned char ptr_type;
+};
+
+template <>
+struct tile_traits<32>
+{
+    typedef unsigned short ptr_type;
+};
+
+template <int TS>
+MAT_PTR_TYPE tile_idx_bytes(MAT_PTR_TYPE len);
+
+template <>
+MAT_PTR_TYPE tile_idx_bytes<8>(MAT_PTR_TYPE len) { return (len * 3 + 7) / 8; }
+
+template <>
+MAT_PTR_TYPE tile_idx_bytes<16>(MAT_PTR_TYPE len) { return (len + 1) / 2; }
+
+template <>
+MAT_PTR_TYPE tile_idx_bytes<32>(MAT_PTR_TYPE len) { return len; }
+
+template <int TS>
+void tile_idx_encode(INDEX_DATA_TYPE *str, INDEX_DATA_TYPE *res, MAT_PTR_TYPE str_len);
+
+template <>
+void tile_idx_encode<8>(INDEX_DATA_TYPE *str, INDEX_DATA_TYPE *res, MAT_PTR_TYPE str_len)
+{
+    memset(res, 0, tile_idx_bytes<8>(str_len));
+    for (MAT_PTR_TYPE i = 0; i < str_len; i++)
+    {
+        MAT_PTR_TYPE bit = i * 3;
+        unsigned int field = (unsigned int)(str[i] & 7) << (bit & 7);
+        res[bit >> 3] |= field & 0xff;
+        if ((bit & 7) > 5)
+            res[(bit >> 3) + 1] |= field >> 8;
+    }
+}
+
+// the layout of encode(), whose int length stops at 2^31 nonzeros
+template <>
+void tile_idx_encode<16>(INDEX_DATA_TYPE *str, INDEX_DATA_TYPE *res, MAT_PTR_TYPE str_len)
+{
+    for (MAT_PTR_TYPE i = 0; i < str_len; i += 2)
+        res[i / 2] = (str[i] << 4) + (i + 1 < str_len ? str[i + 1] : 0);
+}
+
+template <>
+void tile_idx_encode<32>(INDEX_DATA_TYPE *str, INDEX_DATA_TYPE *res, MAT_PTR_TYPE str_len)
+{
+    memcpy(res, str, str_len);
+}
+
+// column of nonzero pos; the 8-wide case reads one byte past the field, so buffers carry a spare byte
+template <int TS>
+inline int tile_idx_get(const INDEX_DATA_TYPE *res, MAT_PTR_TYPE pos);
+
+template <>
+inline int tile_idx_get<8>(const INDEX_DATA_TYPE *res, MAT_PTR_TYPE pos)
+{
+    MAT_PTR_TYPE bit = pos * 3;
+    return ((res[bit >> 3] | (res[(bit >> 3) + 1] << 8)) >> (bit & 7)) & 7;
+}
+
+template <>
+inline int tile_idx_get<16>(const INDEX_DATA_TYPE *res, MAT_PTR_TYPE pos)
+{
+    return pos % 2 == 0 ? (res[pos / 2] & num_f) >> 4 : res[pos / 2] & num_b;
+}
+
+template <>
+inline int tile_idx_get<32>(const INDEX_DATA_TYPE *res, MAT_PTR_TYPE pos)
+{
+    return res[pos];
+}
+
 void transposition_CSR_to_COO(INDEX_DATA_TYPE *csr_rowPtr, INDEX_DATA_TYPE *csr_colIdx, VAL_DATA_TYPE *csr_val,
                               INDEX_DATA_TYPE *coo_rowIdx, INDEX_DATA_TYPE *coo_colIdx, VAL_DATA_TYPE *coo_val,
                               int m, int nnz)
@@ -119,3 +204,4 @@ void transposition_CSR_to_DENSE(INDEX_DATA_TYPE *csr_rowPtr, INDEX_DATA_TYPE *cs
     return;
 }
 
+#endif
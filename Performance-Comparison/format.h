@@ -1,4 +1,8 @@
+#ifndef _FORMAT_H_
+#define _FORMAT_H_
+
 #include "common.h"
+#include "arena.h"
 
 typedef struct csrval
 {
@@ -11,8 +15,14 @@ typedef struct Data{
     float *v2;
 }va;
 
+// Per-tile offsets (tile_nnz, blknnz, csr_offset, csrptr_offset, tile_val_offset) are exclusive scans kept
+// in 32 bits, modulo 2^32 once an operator passes 2^31 nonzeros: the difference of two entries in one row
+// block stays exact, and rowblk_base / rowblk_packed_base give the full 64-bit start of each row block. The
+// CPU kernels address a tile through tile_csr_start, tile_ptr_start and tile_packed_start, never through
+// the raw offset; below 2^31 nonzeros the raw offsets are the global ones the GPU drivers read.
 typedef struct
 {
+    int tile_size; // rows and columns per tile: 8, 16 or 32
     int tilem;
     int tilen;
     int tilenum;
@@ -41,8 +51,8 @@ typedef struct
     mixval *Blockcsr_Val_mix;
     unsigned char *Blockcsr_Ptr;
     unsigned char *csr_compressedIdx;
-    int csrsize;
-    int csrptrlen;
+    MAT_PTR_TYPE csrsize;
+    MAT_PTR_TYPE csrptrlen;
     MAT_VAL_TYPE *Blockcoo_Val;
     MAT_VAL_LOW_TYPE *Blockcoo_Val_Low;
     unsigned char *coo_compressed_Idx;
@@ -68,7 +78,7 @@ typedef struct
     MAT_VAL_LOW_TYPE *Blockdensecol_Val_Low;
     char *densecolid;
     int dnscolsize;
-    int coototal;
+    MAT_PTR_TYPE coototal;
     MAT_VAL_TYPE *deferredcoo_val;
     MAT_VAL_LOW_TYPE *deferredcoo_val_Low;
     int *deferredcoo_colidx;
@@ -82,20 +92,101 @@ typedef struct
     int *tile_bal_rowidx_colstart_v2;
     int *tile_bal_rowidx_colstop_v2;
     int *map;
+    char *tile_prec;
+    int *tile_val_offset;
+    unsigned char *Blockcsr_Val_Packed;
+    MAT_PTR_TYPE packedsize;
+    MAT_PTR_TYPE *rowblk_base;        // Blockcsr_Val slot of each row block's first tile, tilem + 1 entries
+    MAT_PTR_TYPE *rowblk_packed_base; // byte of each row block's first tile in Blockcsr_Val_Packed
+    arena mem;                        // backs every array Tile_create allocates
 
 } Tile_matrix;
 
+// entries of tile t in an offset array, exact whatever the wrap
+static inline int tile_span(const int *offset, int t)
+{
+    return (int)((unsigned)offset[t + 1] - (unsigned)offset[t]);
+}
+
+// Blockcsr_Val / csr_compressedIdx position of tile blkj of row block blki
+static inline MAT_PTR_TYPE tile_csr_start(const Tile_matrix *matrix, int blki, int blkj)
+{
+    const int *csr_offset = matrix->csr_offset;
+    return matrix->rowblk_base[blki] + (MAT_PTR_TYPE)((unsigned)csr_offset[blkj] - (unsigned)csr_offset[matrix->tile_ptr[blki]]);
+}
+
+// Blockcsr_Ptr position: every row block above the last one is tile_size rows high
+static inline MAT_PTR_TYPE tile_ptr_start(const Tile_matrix *matrix, int blki, int blkj)
+{
+    const int *csrptr_offset = matrix->csrptr_offset;
+    return (MAT_PTR_TYPE)matrix->tile_ptr[blki] * matrix->tile_size +
+           (MAT_PTR_TYPE)((unsigned)csrptr_offset[blkj] - (unsigned)csrptr_offset[matrix->tile_ptr[blki]]);
+}
+
+// Blockcsr_Val_Packed byte of the tile
+static inline MAT_PTR_TYPE tile_packed_start(const Tile_matrix *matrix, int blki, int blkj)
+{
+    const int *tile_val_offset = matrix->tile_val_offset;
+    return matrix->rowblk_packed_base[blki] + (MAT_PTR_TYPE)((unsigned)tile_val_offset[blkj] - (unsigned)tile_val_offset[matrix->tile_ptr[blki]]);
+}
+
+// exclusive scan of per-tile counts in place, kept modulo 2^32 as above; the 64-bit start of each row block
+// goes to base (tilem + 1 entries) when it is not NULL. Returns the total. Above PAR_PRIM_MIN tiles it is
+// blocked over the threads like exclusive_scan, each thread setting the bases of the row blocks that start
+// in its block of tiles
+MAT_PTR_TYPE tile_offset_scan(int *count, int tilenum, const MAT_PTR_TYPE *tile_ptr, int tilem, MAT_PTR_TYPE *base)
+{
+    int nthreads = tilenum < PAR_PRIM_MIN || omp_in_parallel() ? 1 : omp_get_max_threads();
+    MAT_PTR_TYPE *block_sum = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (nthreads + 1));
+    MAT_PTR_TYPE total = 0;
+#pragma omp parallel num_threads(nthreads) if (nthreads > 1)
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int t0 = (int)((long long)(tilenum + 1) * t / nt);
+        int t1 = (int)((long long)(tilenum + 1) * (t + 1) / nt);
+        MAT_PTR_TYPE sum = 0;
+        for (int i = t0; i < t1 && i < tilenum; i++)
+            sum += count[i];
+        block_sum[t + 1] = sum;
+#pragma omp barrier
+#pragma omp single
+        {
+            block_sum[0] = 0;
+            for (int b = 0; b < nt; b++)
+                block_sum[b + 1] += block_sum[b];
+            total = block_sum[nt];
+        }
+        // first row block starting at or after t0
+        int lo = 0, hi = tilem + 1;
+        while (base && lo < hi)
+        {
+            int mid = (lo + hi) / 2;
+            if (tile_ptr[mid] < t0)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        int blki = lo;
+        sum = block_sum[t];
+        for (int i = t0; i < t1; i++)
+        {
+            while (base && blki <= tilem && tile_ptr[blki] == i)
+                base[blki++] = sum;
+            MAT_PTR_TYPE c = i < tilenum ? count[i] : 0;
+            count[i] = (int)(unsigned)sum;
+            sum += c;
+        }
+    }
+    free(block_sum);
+    return total;
+}
+
 void Tile_destroy(Tile_matrix *matrix)
 {
 
-    free(matrix->tile_ptr);
-    free(matrix->tile_columnidx);
-    free(matrix->tile_nnz);
-    free(matrix->blknnz);
-    free(matrix->blknnznnz);
-    free(matrix->Blockcsr_Val);
-    free(matrix->csr_compressedIdx);
-    free(matrix->Blockcsr_Ptr);
+    // every array Tile_create allocated
+    arena_destroy(&matrix->mem);
     free(matrix->Blockcoo_Val);
     free(matrix->Blockell_Val);
     free(matrix->Blockhyb_Val);
@@ -107,8 +198,6 @@ void Tile_destroy(Tile_matrix *matrix)
     free(matrix->Blockdensecol_Val);
     free(matrix->densecolid);
     free(matrix->dnscolptr);
-    free(matrix->tilewidth);
-    free(matrix->csrptr_offset);
     free(matrix->coo_offset);
     free(matrix->ell_offset);
     free(matrix->hyb_offset);
@@ -122,3 +211,5 @@ void Tile_destroy(Tile_matrix *matrix)
     free(matrix->deferredcoo_colidx);
     free(matrix->deferredcoo_ptr);
 }
+
+#endif
@@ -0,0 +1,116 @@
+#ifndef _MF_SOLVER_H_
+#define _MF_SOLVER_H_
+
+#include "common.h"
+#include "cg_cpu.h"
+#include "cg_pipe_cpu.h"
+#include "bicgstab_cpu.h"
+
+// Setup/solve split of the CPU solvers for callers that solve with one operator many times, such as a
+// time-stepping loop. mf_setup pays the tiling (or the tile cache map), the row-block partition, the
+// preconditioner and format side structures and the solver vectors once; mf_solve then only runs the
+// iteration on them and can be called any number of times. When only the values change, mf_update writes
+// them into the operator in place instead of a new mf_setup. Nothing is written to disk or stdout.
+#define MF_CG 0
+#define MF_CG_PIPE 1
+#define MF_BICGSTAB 2
+
+typedef struct
+{
+    int method;
+    int maxiter;
+    // stop at ||b - Ax|| <= tol ||b||
+    double tol;
+    // start from the x passed to mf_solve instead of zero, e.g. the previous time step
+    int use_x0;
+} mf_opts;
+
+typedef struct
+{
+    cpu_tile_op op;
+    int n;
+    // last mf_solve: iterations, ||r|| / ||b|| of the recurrence and wall time in ms
+    int iterations;
+    double relres;
+    double time_solve;
+    int solves;
+    // the last mf_update could not write the new values, mf_solve refuses the handle
+    int update_failed;
+} mf_handle;
+
+mf_opts mf_opts_default()
+{
+    mf_opts opts;
+    opts.method = MF_CG;
+    opts.maxiter = 1000;
+    opts.tol = 1e-6;
+    opts.use_x0 = 0;
+    return opts;
+}
+
+// n x n CSR operator, n need not be a multiple of the tile size.
+// cache_name, when not NULL, is the matrix file the tile cache is keyed on. The caller keeps ownership of
+// the CSR arrays, they are not referenced after mf_setup returns
+mf_handle *mf_setup(int n, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, MAT_PTR_TYPE nnzR, char *cache_name)
+{
+    mf_handle *h = (mf_handle *)calloc(1, sizeof(mf_handle));
+    cpu_tile_op_create(&h->op, RowPtr, ColIdx, Val, n, n, nnzR, cache_name, TILE_SIZE);
+#if TILE_REFRESH
+    cpu_tile_op_record(&h->op, RowPtr, ColIdx);
+#endif
+    h->n = h->op.rowA;
+    return h;
+}
+
+#if TILE_REFRESH
+// new values on the sparsity pattern given to mf_setup, Val in the same CSR order. Costs two passes over the
+// nonzeros plus the block-Jacobi refactorization, and a new packed stream when some value needs a wider
+// precision class than its tile had. Returns 0 on success, or -1 when setup could not make the cached tiles
+// writable; the operator is then unchanged and the handle has to be set up again
+int mf_update(mf_handle *h, MAT_VAL_TYPE *Val)
+{
+    if (!h->op.tr_recorded)
+    {
+        h->update_failed = 1;
+        return -1;
+    }
+    cpu_tile_op_refresh(&h->op, Val);
+    h->update_failed = 0;
+    return 0;
+}
+#endif
+
+// solve A x = b with the handle's operator, returns the iteration count, or -1 without touching x when the
+// last mf_update failed. x and b hold mf_handle.n entries
+int mf_solve(mf_handle *h, double *b, double *x, mf_opts *opts)
+{
+    if (h->update_failed)
+        return -1;
+    struct timeval t1, t2;
+    double res = 0;
+    double *x0 = opts->use_x0 ? x : NULL;
+    gettimeofday(&t1, NULL);
+    if (opts->method == MF_CG_PIPE)
+        h->iterations = cg_pipe_cpu_iterate(&h->op, b, x, x0, opts->maxiter, opts->tol, &res, NULL);
+    else if (opts->method == MF_BICGSTAB)
+        h->iterations = bicgstab_cpu_iterate(&h->op, b, x, x0, opts->maxiter, opts->tol, &res);
+    else
+        h->iterations = cg_cpu_iterate(&h->op, b, x, x0, opts->maxiter, opts->tol, &res);
+    gettimeofday(&t2, NULL);
+    h->time_solve = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+
+    double bb = 0;
+    for (int i = 0; i < h->n; i++)
+        bb += b[i] * b[i];
+    h->relres = bb > 0 ? sqrt(res / bb) : sqrt(res);
+    h->solves++;
+    return h->iterations;
+}
+
+void mf_destroy(mf_handle *h)
+{
+    cpu_tile_op_destroy(&h->op);
+    free(h);
+}
+
+#endif
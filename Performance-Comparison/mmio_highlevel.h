@@ -10,6 +10,44 @@
 
 #include "common.h"
 
+#include "./biio2.0/src/mmio_parallel.h"
+
+// mmio_parallel_read narrowed to the int row pointers of this header, any output may be NULL
+int mmio_parallel_read_32(int *m, int *n, int *nnz, int *isSymmetric, int *csrRowPtr, int *csrColIdx, MAT_VAL_TYPE *csrVal, MAT_VAL_LOW_TYPE *csrVal_Low, char *filename)
+{
+    int m_tmp, n_tmp, isSymmetric_tmp;
+    int64_t nnz_tmp;
+    int64_t *row_ptr;
+    int *col_idx;
+    double *val;
+    int ret_code = mmio_parallel_read(&m_tmp, &n_tmp, &nnz_tmp, &row_ptr, &col_idx, &val, &isSymmetric_tmp, filename);
+    if (ret_code != 0)
+        return ret_code;
+    if (m != NULL)
+        *m = m_tmp;
+    if (n != NULL)
+        *n = n_tmp;
+    if (nnz != NULL)
+        *nnz = nnz_tmp;
+    if (isSymmetric != NULL)
+        *isSymmetric = isSymmetric_tmp;
+    if (csrRowPtr != NULL)
+        for (int i = 0; i <= m_tmp; i++)
+            csrRowPtr[i] = row_ptr[i];
+    if (csrColIdx != NULL)
+        memcpy(csrColIdx, col_idx, nnz_tmp * sizeof(int));
+    if (csrVal != NULL)
+        for (int64_t i = 0; i < nnz_tmp; i++)
+            csrVal[i] = val[i];
+    if (csrVal_Low != NULL)
+        for (int64_t i = 0; i < nnz_tmp; i++)
+            csrVal_Low[i] = val[i];
+    free(row_ptr);
+    free(col_idx);
+    free(val);
+    return 0;
+}
+
 
 
 // read matrix infomation from mtx file
@@ -17,6 +55,9 @@
 int mmio_info(int *m, int *n, int *nnz, int *isSymmetric, char *filename)
 
 {
+#if MMIO_PARALLEL
+    return mmio_parallel_read_32(m, n, nnz, isSymmetric, NULL, NULL, NULL, NULL, filename);
+#endif
 
     int m_tmp, n_tmp, nnz_tmp;
 
@@ -275,6 +316,9 @@ int mmio_info(int *m, int *n, int *nnz, int *isSymmetric, char *filename)
 int mmio_data(int *csrRowPtr, int *csrColIdx, MAT_VAL_TYPE *csrVal, char *filename)
 
 {
+#if MMIO_PARALLEL
+    return mmio_parallel_read_32(NULL, NULL, NULL, NULL, csrRowPtr, csrColIdx, csrVal, NULL, filename);
+#endif
 
     int m_tmp, n_tmp, nnz_tmp;
 
@@ -594,6 +638,9 @@ int mmio_data(int *csrRowPtr, int *csrColIdx, MAT_VAL_TYPE *csrVal, char *filena
 int mmio_data_Low(int *csrRowPtr, int *csrColIdx, MAT_VAL_LOW_TYPE *csrVal, char *filename)
 
 {
+#if MMIO_PARALLEL
+    return mmio_parallel_read_32(NULL, NULL, NULL, NULL, csrRowPtr, csrColIdx, NULL, csrVal, filename);
+#endif
 
     int m_tmp, n_tmp, nnz_tmp;
 
@@ -0,0 +1,205 @@
+#ifndef _NUMA_PLACE_H_
+#define _NUMA_PLACE_H_
+
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include "common.h"
+#include "encode.h"
+#include "format.h"
+
+// NUMA placement of the CPU path (NUMA_PLACE). Linux puts a page on the node of the thread that first writes
+// it, and the tiles are built and the vectors cleared on one thread, so every page starts on one socket.
+// numa_place_create reads the node layout from sysfs, gives each node a contiguous run of thread ids, and so
+// a contiguous run of the row-block partition, and pins every thread to a CPU of its node. numa_place_tiles
+// and numa_place_vectors then move each thread's share of the arrays the SpMV streams to its node: the whole
+// pages of the share are copied out, dropped and written back by that thread. A page straddling two shares
+// stays where it was. The arrays must be private and writable, a tile cache mapping has to be made
+// writable first.
+#define NUMA_MAX_NODES 64
+// bounce buffer per thread, one huge page so that a dropped range keeps its huge pages
+#define NUMA_BOUNCE_BYTES (2 << 20)
+
+typedef struct
+{
+    int nodes; // nodes with a CPU this process may run on
+    int nthreads;
+    int *thread_node;
+    int *thread_cpu; // -1 when pinning failed
+    int *node_cpus;  // CPUs of each node the process may use
+} numa_place;
+
+// "0-3,8,10-11" -> set
+static int numa_read_cpulist(const char *path, cpu_set_t *set)
+{
+    CPU_ZERO(set);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL)
+        return 0;
+    int lo, hi;
+    char sep;
+    while (fscanf(fp, "%d", &lo) == 1)
+    {
+        hi = lo;
+        sep = fgetc(fp);
+        if (sep == '-')
+        {
+            if (fscanf(fp, "%d", &hi) != 1)
+                break;
+            sep = fgetc(fp);
+        }
+        for (int c = lo; c <= hi && c < CPU_SETSIZE; c++)
+            CPU_SET(c, set);
+        if (sep != ',')
+            break;
+    }
+    fclose(fp);
+    return 1;
+}
+
+// c-th CPU of set, counting round
+static int numa_nth_cpu(const cpu_set_t *set, int c)
+{
+    c %= CPU_COUNT(set);
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+        if (CPU_ISSET(cpu, set) && c-- == 0)
+            return cpu;
+    return -1;
+}
+
+void numa_place_create(numa_place *np, int nthreads)
+{
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(cpu_set_t), &allowed) != 0)
+    {
+        CPU_ZERO(&allowed);
+        for (int c = 0; c < nthreads && c < CPU_SETSIZE; c++)
+            CPU_SET(c, &allowed);
+    }
+    cpu_set_t *node_set = (cpu_set_t *)malloc(sizeof(cpu_set_t) * NUMA_MAX_NODES);
+    np->nodes = 0;
+    for (int n = 0; n < NUMA_MAX_NODES; n++)
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", n);
+        cpu_set_t set;
+        if (!numa_read_cpulist(path, &set))
+            continue;
+        CPU_AND(&set, &set, &allowed);
+        if (CPU_COUNT(&set) > 0)
+            node_set[np->nodes++] = set;
+    }
+    if (np->nodes == 0)
+        node_set[np->nodes++] = allowed;
+
+    np->nthreads = nthreads;
+    np->thread_node = (int *)malloc(sizeof(int) * nthreads);
+    np->thread_cpu = (int *)malloc(sizeof(int) * nthreads);
+    np->node_cpus = (int *)malloc(sizeof(int) * np->nodes);
+    for (int n = 0; n < np->nodes; n++)
+        np->node_cpus[n] = CPU_COUNT(&node_set[n]);
+    for (int t = 0; t < nthreads; t++)
+    {
+        int node = (int)((long long)t * np->nodes / nthreads);
+        int first = (int)(((long long)node * nthreads + np->nodes - 1) / np->nodes);
+        np->thread_node[t] = node;
+        np->thread_cpu[t] = numa_nth_cpu(&node_set[node], t - first);
+    }
+    free(node_set);
+
+#pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        cpu_set_t one;
+        CPU_ZERO(&one);
+        if (np->thread_cpu[t] >= 0)
+            CPU_SET(np->thread_cpu[t], &one);
+        if (np->thread_cpu[t] < 0 || sched_setaffinity(0, sizeof(cpu_set_t), &one) != 0)
+            np->thread_cpu[t] = -1;
+    }
+}
+
+void numa_place_destroy(numa_place *np)
+{
+    free(np->thread_node);
+    free(np->thread_cpu);
+    free(np->node_cpus);
+}
+
+// move bytes lo..hi-1 of the array at base to the calling thread's node
+static void numa_place_touch(void *base, size_t lo, size_t hi, unsigned char *bounce)
+{
+    if (base == NULL || hi <= lo)
+        return;
+    size_t page = sysconf(_SC_PAGESIZE);
+    uintptr_t start = ((uintptr_t)base + lo + page - 1) / page * page;
+    uintptr_t stop = ((uintptr_t)base + hi) / page * page;
+    for (uintptr_t p = start; p < stop; p += NUMA_BOUNCE_BYTES)
+    {
+        size_t len = stop - p < NUMA_BOUNCE_BYTES ? stop - p : NUMA_BOUNCE_BYTES;
+        memcpy(bounce, (void *)p, len);
+        if (madvise((void *)p, len, MADV_DONTNEED) == 0)
+            memcpy((void *)p, bounce, len);
+    }
+}
+
+static MAT_PTR_TYPE numa_idx_bytes(int tile_size, MAT_PTR_TYPE len)
+{
+    return tile_size == 8 ? tile_idx_bytes<8>(len) : (tile_size == 32 ? tile_idx_bytes<32>(len) : tile_idx_bytes<16>(len));
+}
+
+// the tile arrays of row blocks rowblk_start[t]..rowblk_start[t+1]-1 to the node of thread t: the values,
+// packed or not, the compressed column indices, the row pointers, tile_columnidx and the deferred CSR rows
+void numa_place_tiles(numa_place *np, Tile_matrix *matrix, int rowA, const int *rowblk_start)
+{
+    int ts = matrix->tile_size;
+    int tilem = matrix->tilem;
+    size_t ptr_bytes = ts == 32 ? sizeof(tile_traits<32>::ptr_type) : sizeof(tile_traits<16>::ptr_type);
+#pragma omp parallel num_threads(np->nthreads)
+    {
+        int t = omp_get_thread_num();
+        int last = t == np->nthreads - 1;
+        int b0 = rowblk_start[t];
+        int b1 = last ? tilem : rowblk_start[t + 1];
+        unsigned char *bounce = (unsigned char *)malloc(NUMA_BOUNCE_BYTES);
+        MAT_PTR_TYPE v0 = matrix->rowblk_base[b0], v1 = matrix->rowblk_base[b1];
+        numa_place_touch(matrix->Blockcsr_Val, v0 * sizeof(MAT_VAL_TYPE), v1 * sizeof(MAT_VAL_TYPE), bounce);
+        numa_place_touch(matrix->Blockcsr_Val_Low, v0 * sizeof(MAT_VAL_LOW_TYPE), v1 * sizeof(MAT_VAL_LOW_TYPE), bounce);
+        if (matrix->Blockcsr_Val_Packed)
+            numa_place_touch(matrix->Blockcsr_Val_Packed, matrix->rowblk_packed_base[b0], matrix->rowblk_packed_base[b1], bounce);
+        // the last share keeps the 16 spare bytes of csr_compressedIdx
+        numa_place_touch(matrix->csr_compressedIdx, numa_idx_bytes(ts, v0), numa_idx_bytes(ts, v1) + (last ? 16 : 0), bounce);
+        MAT_PTR_TYPE p1 = (MAT_PTR_TYPE)matrix->tile_ptr[b1] * ts;
+        p1 = p1 < matrix->csrptrlen ? p1 : matrix->csrptrlen;
+        numa_place_touch(matrix->Blockcsr_Ptr, (MAT_PTR_TYPE)matrix->tile_ptr[b0] * ts * ptr_bytes, p1 * ptr_bytes, bounce);
+        numa_place_touch(matrix->tile_columnidx, matrix->tile_ptr[b0] * sizeof(int), matrix->tile_ptr[b1] * sizeof(int), bounce);
+        if (matrix->coototal)
+        {
+            int r0 = b0 * ts < rowA ? b0 * ts : rowA;
+            int r1 = b1 * ts < rowA ? b1 * ts : rowA;
+            MAT_PTR_TYPE d0 = matrix->deferredcoo_ptr[r0], d1 = matrix->deferredcoo_ptr[r1];
+            numa_place_touch(matrix->deferredcoo_val, d0 * sizeof(MAT_VAL_TYPE), d1 * sizeof(MAT_VAL_TYPE), bounce);
+            numa_place_touch(matrix->deferredcoo_colidx, d0 * sizeof(int), d1 * sizeof(int), bounce);
+        }
+        free(bounce);
+    }
+}
+
+// rows of nvec vectors of vec_len entries, split like the row blocks; the last share takes the padding
+void numa_place_vectors(numa_place *np, double **vec, int nvec, int vec_len, int tile_size, const int *rowblk_start)
+{
+#pragma omp parallel num_threads(np->nthreads)
+    {
+        int t = omp_get_thread_num();
+        size_t r0 = (size_t)rowblk_start[t] * tile_size;
+        size_t r1 = t == np->nthreads - 1 ? vec_len : (size_t)rowblk_start[t + 1] * tile_size;
+        r0 = r0 < (size_t)vec_len ? r0 : vec_len;
+        r1 = r1 < (size_t)vec_len ? r1 : vec_len;
+        unsigned char *bounce = (unsigned char *)malloc(NUMA_BOUNCE_BYTES);
+        for (int v = 0; v < nvec; v++)
+            numa_place_touch(vec[v], r0 * sizeof(double), r1 * sizeof(double), bounce);
+        free(bounce);
+    }
+}
+
+#endif
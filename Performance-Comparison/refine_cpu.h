@@ -0,0 +1,465 @@
+#ifndef _REFINE_CPU_H_
+#define _REFINE_CPU_H_
+
+#include "common.h"
+#include "cg_cpu.h"
+#include "bicgstab_cpu.h"
+
+// Mixed-precision iterative refinement on the tile format. The outer loop keeps x and r = b - Ax in double
+// and computes r on the fp64 tiles of op. Each outer step solves A d = r / ||r|| with a CG or BiCGSTAB that
+// runs entirely in MAT_VAL_LOW_TYPE: tile values, deferred values and vectors, dot products summed in
+// double (the block-Jacobi inverses of the inner CG stay in BJ_VAL_TYPE). So the inner SpMV streams half
+// the value bytes of the fp64 one and the vectors half as many.
+// The inner solver restarts from d = 0 every outer step and stops at REFINE_INNER_TOL or
+// REFINE_INNER_MAXITER. An outer step that does not cut ||r|| by REFINE_STALL means the fp32 operator
+// cannot get closer, the rest of the solve then runs in fp64 from the current x.
+#define REFINE_CG 0
+#define REFINE_BICGSTAB 1
+#define REFINE_VECS 7
+
+typedef struct
+{
+    // tile values and deferred values in low precision, Blockcsr_Val_Low itself when the matrix keeps it
+    MAT_VAL_LOW_TYPE *val;
+    MAT_VAL_LOW_TYPE *deferred_val;
+    int own_val;
+    MAT_VAL_LOW_TYPE *vec[REFINE_VECS];
+    int vec_len;
+} refine_cpu;
+
+void refine_cpu_create(refine_cpu *rf, cpu_tile_op *op)
+{
+    Tile_matrix *matrix = op->matrix;
+    MAT_PTR_TYPE csrsize = matrix->csrsize;
+    rf->own_val = matrix->Blockcsr_Val_Low == NULL;
+    if (rf->own_val)
+    {
+        rf->val = (MAT_VAL_LOW_TYPE *)malloc(sizeof(MAT_VAL_LOW_TYPE) * (csrsize + 1));
+#pragma omp parallel for schedule(dynamic, 16)
+        for (int blki = 0; blki < matrix->tilem; blki++)
+        {
+            for (int tile = matrix->tile_ptr[blki]; tile < matrix->tile_ptr[blki + 1]; tile++)
+            {
+                int prec = matrix->Blockcsr_Val_Packed ? matrix->tile_prec[tile] : PREC_FP64;
+                MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, tile);
+                const unsigned char *tile_vals = matrix->Blockcsr_Val_Packed ? matrix->Blockcsr_Val_Packed + tile_packed_start(matrix, blki, tile)
+                                                                             : (const unsigned char *)(matrix->Blockcsr_Val + csroffset);
+                for (int i = 0; i < tile_span(matrix->csr_offset, tile); i++)
+                    rf->val[csroffset + i] = packed_val(prec, tile_vals, i);
+            }
+        }
+    }
+    else
+        rf->val = matrix->Blockcsr_Val_Low;
+    rf->deferred_val = (MAT_VAL_LOW_TYPE *)malloc(sizeof(MAT_VAL_LOW_TYPE) * (matrix->coototal + 1));
+    for (MAT_PTR_TYPE i = 0; i < matrix->coototal; i++)
+        rf->deferred_val[i] = matrix->deferredcoo_val[i];
+    rf->vec_len = op->vec_len;
+    for (int v = 0; v < REFINE_VECS; v++)
+    {
+        rf->vec[v] = (MAT_VAL_LOW_TYPE *)malloc(sizeof(MAT_VAL_LOW_TYPE) * rf->vec_len);
+        memset(rf->vec[v], 0, sizeof(MAT_VAL_LOW_TYPE) * rf->vec_len);
+    }
+}
+
+void refine_cpu_destroy(refine_cpu *rf)
+{
+    if (rf->own_val)
+        free(rf->val);
+    free(rf->deferred_val);
+    for (int v = 0; v < REFINE_VECS; v++)
+        free(rf->vec[v]);
+}
+
+// blockspmv_cpu_rowblk on the low-precision values and vectors, the products summed in low precision and w.y in double
+template <int TS>
+double refine_spmv_rowblk(Tile_matrix *matrix, const MAT_VAL_LOW_TYPE *val, int blki, int rowA,
+                          const MAT_VAL_LOW_TYPE *x, MAT_VAL_LOW_TYPE *y, const MAT_VAL_LOW_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    int *blknnz = matrix->blknnz;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+    MAT_VAL_LOW_TYPE sum[TS];
+    for (int ri = 0; ri < TS; ri++)
+        sum[ri] = 0;
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        const MAT_VAL_LOW_TYPE *x_win = x + tile_columnidx[blkj] * TS;
+        MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+        MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+        const MAT_VAL_LOW_TYPE *tile_vals = val + csroffset;
+        for (int ri = 0; ri < rowlength; ri++)
+        {
+            int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+            for (int rj = Blockcsr_Ptr[csrcount + ri]; rj < stop; rj++)
+                sum[ri] += x_win[tile_idx_get<TS>(csr_compressedIdx, csroffset + rj)] * tile_vals[rj];
+        }
+    }
+
+    double dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        y[blki * TS + ri] = sum[ri];
+        dot += (double)w[blki * TS + ri] * sum[ri];
+    }
+    return dot;
+}
+
+// y = Ax on row blocks blk_start..blk_stop-1 in low precision, deferred entries included; returns w.y
+static inline double refine_spmv(refine_cpu *rf, cpu_tile_op *op, int blk_start, int blk_stop,
+                                 const MAT_VAL_LOW_TYPE *x, MAT_VAL_LOW_TYPE *y, const MAT_VAL_LOW_TYPE *w)
+{
+    Tile_matrix *matrix = op->matrix;
+    double dot = 0;
+    for (int blki = blk_start; blki < blk_stop; blki++)
+    {
+        if (op->tile_size == 8)
+            dot += refine_spmv_rowblk<8>(matrix, rf->val, blki, op->rowA, x, y, w);
+        else if (op->tile_size == 32)
+            dot += refine_spmv_rowblk<32>(matrix, rf->val, blki, op->rowA, x, y, w);
+        else
+            dot += refine_spmv_rowblk<16>(matrix, rf->val, blki, op->rowA, x, y, w);
+    }
+    if (!matrix->coototal)
+        return dot;
+    int row_stop = blk_stop * op->tile_size < op->rowA ? blk_stop * op->tile_size : op->rowA;
+    for (int i = blk_start * op->tile_size; i < row_stop; i++)
+    {
+        MAT_VAL_LOW_TYPE sum = 0;
+        for (MAT_PTR_TYPE j = matrix->deferredcoo_ptr[i]; j < matrix->deferredcoo_ptr[i + 1]; j++)
+            sum += rf->deferred_val[j] * x[matrix->deferredcoo_colidx[j]];
+        y[i] += sum;
+        dot += (double)w[i] * sum;
+    }
+    return dot;
+}
+
+// low-precision CG on A d = r, preconditioned like cg_cpu_iterate; d in vec[0] and r in vec[1] on entry, until
+// ||r|| <= tol ||r_0|| or maxiter
+int refine_cg_inner(refine_cpu *rf, cpu_tile_op *op, int maxiter, double tol)
+{
+    int rowA = op->rowA;
+    int tile_size = op->tile_size;
+    int tilem = op->tilem;
+    int nthreads = op->nthreads;
+    int *rowblk_start = op->rowblk_start;
+    MAT_VAL_LOW_TYPE *k_d = rf->vec[0];
+    MAT_VAL_LOW_TYPE *k_r = rf->vec[1];
+    MAT_VAL_LOW_TYPE *k_p = rf->vec[2];
+    MAT_VAL_LOW_TYPE *k_q = rf->vec[3];
+    MAT_VAL_LOW_TYPE *k_z = rf->vec[4];
+    double *dot_partial = op->partial[0];
+    double *snew_partial = op->partial[1];
+
+    double snew = 0;
+    for (int i = 0; i < rowA; i++)
+        snew += (double)k_r[i] * k_r[i];
+    double threshold = tol * tol * snew;
+#if CG_BLOCK_JACOBI
+    double rz = 0;
+    for (int blki = 0; blki < tilem; blki++)
+        rz += block_jacobi_apply(&op->bj, blki, blki == tilem - 1 ? rowA - (tilem - 1) * tile_size : tile_size, k_r, k_z);
+    memcpy(k_p, k_z, sizeof(MAT_VAL_LOW_TYPE) * rowA);
+#else
+    memcpy(k_p, k_r, sizeof(MAT_VAL_LOW_TYPE) * rowA);
+#endif
+
+    cpu_signal signal_dot = {0, 0};
+    cpu_signal signal_final = {0, 0};
+    int iterations = 0;
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = rowblk_start[tid];
+        int blk_stop = rowblk_start[tid + 1];
+        int row_start = blk_start * tile_size;
+        int row_stop = blk_stop * tile_size < rowA ? blk_stop * tile_size : rowA;
+        double snew_local = snew;
+#if CG_BLOCK_JACOBI
+        double rz_local = rz;
+#endif
+        int iter_local = 0;
+
+        while (iter_local < maxiter && snew_local > threshold)
+        {
+            // q = Ap, p.q
+            dot_partial[tid * PARTIAL_STRIDE] = refine_spmv(rf, op, blk_start, blk_stop, k_p, k_q, k_p);
+            cpu_signal_wait(&signal_dot, nthreads);
+#if CG_BLOCK_JACOBI
+            // alpha = r.z / p.q, d += alpha p, r -= alpha q, z = M^(-1)r per row block
+            MAT_VAL_LOW_TYPE alpha = rz_local / cpu_partial_sum(dot_partial, nthreads);
+            double rr = 0, rz_part = 0;
+            for (int blki = blk_start; blki < blk_stop; blki++)
+            {
+                int blk_row_stop = (blki + 1) * tile_size < rowA ? (blki + 1) * tile_size : rowA;
+                for (int i = blki * tile_size; i < blk_row_stop; i++)
+                {
+                    k_d[i] += alpha * k_p[i];
+                    k_r[i] -= alpha * k_q[i];
+                    rr += (double)k_r[i] * k_r[i];
+                }
+                rz_part += block_jacobi_apply(&op->bj, blki, blk_row_stop - blki * tile_size, k_r, k_z);
+            }
+            snew_partial[tid * PARTIAL_STRIDE] = rr;
+            snew_partial[tid * PARTIAL_STRIDE + 1] = rz_part;
+            cpu_signal_wait(&signal_dot, nthreads);
+            // beta = r.z / r.z_old, p = z + beta p
+            snew_local = cpu_partial_sum(snew_partial, nthreads);
+            double rz_old = rz_local;
+            rz_local = cpu_partial_sum(snew_partial + 1, nthreads);
+            MAT_VAL_LOW_TYPE beta = rz_local / rz_old;
+            for (int i = row_start; i < row_stop; i++)
+                k_p[i] = k_z[i] + beta * k_p[i];
+#else
+            // alpha = snew / p.q, d += alpha p, r -= alpha q
+            MAT_VAL_LOW_TYPE alpha = snew_local / cpu_partial_sum(dot_partial, nthreads);
+            double rr = 0;
+            for (int i = row_start; i < row_stop; i++)
+            {
+                k_d[i] += alpha * k_p[i];
+                k_r[i] -= alpha * k_q[i];
+                rr += (double)k_r[i] * k_r[i];
+            }
+            snew_partial[tid * PARTIAL_STRIDE] = rr;
+            cpu_signal_wait(&signal_dot, nthreads);
+            // beta = snew / sold, p = r + beta p
+            double sold = snew_local;
+            snew_local = cpu_partial_sum(snew_partial, nthreads);
+            MAT_VAL_LOW_TYPE beta = snew_local / sold;
+            for (int i = row_start; i < row_stop; i++)
+                k_p[i] = k_r[i] + beta * k_p[i];
+#endif
+            cpu_signal_wait(&signal_final, nthreads);
+            iter_local++;
+        }
+        if (tid == 0)
+            iterations = iter_local;
+    }
+    return iterations;
+}
+
+// low-precision BiCGSTAB on A d = r, laid out like bicgstab_cpu_iterate; d in vec[0] and r in vec[1] on entry
+int refine_bicgstab_inner(refine_cpu *rf, cpu_tile_op *op, int maxiter, double tol)
+{
+    int rowA = op->rowA;
+    int tile_size = op->tile_size;
+    int nthreads = op->nthreads;
+    int *rowblk_start = op->rowblk_start;
+    MAT_VAL_LOW_TYPE *k_d = rf->vec[0];
+    MAT_VAL_LOW_TYPE *k_rg = rf->vec[1];
+    MAT_VAL_LOW_TYPE *k_rh = rf->vec[2];
+    MAT_VAL_LOW_TYPE *k_pg = rf->vec[3];
+    MAT_VAL_LOW_TYPE *k_sg = rf->vec[4];
+    MAT_VAL_LOW_TYPE *k_vg = rf->vec[5];
+    MAT_VAL_LOW_TYPE *k_tg = rf->vec[6];
+    double *dot_partial = op->partial[0];
+
+    double s0 = 0;
+    for (int i = 0; i < rowA; i++)
+    {
+        k_rh[i] = k_rg[i];
+        k_pg[i] = k_rg[i];
+        s0 += (double)k_rg[i] * k_rg[i];
+    }
+    double threshold = tol * tol * s0;
+
+    cpu_signal signal_dot = {0, 0};
+    cpu_signal signal_final = {0, 0};
+    int iterations = 0;
+#pragma omp parallel num_threads(nthreads)
+    {
+        int tid = omp_get_thread_num();
+        int blk_start = rowblk_start[tid];
+        int blk_stop = rowblk_start[tid + 1];
+        int row_start = blk_start * tile_size;
+        int row_stop = blk_stop * tile_size < rowA ? blk_stop * tile_size : rowA;
+        double *partial = dot_partial + tid * PARTIAL_STRIDE;
+        double r1 = s0;
+        double residual_local = s0;
+        int iter_local = 0;
+
+        while (iter_local < maxiter && residual_local > threshold)
+        {
+            // v = Ap, rh.v
+            partial[0] = refine_spmv(rf, op, blk_start, blk_stop, k_pg, k_vg, k_rh);
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // alpha = r1 / rh.v, s = r - alpha v
+            double alpha = r1 / cpu_partial_sum(dot_partial, nthreads);
+            for (int i = row_start; i < row_stop; i++)
+                k_sg[i] = k_rg[i] - (MAT_VAL_LOW_TYPE)alpha * k_vg[i];
+            cpu_signal_wait(&signal_final, nthreads);
+
+            // t = As, t.s and t.t
+            double ts = refine_spmv(rf, op, blk_start, blk_stop, k_sg, k_tg, k_sg);
+            double tt = 0;
+            for (int i = row_start; i < row_stop; i++)
+                tt += (double)k_tg[i] * k_tg[i];
+            partial[1] = ts;
+            partial[2] = tt;
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // omega = t.s / t.t, d += alpha p + omega s, r = s - omega t, rh.r and r.r
+            ts = cpu_partial_sum(dot_partial + 1, nthreads);
+            tt = cpu_partial_sum(dot_partial + 2, nthreads);
+            double omega = tt > 0 ? ts / tt : 0;
+            double rr = 0, rhr = 0;
+            for (int i = row_start; i < row_stop; i++)
+            {
+                k_d[i] += (MAT_VAL_LOW_TYPE)alpha * k_pg[i] + (MAT_VAL_LOW_TYPE)omega * k_sg[i];
+                k_rg[i] = k_sg[i] - (MAT_VAL_LOW_TYPE)omega * k_tg[i];
+                rhr += (double)k_rh[i] * k_rg[i];
+                rr += (double)k_rg[i] * k_rg[i];
+            }
+            partial[3] = rhr;
+            partial[4] = rr;
+            cpu_signal_wait(&signal_dot, nthreads);
+
+            // beta = (r1_new / r1)(alpha / omega), p = r + beta (p - omega v)
+            double r1_new = cpu_partial_sum(dot_partial + 3, nthreads);
+            residual_local = cpu_partial_sum(dot_partial + 4, nthreads);
+            iter_local++;
+            if (omega == 0)
+                break;
+            double beta = (r1_new / r1) * (alpha / omega);
+            r1 = r1_new;
+            for (int i = row_start; i < row_stop; i++)
+                k_pg[i] = k_rg[i] + (MAT_VAL_LOW_TYPE)beta * (k_pg[i] - (MAT_VAL_LOW_TYPE)omega * k_vg[i]);
+            cpu_signal_wait(&signal_final, nthreads);
+        }
+        if (tid == 0)
+            iterations = iter_local;
+    }
+    return iterations;
+}
+
+// refinement from x = 0 until ||b - Ax|| <= tol ||b|| or maxouter outer steps, a fp64 finish after a stall
+// gets at most fp64_maxiter iterations. x gets the solution, *res the final r.r, *inner the low-precision
+// iterations and *fp64 those of the fp64 finish. Returns the outer steps taken
+int refine_cpu_iterate(cpu_tile_op *op, refine_cpu *rf, int method, double *b, double *x, int maxouter, double tol,
+                       double inner_tol, int inner_maxiter, int fp64_maxiter, double *res, int *inner, int *fp64)
+{
+    int rowA = op->rowA;
+    double *k_x = op->vec[0];
+    double *k_r = op->vec[1];
+    double threshold = tol * tol * cpu_tile_op_start(op, 2, NULL, b);
+    double rr = 0;
+    for (int i = 0; i < rowA; i++)
+        rr += k_r[i] * k_r[i];
+    *inner = 0;
+    *fp64 = 0;
+
+    int outer = 0;
+    while (outer < maxouter && rr > threshold)
+    {
+        // d = 0 and r / ||r|| in low precision, so the inner solve sees a unit right-hand side at every step
+        double rnorm = sqrt(rr);
+        memset(rf->vec[0], 0, sizeof(MAT_VAL_LOW_TYPE) * rf->vec_len);
+#pragma omp parallel for num_threads(op->nthreads)
+        for (int i = 0; i < rowA; i++)
+            rf->vec[1][i] = k_r[i] / rnorm;
+        *inner += method == REFINE_BICGSTAB ? refine_bicgstab_inner(rf, op, inner_maxiter, inner_tol)
+                                            : refine_cg_inner(rf, op, inner_maxiter, inner_tol);
+
+        // x += ||r|| d and r = b - Ax in fp64
+#pragma omp parallel for num_threads(op->nthreads)
+        for (int i = 0; i < rowA; i++)
+            k_x[i] += rnorm * rf->vec[0][i];
+        cpu_tile_op_residual(op, k_x, b, k_r);
+        double rr_new = 0;
+        for (int i = 0; i < rowA; i++)
+            rr_new += k_r[i] * k_r[i];
+        outer++;
+        if (rr_new > REFINE_STALL * REFINE_STALL * rr && rr_new > threshold)
+        {
+            // the fp32 operator has hit its accuracy floor, finish in fp64 from here
+            memcpy(x, k_x, sizeof(double) * rowA);
+            *fp64 = method == REFINE_BICGSTAB ? bicgstab_cpu_iterate(op, b, x, x, fp64_maxiter, tol, res)
+                                              : cg_cpu_iterate(op, b, x, x, fp64_maxiter, tol, res);
+            return outer;
+        }
+        rr = rr_new;
+    }
+    memcpy(x, k_x, sizeof(double) * rowA);
+    *res = rr;
+    return outer;
+}
+
+// iterative refinement against the plain fp64 solver on the same tiles: both solve from x = 0, the report
+// and refine_cpu.csv give their iterations, times, ||b - Ax|| / ||b|| on the CSR input and the distance of
+// the refined x from the fp64 one. x gets the refined solution
+void refine_solve_cpu(int method, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val, double *x, double *b, int n, int *iter, int maxiter, double threshold, char *filename, MAT_PTR_TYPE nnzR, int ori, int tile_size)
+{
+    struct timeval t1, t2;
+    cpu_tile_op op;
+    cpu_tile_op_create(&op, RowPtr, ColIdx, Val, n, ori, nnzR, filename, tile_size);
+    int rowA = op.rowA;
+    gettimeofday(&t1, NULL);
+    refine_cpu rf;
+    refine_cpu_create(&rf, &op);
+    gettimeofday(&t2, NULL);
+    double time_format = op.time_setup + (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    char extra[96];
+    sprintf(extra, " refine=%s inner_tol=%.1e inner_maxiter=%d", method == REFINE_BICGSTAB ? "bicgstab" : "cg", (double)REFINE_INNER_TOL, REFINE_INNER_MAXITER);
+    cpu_tile_op_print(&op, extra);
+
+    // the fp64 reference
+    double *x64 = (double *)malloc(sizeof(double) * rowA);
+    double res64 = 0;
+    gettimeofday(&t1, NULL);
+    int iter64 = method == REFINE_BICGSTAB ? bicgstab_cpu_iterate(&op, b, x64, NULL, maxiter, threshold, &res64)
+                                           : cg_cpu_iterate(&op, b, x64, NULL, maxiter, threshold, &res64);
+    gettimeofday(&t2, NULL);
+    double time_fp64 = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+
+    double res = 0;
+    int inner = 0, fp64 = 0;
+    gettimeofday(&t1, NULL);
+    int outer = refine_cpu_iterate(&op, &rf, method, b, x, REFINE_MAXOUTER, threshold, REFINE_INNER_TOL, REFINE_INNER_MAXITER, maxiter, &res, &inner, &fp64);
+    gettimeofday(&t2, NULL);
+    double time_refine = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    *iter = inner + fp64;
+
+    double l2_norm64 = cpu_csr_relres(RowPtr, ColIdx, Val, rowA, x64, b);
+    double l2_norm = cpu_csr_relres(RowPtr, ColIdx, Val, rowA, x, b);
+    double dx = 0, xx = 0;
+    for (int i = 0; i < rowA; i++)
+    {
+        dx += (x[i] - x64[i]) * (x[i] - x64[i]);
+        xx += x64[i] * x64[i];
+    }
+    double x_diff = xx > 0 ? sqrt(dx / xx) : sqrt(dx);
+    printf("fp64: iter=%d,time=%lf ms,l2_norm=%e\n", iter64, time_fp64, l2_norm64);
+    printf("refine: outer=%d,inner=%d,fp64_finish=%d,time=%lf ms,l2_norm=%e,x_diff=%e,speedup=%.2f,time_format=%lf ms\n",
+           outer, inner, fp64, time_refine, l2_norm, x_diff, time_refine > 0 ? time_fp64 / time_refine : 0, time_format);
+    printf("%e\n", sqrt(res));
+    printf("%e\n", l2_norm);
+
+    char *s = (char *)malloc(sizeof(char) * 384);
+    sprintf(s, "method=%s,outer=%d,inner=%d,fp64_finish=%d,time_refine=%.3f,l2_norm=%e,iter_fp64=%d,time_fp64=%.3f,l2_norm_fp64=%e,x_diff=%e,nnzR=%lld,time_format=%lf,nthreads=%d,tile_size=%d,inner_tol=%.1e\n",
+            method == REFINE_BICGSTAB ? "bicgstab" : "cg", outer, inner, fp64, time_refine, l2_norm, iter64, time_fp64, l2_norm64, x_diff, (long long)nnzR, time_format, op.nthreads, op.tile_size, (double)REFINE_INNER_TOL);
+    FILE *file1 = fopen("refine_cpu.csv", "a");
+    if (file1 == NULL)
+    {
+        printf("open error!\n");
+    }
+    else
+    {
+        fwrite(filename, strlen(filename), 1, file1);
+        fwrite(",", strlen(","), 1, file1);
+        fwrite(s, strlen(s), 1, file1);
+        fclose(file1);
+    }
+    free(s);
+    free(x64);
+    refine_cpu_destroy(&rf);
+    cpu_tile_op_destroy(&op);
+}
+
+#endif
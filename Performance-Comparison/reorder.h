@@ -0,0 +1,357 @@
+#ifndef _REORDER_H_
+#define _REORDER_H_
+
+#include "common.h"
+#include "utils.h"
+#include "tile_size.h"
+
+#define REORDER_NONE 0
+#define REORDER_RCM 1
+#define REORDER_TILE 2
+
+// Symmetric permutation P A P^T of the leading n x n block of a CSR matrix, applied before Tile_create.
+// perm[i] is the original index of new row i; rows and columns from n on keep their place. Both orderings
+// work on the pattern of A + A^T restricted to that block.
+typedef struct
+{
+    int n;
+    int method;
+    int *perm;
+    int *iperm;
+} reorder;
+
+// adjacency of A + A^T on rows and columns below n, without the diagonal
+void reorder_graph(int n, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_PTR_TYPE **adj_ptr, int **adj)
+{
+    MAT_PTR_TYPE *deg = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (n + 1));
+    memset(deg, 0, sizeof(MAT_PTR_TYPE) * (n + 1));
+    for (int i = 0; i < n; i++)
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            if (ColIdx[j] < n && ColIdx[j] != i)
+            {
+                deg[i]++;
+                deg[ColIdx[j]]++;
+            }
+    exclusive_scan(deg, n + 1);
+    MAT_PTR_TYPE *ptr = deg;
+    int *list = (int *)malloc(sizeof(int) * (ptr[n] > 0 ? ptr[n] : 1));
+    MAT_PTR_TYPE *fill = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * n);
+    memcpy(fill, ptr, sizeof(MAT_PTR_TYPE) * n);
+    for (int i = 0; i < n; i++)
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            if (ColIdx[j] < n && ColIdx[j] != i)
+            {
+                list[fill[i]++] = ColIdx[j];
+                list[fill[ColIdx[j]]++] = i;
+            }
+    free(fill);
+
+    // drop the duplicates a symmetric input leaves behind
+    MAT_PTR_TYPE out = 0;
+    int *mark = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+        mark[i] = -1;
+    for (int i = 0; i < n; i++)
+    {
+        MAT_PTR_TYPE start = ptr[i];
+        ptr[i] = out;
+        for (MAT_PTR_TYPE j = start; j < ptr[i + 1]; j++)
+            if (mark[list[j]] != i)
+            {
+                mark[list[j]] = i;
+                list[out++] = list[j];
+            }
+    }
+    ptr[n] = out;
+    free(mark);
+    *adj_ptr = ptr;
+    *adj = list;
+}
+
+// reverse Cuthill-McKee, each component starts from a minimum-degree vertex and neighbors enter by degree
+void reorder_rcm(int n, MAT_PTR_TYPE *adj_ptr, int *adj, int *perm)
+{
+    char *visited = (char *)malloc(sizeof(char) * n);
+    memset(visited, 0, sizeof(char) * n);
+    // vertices by ascending degree, a counting sort keeps equal degrees in index order
+    int *degree = (int *)malloc(sizeof(int) * n);
+    int max_degree = 0;
+    for (int i = 0; i < n; i++)
+    {
+        degree[i] = adj_ptr[i + 1] - adj_ptr[i];
+        max_degree = degree[i] > max_degree ? degree[i] : max_degree;
+    }
+    int *bucket = (int *)malloc(sizeof(int) * (max_degree + 2));
+    memset(bucket, 0, sizeof(int) * (max_degree + 2));
+    for (int i = 0; i < n; i++)
+        bucket[degree[i]]++;
+    exclusive_scan(bucket, max_degree + 2);
+    int *by_degree = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+        by_degree[bucket[degree[i]]++] = i;
+    free(bucket);
+
+    int head = 0, tail = 0;
+    for (int s = 0; s < n; s++)
+    {
+        int seed = by_degree[s];
+        if (visited[seed])
+            continue;
+        visited[seed] = 1;
+        perm[tail++] = seed;
+        while (head < tail)
+        {
+            int v = perm[head++];
+            int first = tail;
+            for (MAT_PTR_TYPE j = adj_ptr[v]; j < adj_ptr[v + 1]; j++)
+                if (!visited[adj[j]])
+                {
+                    visited[adj[j]] = 1;
+                    perm[tail++] = adj[j];
+                }
+            // insertion sort of the new level by degree, the lists are short
+            for (int a = first + 1; a < tail; a++)
+            {
+                int u = perm[a];
+                int b = a - 1;
+                while (b >= first && degree[perm[b]] > degree[u])
+                {
+                    perm[b + 1] = perm[b];
+                    b--;
+                }
+                perm[b + 1] = u;
+            }
+        }
+    }
+    for (int i = 0; i < n / 2; i++)
+    {
+        int t = perm[i];
+        perm[i] = perm[n - 1 - i];
+        perm[n - 1 - i] = t;
+    }
+    free(visited);
+    free(by_degree);
+    free(degree);
+}
+
+// Greedy tile filling on top of RCM: a tile of tile_size rows starts from the first unplaced row in RCM
+// order and then takes, one at a time, the unplaced row with the most edges into the rows it already
+// holds (ties to the earlier RCM position), so tightly coupled rows share a diagonal tile and their
+// neighbors land in few column blocks.
+void reorder_tile_greedy(int n, MAT_PTR_TYPE *adj_ptr, int *adj, int tile_size, int *perm)
+{
+    int *rcm = (int *)malloc(sizeof(int) * n);
+    reorder_rcm(n, adj_ptr, adj, rcm);
+    int *rcm_pos = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+        rcm_pos[rcm[i]] = i;
+    char *placed = (char *)malloc(sizeof(char) * n);
+    memset(placed, 0, sizeof(char) * n);
+    int *score = (int *)malloc(sizeof(int) * n);
+    memset(score, 0, sizeof(int) * n);
+    int *cand = (int *)malloc(sizeof(int) * (adj_ptr[n] + 1));
+
+    int out = 0, next = 0;
+    while (out < n)
+    {
+        while (placed[rcm[next]])
+            next++;
+        int ncand = 0;
+        int v = rcm[next];
+        for (int k = 0; k < tile_size && out < n; k++)
+        {
+            placed[v] = 1;
+            perm[out++] = v;
+            for (MAT_PTR_TYPE j = adj_ptr[v]; j < adj_ptr[v + 1]; j++)
+            {
+                int u = adj[j];
+                if (placed[u])
+                    continue;
+                if (score[u] == 0)
+                    cand[ncand++] = u;
+                score[u]++;
+            }
+            // best candidate, or the next row in RCM order when the tile has no unplaced neighbor left
+            int best = -1;
+            for (int c = 0; c < ncand; c++)
+            {
+                int u = cand[c];
+                if (placed[u])
+                    continue;
+                if (best < 0 || score[u] > score[best] || (score[u] == score[best] && rcm_pos[u] < rcm_pos[best]))
+                    best = u;
+            }
+            if (best < 0)
+            {
+                while (next < n && placed[rcm[next]])
+                    next++;
+                if (next == n)
+                    break;
+                best = rcm[next];
+            }
+            v = best;
+        }
+        for (int c = 0; c < ncand; c++)
+            score[cand[c]] = 0;
+    }
+    free(rcm);
+    free(rcm_pos);
+    free(placed);
+    free(score);
+    free(cand);
+}
+
+// number of nonempty tile_size x tile_size tiles of the leading n x n block
+long long reorder_tile_count(int n, MAT_PTR_TYPE *RowPtr, int *ColIdx, int tile_size, long long *nnz)
+{
+    int tilen = (n + tile_size - 1) / tile_size;
+    int *seen = (int *)malloc(sizeof(int) * tilen);
+    for (int j = 0; j < tilen; j++)
+        seen[j] = -1;
+    long long tiles = 0, count = 0;
+    for (int i = 0; i < n; i++)
+    {
+        int blki = i / tile_size;
+        for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+        {
+            if (ColIdx[j] >= n)
+                continue;
+            int blkj = ColIdx[j] / tile_size;
+            count++;
+            if (seen[blkj] != blki)
+            {
+                seen[blkj] = blki;
+                tiles++;
+            }
+        }
+    }
+    free(seen);
+    *nnz = count;
+    return tiles;
+}
+
+// CSR of P A P^T over all rows: RowPtr is rewritten in place, ColIdx and Val are replaced and sorted per row
+void reorder_apply(reorder *ro, int rows, MAT_PTR_TYPE *RowPtr, int **ColIdx, MAT_VAL_TYPE **Val)
+{
+    int *col_new = (int *)malloc(sizeof(int) * RowPtr[rows]);
+    MAT_VAL_TYPE *val_new = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * RowPtr[rows]);
+    MAT_PTR_TYPE *ptr_new = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (rows + 1));
+    int max_len = 0;
+#pragma omp parallel for reduction(max : max_len)
+    for (int i = 0; i < rows; i++)
+    {
+        int src = i < ro->n ? ro->perm[i] : i;
+        ptr_new[i] = RowPtr[src + 1] - RowPtr[src];
+        max_len = ptr_new[i] > max_len ? ptr_new[i] : max_len;
+    }
+    ptr_new[rows] = 0;
+    exclusive_scan(ptr_new, rows + 1);
+#pragma omp parallel
+    {
+        // radix scratch for the longest row
+        int *key_tmp = (int *)malloc(sizeof(int) * (max_len + 1));
+        MAT_VAL_TYPE *val_tmp = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * (max_len + 1));
+#pragma omp for schedule(dynamic, 256)
+        for (int i = 0; i < rows; i++)
+        {
+            int src = i < ro->n ? ro->perm[i] : i;
+            MAT_PTR_TYPE k = ptr_new[i];
+            for (MAT_PTR_TYPE j = RowPtr[src]; j < RowPtr[src + 1]; j++, k++)
+            {
+                int c = (*ColIdx)[j];
+                col_new[k] = c < ro->n ? ro->iperm[c] : c;
+                val_new[k] = (*Val)[j];
+            }
+            sort_key_val_pair(col_new + ptr_new[i], val_new + ptr_new[i], (int)(ptr_new[i + 1] - ptr_new[i]), key_tmp, val_tmp);
+        }
+        free(key_tmp);
+        free(val_tmp);
+    }
+    memcpy(RowPtr, ptr_new, sizeof(MAT_PTR_TYPE) * (rows + 1));
+    free(ptr_new);
+    free(*ColIdx);
+    free(*Val);
+    *ColIdx = col_new;
+    *Val = val_new;
+}
+
+// the tile size to reorder at, which the mains also hand to the solver setup so that both see the same tiles:
+// TILE_SIZE, else tile_size_select's on the input pattern. Without reordering it stays 0 and the setup
+// chooses, after a tile cache miss only
+int reorder_tile_size(int method, int rowA, int colA, MAT_PTR_TYPE *RowPtr, int *ColIdx, int simd)
+{
+    if (TILE_SIZE || method == REORDER_NONE)
+        return TILE_SIZE;
+    return tile_size_select(rowA, colA, RowPtr, ColIdx, simd);
+}
+
+// permute the CSR matrix (rows x rows, reordered below n) in place and print the tile counts at tile_size
+// before and after; with REORDER_NONE the permutation is the identity and nothing is touched
+void reorder_create(reorder *ro, int method, int n, int rows, MAT_PTR_TYPE *RowPtr, int **ColIdx, MAT_VAL_TYPE **Val, int tile_size)
+{
+    ro->n = n;
+    ro->method = method;
+    ro->perm = (int *)malloc(sizeof(int) * n);
+    ro->iperm = (int *)malloc(sizeof(int) * n);
+    for (int i = 0; i < n; i++)
+        ro->perm[i] = i;
+    if (method == REORDER_NONE)
+    {
+        memcpy(ro->iperm, ro->perm, sizeof(int) * n);
+        return;
+    }
+
+    struct timeval t1, t2;
+    gettimeofday(&t1, NULL);
+    long long nnz_before, nnz_after;
+    long long tiles_before = reorder_tile_count(n, RowPtr, *ColIdx, tile_size, &nnz_before);
+    MAT_PTR_TYPE *adj_ptr;
+    int *adj;
+    reorder_graph(n, RowPtr, *ColIdx, &adj_ptr, &adj);
+    if (method == REORDER_RCM)
+        reorder_rcm(n, adj_ptr, adj, ro->perm);
+    else
+        reorder_tile_greedy(n, adj_ptr, adj, tile_size, ro->perm);
+    free(adj_ptr);
+    free(adj);
+    for (int i = 0; i < n; i++)
+        ro->iperm[ro->perm[i]] = i;
+    reorder_apply(ro, rows, RowPtr, ColIdx, Val);
+    long long tiles_after = reorder_tile_count(n, RowPtr, *ColIdx, tile_size, &nnz_after);
+    gettimeofday(&t2, NULL);
+    double time_reorder = (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    printf("reorder=%s tile_size=%d tilenum %lld -> %lld, nnz_per_tile %.2f -> %.2f, time_reorder=%lf ms\n", method == REORDER_RCM ? "rcm" : "tile",
+           tile_size, tiles_before, tiles_after, tiles_before ? (double)nnz_before / tiles_before : 0, tiles_after ? (double)nnz_after / tiles_after : 0, time_reorder);
+}
+
+void reorder_destroy(reorder *ro)
+{
+    free(ro->perm);
+    free(ro->iperm);
+}
+
+// v_new[i] = v[perm[i]] for i < n, on nrhs interleaved vectors
+void reorder_forward(reorder *ro, MAT_VAL_TYPE *v, int nrhs)
+{
+    if (ro->method == REORDER_NONE)
+        return;
+    MAT_VAL_TYPE *tmp = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * ro->n * nrhs);
+    for (int i = 0; i < ro->n; i++)
+        memcpy(tmp + (size_t)i * nrhs, v + (size_t)ro->perm[i] * nrhs, sizeof(MAT_VAL_TYPE) * nrhs);
+    memcpy(v, tmp, sizeof(MAT_VAL_TYPE) * ro->n * nrhs);
+    free(tmp);
+}
+
+// v[perm[i]] = v_new[i] for i < n, on nrhs interleaved vectors
+void reorder_backward(reorder *ro, MAT_VAL_TYPE *v, int nrhs)
+{
+    if (ro->method == REORDER_NONE)
+        return;
+    MAT_VAL_TYPE *tmp = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * ro->n * nrhs);
+    for (int i = 0; i < ro->n; i++)
+        memcpy(tmp + (size_t)ro->perm[i] * nrhs, v + (size_t)i * nrhs, sizeof(MAT_VAL_TYPE) * nrhs);
+    memcpy(v, tmp, sizeof(MAT_VAL_TYPE) * ro->n * nrhs);
+    free(tmp);
+}
+
+#endif
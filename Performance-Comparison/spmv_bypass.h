@@ -0,0 +1,138 @@
+#ifndef _SPMV_BYPASS_H_
+#define _SPMV_BYPASS_H_
+
+#include "common.h"
+#include "format.h"
+#include "tile_precision.h"
+
+// Host counterpart of d_vis in Mixed-Precision/Mille-feuille_CG.cu. q is kept equal to A d_ref, where d_ref
+// follows d one column block at a time: a block is only flagged in col_changed when some entry of d moved
+// by more than tol since d_ref last caught up, and the SpMV then adds A (d - d_ref) over the flagged
+// blocks only, skipping every tile whose column block stayed put.
+typedef struct
+{
+    double *d_ref;
+    double *dd;
+    char *col_changed;
+    double *changed_partial;
+    double *skip_partial;
+    int *skipped;
+    int full_spmv;
+} spmv_bypass;
+
+void spmv_bypass_create(spmv_bypass *bypass, int vec_len, int tilen, int nthreads, int maxiter)
+{
+    bypass->d_ref = (double *)malloc(sizeof(double) * vec_len);
+    bypass->dd = (double *)malloc(sizeof(double) * vec_len);
+    bypass->col_changed = (char *)malloc(sizeof(char) * tilen);
+    bypass->changed_partial = (double *)malloc(sizeof(double) * nthreads * PARTIAL_STRIDE);
+    bypass->skip_partial = (double *)malloc(sizeof(double) * nthreads * PARTIAL_STRIDE);
+    bypass->skipped = (int *)malloc(sizeof(int) * (maxiter > 0 ? maxiter : 1));
+    memset(bypass->d_ref, 0, sizeof(double) * vec_len);
+    memset(bypass->dd, 0, sizeof(double) * vec_len);
+    memset(bypass->col_changed, 0, sizeof(char) * tilen);
+    memset(bypass->changed_partial, 0, sizeof(double) * nthreads * PARTIAL_STRIDE);
+    memset(bypass->skip_partial, 0, sizeof(double) * nthreads * PARTIAL_STRIDE);
+    bypass->full_spmv = 0;
+}
+
+void spmv_bypass_destroy(spmv_bypass *bypass)
+{
+    free(bypass->d_ref);
+    free(bypass->dd);
+    free(bypass->col_changed);
+    free(bypass->changed_partial);
+    free(bypass->skip_partial);
+    free(bypass->skipped);
+}
+
+// forget the d_ref of the last solve, for a new one on the same matrix
+void spmv_bypass_reset(spmv_bypass *bypass, int vec_len, int tilen, int nthreads)
+{
+    memset(bypass->d_ref, 0, sizeof(double) * vec_len);
+    memset(bypass->dd, 0, sizeof(double) * vec_len);
+    memset(bypass->col_changed, 0, sizeof(char) * tilen);
+    memset(bypass->changed_partial, 0, sizeof(double) * nthreads * PARTIAL_STRIDE);
+    memset(bypass->skip_partial, 0, sizeof(double) * nthreads * PARTIAL_STRIDE);
+    bypass->full_spmv = 0;
+}
+
+// flag the column blocks blk_start..blk_stop-1 of d (tile_size wide) that moved by more than tol, store
+// their delta in dd and let d_ref catch up; returns the number flagged
+int spmv_bypass_mark(spmv_bypass *bypass, double *d, int blk_start, int blk_stop, int tile_size, double tol)
+{
+    int changed = 0;
+    for (int blkj = blk_start; blkj < blk_stop; blkj++)
+    {
+        double *d_seg = d + blkj * tile_size;
+        double *ref_seg = bypass->d_ref + blkj * tile_size;
+        double delta = 0;
+        for (int i = 0; i < tile_size; i++)
+            delta = fmax(delta, fabs(d_seg[i] - ref_seg[i]));
+        bypass->col_changed[blkj] = delta > tol;
+        if (delta > tol)
+        {
+            for (int i = 0; i < tile_size; i++)
+            {
+                bypass->dd[blkj * tile_size + i] = d_seg[i] - ref_seg[i];
+                ref_seg[i] = d_seg[i];
+            }
+            changed++;
+        }
+    }
+    return changed;
+}
+
+// after a full q = Ad, d_ref = d on the rows this thread owns
+void spmv_bypass_sync(spmv_bypass *bypass, double *d, int row_start, int row_stop)
+{
+    memcpy(bypass->d_ref + row_start, d + row_start, sizeof(double) * (row_stop - row_start));
+}
+
+// y += A dd over the tiles of row block blki whose column block is flagged, returns the tiles skipped
+template <int TS>
+int blockspmv_cpu_rowblk_delta(Tile_matrix *matrix,
+                               int blki,
+                               int rowA,
+                               char *col_changed,
+                               MAT_VAL_TYPE *dd,
+                               MAT_VAL_TYPE *y)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    unsigned char *Blockcsr_Val_Packed = matrix->Blockcsr_Val_Packed;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+    MAT_VAL_TYPE sum[TS];
+    for (int ri = 0; ri < TS; ri++)
+        sum[ri] = 0;
+
+    int skipped = 0;
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+    {
+        if (!col_changed[tile_columnidx[blkj]])
+        {
+            skipped++;
+            continue;
+        }
+        int prec = Blockcsr_Val_Packed ? matrix->tile_prec[blkj] : PREC_FP64;
+        const unsigned char *tile_vals = Blockcsr_Val_Packed ? Blockcsr_Val_Packed + tile_packed_start(matrix, blki, blkj)
+                                                             : (const unsigned char *)(Blockcsr_Val + tile_csr_start(matrix, blki, blkj));
+        packed_tile_spmv_prec<TS>(prec, matrix, blki, blkj, rowlength, tile_vals, dd + tile_columnidx[blkj] * TS, sum);
+    }
+
+    for (int ri = 0; ri < rowlength; ri++)
+        y[blki * TS + ri] += sum[ri];
+    return skipped;
+}
+
+typedef int (*blockspmv_delta_kernel)(Tile_matrix *matrix, int blki, int rowA, char *col_changed, MAT_VAL_TYPE *dd, MAT_VAL_TYPE *y);
+
+blockspmv_delta_kernel spmv_bypass_select(int tile_size)
+{
+    return tile_size == 8 ? blockspmv_cpu_rowblk_delta<8> : (tile_size == 32 ? blockspmv_cpu_rowblk_delta<32> : blockspmv_cpu_rowblk_delta<16>);
+}
+
+#endif
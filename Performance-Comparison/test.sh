@@ -10,6 +10,9 @@ input="CG_dataset" #The name of dataset
         ./Mille-feuille_BiCGSTAB_NVIDIA $matrix
         ./cuSPARSE_CG $matrix
         ./cuSPARSE_BiCGSTAB $matrix
+        ./Mille-feuille_CG_CPU $matrix
+        ./Mille-feuille_BiCGSTAB_CPU $matrix
+        ./Mille-feuille_MF_CPU $matrix
     done
     i=`expr $i + 1`
   done 
@@ -0,0 +1,348 @@
+#ifndef _TILE_CACHE_H_
+#define _TILE_CACHE_H_
+
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include "common.h"
+#include "format.h"
+#include "tile_precision.h"
+#include "encode.h"
+
+// On-disk Tile_matrix: a fixed header, then one 64-byte aligned section per array. Loading maps the file
+// read-only and points the Tile_matrix fields straight into it, so nothing is converted or copied.
+// Bump TILE_CACHE_VERSION whenever the layout of a section changes.
+#define TILE_CACHE_MAGIC 0x3143544d46ULL // "FMTC1"
+#define TILE_CACHE_VERSION 5
+#define TILE_CACHE_ALIGN 64
+
+#define TILE_CACHE_OK 0
+#define TILE_CACHE_MISSING -1
+#define TILE_CACHE_STALE -2
+
+enum
+{
+    TC_TILE_PTR,
+    TC_TILE_COLUMNIDX,
+    TC_TILE_NNZ,
+    TC_FORMAT,
+    TC_BLKNNZ,
+    TC_CSR_OFFSET,
+    TC_CSRPTR_OFFSET,
+    TC_ROWBLK_BASE,
+    TC_BLOCKCSR_VAL,
+    TC_BLOCKCSR_VAL_LOW,
+    TC_TILE_CSR_COL,
+    TC_BLOCKCSR_PTR,
+    TC_CSR_COMPRESSEDIDX,
+    TC_TILE_PREC,
+    TC_TILE_VAL_OFFSET,
+    TC_ROWBLK_PACKED_BASE,
+    TC_BLOCKCSR_VAL_PACKED,
+    TC_DEFERRED_PTR,
+    TC_DEFERRED_COLIDX,
+    TC_DEFERRED_VAL,
+    TC_NSECTION
+};
+
+typedef struct
+{
+    uint64_t offset;
+    uint64_t bytes;
+} tile_cache_section;
+
+typedef struct
+{
+    uint64_t magic;
+    int version;
+    int block_size; // tile_size of the cached tiling
+    int val_size;
+    int val_low_size;
+    int ptr_size;
+    int rowA;
+    int colA;
+    int64_t nnzR;
+    int tilem;
+    int tilen;
+    int tilenum;
+    int64_t csrsize;
+    int64_t csrptrlen;
+    int64_t packedsize;
+    int64_t coototal;
+    int defer_th;         // COO_NNZ_TH the deferred entries were split off with, 0 when none were
+    double prec_tol;      // -1 when the values are not packed
+    uint64_t source_hash; // tile_cache_hash of the CSR the tiles were built from
+    uint64_t checksum;    // tile_cache_hash of everything after the header
+    tile_cache_section section[TC_NSECTION];
+} tile_cache_header;
+
+typedef struct
+{
+    void *base;
+    size_t length;
+} tile_cache_map;
+
+// 64-bit multiply-xorshift over 8-byte words, the tail is zero-padded
+uint64_t tile_cache_hash(const void *data, size_t bytes, uint64_t h)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    size_t nword = bytes / 8;
+    for (size_t i = 0; i < nword; i++)
+    {
+        uint64_t w;
+        memcpy(&w, p + i * 8, 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    if (bytes % 8)
+    {
+        uint64_t w = 0;
+        memcpy(&w, p + nword * 8, bytes % 8);
+        h = (h ^ w) * 0x9e3779b97f4a7c15ULL;
+        h ^= h >> 29;
+    }
+    return h ^ bytes;
+}
+
+uint64_t tile_cache_source_hash(int rowA, int colA, MAT_PTR_TYPE nnzR, MAT_PTR_TYPE *RowPtr, int *ColIdx, MAT_VAL_TYPE *Val)
+{
+    int64_t dims[3] = {rowA, colA, nnzR};
+    uint64_t h = tile_cache_hash(dims, sizeof(dims), 0);
+    h = tile_cache_hash(RowPtr, sizeof(MAT_PTR_TYPE) * (rowA + 1), h);
+    h = tile_cache_hash(ColIdx, sizeof(int) * nnzR, h);
+    return tile_cache_hash(Val, sizeof(MAT_VAL_TYPE) * nnzR, h);
+}
+
+// foo.mtx or foo.cbd -> foo.mft next to it, any other name gets .mft appended. Returns 0, and the matrix
+// is not cached, for an empty name or when the cache name does not fit in len bytes or would be the input file
+int tile_cache_name(char *cache_name, size_t len, const char *filename)
+{
+    size_t file_length = strlen(filename);
+    size_t stem = file_length;
+    if (file_length >= 4 && (strcmp(filename + file_length - 4, ".mtx") == 0 || strcmp(filename + file_length - 4, ".cbd") == 0))
+        stem -= 4;
+    int n = snprintf(cache_name, len, "%.*s.mft", (int)stem, filename);
+    return file_length > 0 && n > 0 && (size_t)n < len && strcmp(cache_name, filename) != 0;
+}
+
+int tile_cache_save(const char *cache_name, Tile_matrix *matrix, int rowA, int colA, MAT_PTR_TYPE nnzR, double prec_tol, int defer_th, uint64_t source_hash)
+{
+    int tilem = matrix->tilem;
+    int tilenum = matrix->tilenum;
+    MAT_PTR_TYPE csrsize = matrix->csrsize;
+    int tile_size = matrix->tile_size;
+    MAT_PTR_TYPE compressed_csr_size = tile_size == 8 ? tile_idx_bytes<8>(csrsize) : (tile_size == 32 ? tile_idx_bytes<32>(csrsize) : tile_idx_bytes<16>(csrsize));
+    int ptr_bytes = tile_size == 32 ? sizeof(tile_traits<32>::ptr_type) : sizeof(unsigned char);
+
+    const void *data[TC_NSECTION];
+    uint64_t bytes[TC_NSECTION];
+    data[TC_TILE_PTR] = matrix->tile_ptr;
+    bytes[TC_TILE_PTR] = sizeof(MAT_PTR_TYPE) * (tilem + 1);
+    data[TC_TILE_COLUMNIDX] = matrix->tile_columnidx;
+    bytes[TC_TILE_COLUMNIDX] = sizeof(int) * tilenum;
+    data[TC_TILE_NNZ] = matrix->tile_nnz;
+    bytes[TC_TILE_NNZ] = sizeof(int) * (tilenum + 1);
+    data[TC_FORMAT] = matrix->Format;
+    bytes[TC_FORMAT] = sizeof(char) * tilenum;
+    data[TC_BLKNNZ] = matrix->blknnz;
+    bytes[TC_BLKNNZ] = sizeof(int) * (tilenum + 1);
+    data[TC_CSR_OFFSET] = matrix->csr_offset;
+    bytes[TC_CSR_OFFSET] = sizeof(int) * (tilenum + 1);
+    data[TC_CSRPTR_OFFSET] = matrix->csrptr_offset;
+    bytes[TC_CSRPTR_OFFSET] = sizeof(int) * (tilenum + 1);
+    data[TC_ROWBLK_BASE] = matrix->rowblk_base;
+    bytes[TC_ROWBLK_BASE] = sizeof(MAT_PTR_TYPE) * (tilem + 1);
+    // a packed matrix keeps no Blockcsr_Val, an unpacked one no packed stream, the CPU path no Blockcsr_Val_Low
+    data[TC_BLOCKCSR_VAL] = matrix->Blockcsr_Val;
+    bytes[TC_BLOCKCSR_VAL] = matrix->Blockcsr_Val ? sizeof(MAT_VAL_TYPE) * csrsize : 0;
+    data[TC_BLOCKCSR_VAL_LOW] = matrix->Blockcsr_Val_Low;
+    bytes[TC_BLOCKCSR_VAL_LOW] = matrix->Blockcsr_Val_Low ? sizeof(MAT_VAL_LOW_TYPE) * csrsize : 0;
+    data[TC_TILE_CSR_COL] = matrix->Tile_csr_Col;
+    bytes[TC_TILE_CSR_COL] = sizeof(unsigned char) * csrsize;
+    data[TC_BLOCKCSR_PTR] = matrix->Blockcsr_Ptr;
+    bytes[TC_BLOCKCSR_PTR] = ptr_bytes * matrix->csrptrlen;
+    // keep the 16-byte tail the SIMD nibble decode and the 3-bit decode read past the last field
+    data[TC_CSR_COMPRESSEDIDX] = matrix->csr_compressedIdx;
+    bytes[TC_CSR_COMPRESSEDIDX] = sizeof(unsigned char) * (compressed_csr_size + 16);
+    int packed = matrix->Blockcsr_Val_Packed != NULL;
+    data[TC_TILE_PREC] = matrix->tile_prec;
+    bytes[TC_TILE_PREC] = packed ? sizeof(char) * tilenum : 0;
+    data[TC_TILE_VAL_OFFSET] = matrix->tile_val_offset;
+    bytes[TC_TILE_VAL_OFFSET] = packed ? sizeof(int) * (tilenum + 1) : 0;
+    data[TC_ROWBLK_PACKED_BASE] = matrix->rowblk_packed_base;
+    bytes[TC_ROWBLK_PACKED_BASE] = packed ? sizeof(MAT_PTR_TYPE) * (tilem + 1) : 0;
+    data[TC_BLOCKCSR_VAL_PACKED] = matrix->Blockcsr_Val_Packed;
+    bytes[TC_BLOCKCSR_VAL_PACKED] = packed ? matrix->packedsize + PACKED_TAIL_PAD : 0;
+    int deferred = matrix->deferredcoo_ptr != NULL;
+    data[TC_DEFERRED_PTR] = matrix->deferredcoo_ptr;
+    bytes[TC_DEFERRED_PTR] = deferred ? sizeof(MAT_PTR_TYPE) * (rowA + 1) : 0;
+    data[TC_DEFERRED_COLIDX] = matrix->deferredcoo_colidx;
+    bytes[TC_DEFERRED_COLIDX] = deferred ? sizeof(int) * matrix->coototal : 0;
+    data[TC_DEFERRED_VAL] = matrix->deferredcoo_val;
+    bytes[TC_DEFERRED_VAL] = deferred ? sizeof(MAT_VAL_TYPE) * matrix->coototal : 0;
+
+    tile_cache_header header;
+    memset(&header, 0, sizeof(tile_cache_header));
+    header.magic = TILE_CACHE_MAGIC;
+    header.version = TILE_CACHE_VERSION;
+    header.block_size = tile_size;
+    header.val_size = sizeof(MAT_VAL_TYPE);
+    header.val_low_size = sizeof(MAT_VAL_LOW_TYPE);
+    header.ptr_size = sizeof(MAT_PTR_TYPE);
+    header.rowA = rowA;
+    header.colA = colA;
+    header.nnzR = nnzR;
+    header.tilem = tilem;
+    header.tilen = matrix->tilen;
+    header.tilenum = tilenum;
+    header.csrsize = csrsize;
+    header.csrptrlen = matrix->csrptrlen;
+    header.packedsize = matrix->packedsize;
+    header.coototal = matrix->coototal;
+    header.defer_th = defer_th;
+    header.prec_tol = prec_tol;
+    header.source_hash = source_hash;
+
+    uint64_t offset = (sizeof(tile_cache_header) + TILE_CACHE_ALIGN - 1) / TILE_CACHE_ALIGN * TILE_CACHE_ALIGN;
+    for (int s = 0; s < TC_NSECTION; s++)
+    {
+        header.section[s].offset = offset;
+        header.section[s].bytes = bytes[s];
+        offset = (offset + bytes[s] + TILE_CACHE_ALIGN - 1) / TILE_CACHE_ALIGN * TILE_CACHE_ALIGN;
+    }
+    uint64_t length = offset;
+
+    // assemble the payload in memory so the checksum covers the alignment padding too
+    size_t payload_offset = header.section[0].offset;
+    unsigned char *payload = (unsigned char *)malloc(length - payload_offset);
+    memset(payload, 0, length - payload_offset);
+    for (int s = 0; s < TC_NSECTION; s++)
+        if (bytes[s])
+            memcpy(payload + header.section[s].offset - payload_offset, data[s], bytes[s]);
+    header.checksum = tile_cache_hash(payload, length - payload_offset, TILE_CACHE_MAGIC);
+
+    unsigned char head[TILE_CACHE_ALIGN * ((sizeof(tile_cache_header) + TILE_CACHE_ALIGN - 1) / TILE_CACHE_ALIGN)];
+    memset(head, 0, sizeof(head));
+    memcpy(head, &header, sizeof(tile_cache_header));
+
+    // write to a temporary name and rename, so a concurrent reader never maps half a file
+    char tmp_name[520];
+    sprintf(tmp_name, "%s.tmp", cache_name);
+    FILE *fp = fopen(tmp_name, "wb");
+    if (fp == NULL)
+    {
+        free(payload);
+        return TILE_CACHE_MISSING;
+    }
+    int ok = fwrite(head, sizeof(head), 1, fp) == 1 && fwrite(payload, length - payload_offset, 1, fp) == 1;
+    ok = (fclose(fp) == 0) && ok;
+    free(payload);
+    if (!ok || rename(tmp_name, cache_name) != 0)
+    {
+        remove(tmp_name);
+        return TILE_CACHE_MISSING;
+    }
+    return TILE_CACHE_OK;
+}
+
+// map a cache written by tile_cache_save; on TILE_CACHE_OK the matrix arrays live in map and must not be freed.
+// tile_size 0 takes whichever tiling is cached
+int tile_cache_load(const char *cache_name, Tile_matrix *matrix, tile_cache_map *map, int tile_size, int rowA, int colA, MAT_PTR_TYPE nnzR, double prec_tol, int defer_th, uint64_t source_hash)
+{
+    map->base = NULL;
+    map->length = 0;
+    int fd = open(cache_name, O_RDONLY);
+    if (fd < 0)
+        return TILE_CACHE_MISSING;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(tile_cache_header))
+    {
+        close(fd);
+        return TILE_CACHE_STALE;
+    }
+    void *base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return TILE_CACHE_MISSING;
+
+    tile_cache_header *header = (tile_cache_header *)base;
+    int valid = header->magic == TILE_CACHE_MAGIC &&
+                header->version == TILE_CACHE_VERSION &&
+                (tile_size == 0 || header->block_size == tile_size) &&
+                header->val_size == sizeof(MAT_VAL_TYPE) &&
+                header->val_low_size == sizeof(MAT_VAL_LOW_TYPE) &&
+                header->ptr_size == sizeof(MAT_PTR_TYPE) &&
+                header->rowA == rowA && header->colA == colA && header->nnzR == nnzR && header->prec_tol == prec_tol &&
+                header->defer_th == defer_th &&
+                header->source_hash == source_hash;
+    for (int s = 0; valid && s < TC_NSECTION; s++)
+        valid = header->section[s].offset % TILE_CACHE_ALIGN == 0 &&
+                header->section[s].offset + header->section[s].bytes <= (uint64_t)st.st_size;
+#if TILE_CACHE_VERIFY
+    if (valid)
+    {
+        size_t payload_offset = header->section[0].offset;
+        valid = header->checksum == tile_cache_hash((unsigned char *)base + payload_offset, st.st_size - payload_offset, TILE_CACHE_MAGIC);
+    }
+#endif
+    if (!valid)
+    {
+        munmap(base, st.st_size);
+        return TILE_CACHE_STALE;
+    }
+
+    unsigned char *p = (unsigned char *)base;
+    void *ptr[TC_NSECTION];
+    for (int s = 0; s < TC_NSECTION; s++)
+        ptr[s] = header->section[s].bytes ? p + header->section[s].offset : NULL;
+    matrix->tile_size = header->block_size;
+    matrix->tilem = header->tilem;
+    matrix->tilen = header->tilen;
+    matrix->tilenum = header->tilenum;
+    matrix->csrsize = header->csrsize;
+    matrix->csrptrlen = header->csrptrlen;
+    matrix->packedsize = header->packedsize;
+    matrix->coototal = header->coototal;
+    matrix->tile_ptr = (MAT_PTR_TYPE *)ptr[TC_TILE_PTR];
+    matrix->tile_columnidx = (int *)ptr[TC_TILE_COLUMNIDX];
+    matrix->tile_nnz = (int *)ptr[TC_TILE_NNZ];
+    matrix->Format = (char *)ptr[TC_FORMAT];
+    matrix->blknnz = (int *)ptr[TC_BLKNNZ];
+    matrix->csr_offset = (int *)ptr[TC_CSR_OFFSET];
+    matrix->csrptr_offset = (int *)ptr[TC_CSRPTR_OFFSET];
+    matrix->rowblk_base = (MAT_PTR_TYPE *)ptr[TC_ROWBLK_BASE];
+    matrix->Blockcsr_Val = (MAT_VAL_TYPE *)ptr[TC_BLOCKCSR_VAL];
+    matrix->Blockcsr_Val_Low = (MAT_VAL_LOW_TYPE *)ptr[TC_BLOCKCSR_VAL_LOW];
+    matrix->Tile_csr_Col = (unsigned char *)ptr[TC_TILE_CSR_COL];
+    matrix->Blockcsr_Ptr = (unsigned char *)ptr[TC_BLOCKCSR_PTR];
+    matrix->csr_compressedIdx = (unsigned char *)ptr[TC_CSR_COMPRESSEDIDX];
+    matrix->tile_prec = (char *)ptr[TC_TILE_PREC];
+    matrix->tile_val_offset = (int *)ptr[TC_TILE_VAL_OFFSET];
+    matrix->rowblk_packed_base = (MAT_PTR_TYPE *)ptr[TC_ROWBLK_PACKED_BASE];
+    matrix->Blockcsr_Val_Packed = (unsigned char *)ptr[TC_BLOCKCSR_VAL_PACKED];
+    matrix->deferredcoo_ptr = (MAT_PTR_TYPE *)ptr[TC_DEFERRED_PTR];
+    matrix->deferredcoo_colidx = (int *)ptr[TC_DEFERRED_COLIDX];
+    matrix->deferredcoo_val = (MAT_VAL_TYPE *)ptr[TC_DEFERRED_VAL];
+    map->base = base;
+    map->length = st.st_size;
+    return TILE_CACHE_OK;
+}
+
+// let the matrix arrays of a loaded cache be written in place, e.g. by tile_refresh_apply; the mapping is
+// private, so the pages written are copied and the file keeps its contents. Returns 1 on success
+int tile_cache_writable(tile_cache_map *map)
+{
+    return map->base == NULL || mprotect(map->base, map->length, PROT_READ | PROT_WRITE) == 0;
+}
+
+void tile_cache_close(tile_cache_map *map)
+{
+    if (map->base != NULL)
+        munmap(map->base, map->length);
+    map->base = NULL;
+    map->length = 0;
+}
+
+#endif
@@ -0,0 +1,418 @@
+#ifndef _TILE_FORMAT_H_
+#define _TILE_FORMAT_H_
+
+#include "common.h"
+#include "format.h"
+#include "encode.h"
+#include "tile_precision.h"
+
+// Per-tile storage format for the CPU SpMV, picked from the CSR tiles once they are built. A tile whose fill
+// reaches TILE_FMT_DNS_TH is stored dense, rows at a tile_size stride, and drops its index stream; every
+// other tile takes whichever of CSR, COO (one packed row/column position per nonzero, no row pointers) and
+// ELL (rows padded to the longest, stored slot-major, no row pointers) streams the fewest bytes, ties going
+// to CSR. So COO picks up the near-empty tiles and ELL the tiles with rows of about equal length. COO, ELL
+// and dense values keep the tile's precision class. The CSR tiles stay in the Tile_matrix, which the cache,
+// the preconditioner and the bypass read, and CSR-format tiles are read from there.
+#define TILE_FMT_CSR 0
+#define TILE_FMT_COO 1
+#define TILE_FMT_ELL 2
+#define TILE_FMT_DNS 3
+#define TILE_FMT_NUM 4
+
+static const char *tile_fmt_name[TILE_FMT_NUM] = {"csr", "coo", "ell", "dns"};
+
+typedef struct
+{
+    int tile_size;
+    int tilenum;
+    char *format;
+    unsigned char *ell_width;
+    MAT_PTR_TYPE *val_offset; // byte offset of a COO, ELL or dense tile in val, aligned to its element size
+    MAT_PTR_TYPE *idx_offset; // byte offset of a COO or ELL tile in idx
+    unsigned char *val;
+    unsigned char *idx;
+    long long tiles[TILE_FMT_NUM];
+    long long nnz[TILE_FMT_NUM];
+    long long bytes[TILE_FMT_NUM];  // values, indices and row pointers one SpMV streams per format
+    long long bytes_csr;            // the same, had every tile stayed CSR
+    double time[TILE_FMT_NUM];      // ms per SpMV over the tiles of each format
+} tile_format;
+
+static inline int tile_fmt_prec(Tile_matrix *matrix, int tile)
+{
+    return matrix->Blockcsr_Val_Packed ? matrix->tile_prec[tile] : PREC_FP64;
+}
+
+static inline const unsigned char *tile_fmt_csr_vals(Tile_matrix *matrix, int blki, int tile)
+{
+    return matrix->Blockcsr_Val_Packed ? matrix->Blockcsr_Val_Packed + tile_packed_start(matrix, blki, tile)
+                                       : (const unsigned char *)(matrix->Blockcsr_Val + tile_csr_start(matrix, blki, tile));
+}
+
+// copy the values of the COO, ELL and dense tiles over from matrix, in the layout build chose for them
+template <int TS>
+void tile_format_fill(tile_format *tf, Tile_matrix *matrix, int rowA)
+{
+    typedef typename tile_traits<TS>::ptr_type ptr_type;
+    int tilem = matrix->tilem;
+    int *blknnz = matrix->blknnz;
+    ptr_type *Blockcsr_Ptr = (ptr_type *)matrix->Blockcsr_Ptr;
+
+    // copy the values over in the chosen layout, padding slots hold zero at column 0
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+        for (int blkj = matrix->tile_ptr[blki]; blkj < matrix->tile_ptr[blki + 1]; blkj++)
+        {
+            int format = tf->format[blkj];
+            if (format == TILE_FMT_CSR)
+                continue;
+            int nnz = tile_span(blknnz, blkj);
+            int prec = tile_fmt_prec(matrix, blkj);
+            int width = tf->ell_width[blkj];
+            const unsigned char *csr_vals = tile_fmt_csr_vals(matrix, blki, blkj);
+            unsigned char *tile_vals = tf->val + tf->val_offset[blkj];
+            unsigned char *tile_idx = tf->idx + tf->idx_offset[blkj];
+            int slots = format == TILE_FMT_COO ? nnz : (format == TILE_FMT_ELL ? rowlength * width : rowlength * TS);
+            memset(tile_vals, 0, slots * prec_bytes[prec]);
+            if (format != TILE_FMT_DNS)
+                memset(tile_idx, 0, format == TILE_FMT_COO ? nnz * sizeof(ptr_type) : slots);
+            MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+            MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+            for (int ri = 0; ri < rowlength; ri++)
+            {
+                int start = Blockcsr_Ptr[csrcount + ri];
+                int stop = ri == rowlength - 1 ? nnz : Blockcsr_Ptr[csrcount + ri + 1];
+                for (int rj = start; rj < stop; rj++)
+                {
+                    int ci = tile_idx_get<TS>(matrix->csr_compressedIdx, csroffset + rj);
+                    MAT_VAL_TYPE v = packed_val(prec, csr_vals, rj);
+                    if (format == TILE_FMT_COO)
+                    {
+                        ((ptr_type *)tile_idx)[rj] = ri * TS + ci;
+                        prec_store(prec, tile_vals, rj, v);
+                    }
+                    else if (format == TILE_FMT_ELL)
+                    {
+                        int slot = (rj - start) * rowlength + ri;
+                        tile_idx[slot] = ci;
+                        prec_store(prec, tile_vals, slot, v);
+                    }
+                    else
+                    {
+                        prec_store(prec, tile_vals, ri * TS + ci, v);
+                    }
+                }
+            }
+        }
+    }
+}
+
+template <int TS>
+void tile_format_build(tile_format *tf, Tile_matrix *matrix, int rowA, int colA)
+{
+    typedef typename tile_traits<TS>::ptr_type ptr_type;
+    int tilem = matrix->tilem;
+    int tilen = matrix->tilen;
+    int tilenum = matrix->tilenum;
+    int *blknnz = matrix->blknnz;
+    ptr_type *Blockcsr_Ptr = (ptr_type *)matrix->Blockcsr_Ptr;
+    int *val_bytes = (int *)malloc(sizeof(int) * tilenum);
+    int *idx_bytes = (int *)malloc(sizeof(int) * tilenum);
+    long long *tile_bytes_csr = (long long *)malloc(sizeof(long long) * tilenum);
+
+    // choose the format of each tile and size its streams
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+        for (int blkj = matrix->tile_ptr[blki]; blkj < matrix->tile_ptr[blki + 1]; blkj++)
+        {
+            int collength = matrix->tile_columnidx[blkj] == tilen - 1 ? colA - (tilen - 1) * TS : TS;
+            int nnz = tile_span(blknnz, blkj);
+            MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+            int width = 0;
+            for (int ri = 0; ri < rowlength; ri++)
+            {
+                int stop = ri == rowlength - 1 ? nnz : Blockcsr_Ptr[csrcount + ri + 1];
+                int len = stop - Blockcsr_Ptr[csrcount + ri];
+                width = len > width ? len : width;
+            }
+            int vb = prec_bytes[tile_fmt_prec(matrix, blkj)];
+            long long csr = (long long)nnz * vb + tile_idx_bytes<TS>(nnz) + rowlength * sizeof(ptr_type);
+            long long coo = (long long)nnz * (vb + sizeof(ptr_type));
+            long long ell = (long long)rowlength * width * (vb + 1);
+            int format = TILE_FMT_CSR;
+            long long best = csr;
+            if (nnz >= TILE_FMT_DNS_TH * rowlength * collength)
+            {
+                format = TILE_FMT_DNS;
+                best = (long long)rowlength * TS * vb;
+            }
+            else
+            {
+                if (ell < best)
+                {
+                    format = TILE_FMT_ELL;
+                    best = ell;
+                }
+                if (coo < best)
+                {
+                    format = TILE_FMT_COO;
+                    best = coo;
+                }
+            }
+            tf->format[blkj] = format;
+            tf->ell_width[blkj] = format == TILE_FMT_ELL ? width : 0;
+            val_bytes[blkj] = format == TILE_FMT_CSR ? 0 : (format == TILE_FMT_COO ? nnz : (format == TILE_FMT_ELL ? rowlength * width : rowlength * TS)) * vb;
+            idx_bytes[blkj] = format == TILE_FMT_COO ? nnz * sizeof(ptr_type) : (format == TILE_FMT_ELL ? rowlength * width : 0);
+            tile_bytes_csr[blkj] = csr;
+        }
+    }
+
+    for (int f = 0; f < TILE_FMT_NUM; f++)
+    {
+        tf->tiles[f] = 0;
+        tf->nnz[f] = 0;
+        tf->bytes[f] = 0;
+        tf->time[f] = 0;
+    }
+    tf->bytes_csr = 0;
+    MAT_PTR_TYPE val_size = 0, idx_size = 0;
+    for (int tile = 0; tile < tilenum; tile++)
+    {
+        int format = tf->format[tile];
+        int vb = prec_bytes[tile_fmt_prec(matrix, tile)];
+        val_size = (val_size + vb - 1) / vb * vb;
+        tf->val_offset[tile] = val_size;
+        tf->idx_offset[tile] = idx_size;
+        val_size += val_bytes[tile];
+        idx_size += idx_bytes[tile];
+        tf->tiles[format]++;
+        tf->nnz[format] += tile_span(blknnz, tile);
+        tf->bytes[format] += format == TILE_FMT_CSR ? tile_bytes_csr[tile] : val_bytes[tile] + idx_bytes[tile];
+        tf->bytes_csr += tile_bytes_csr[tile];
+    }
+    tf->val = (unsigned char *)malloc(val_size + 1);
+    tf->idx = (unsigned char *)malloc(idx_size + 1);
+    free(val_bytes);
+    free(idx_bytes);
+    free(tile_bytes_csr);
+    tile_format_fill<TS>(tf, matrix, rowA);
+}
+
+void tile_format_create(tile_format *tf, Tile_matrix *matrix, int rowA, int colA)
+{
+    int tilenum = matrix->tilenum;
+    tf->tile_size = matrix->tile_size;
+    tf->tilenum = tilenum;
+    tf->format = (char *)malloc(sizeof(char) * tilenum);
+    tf->ell_width = (unsigned char *)malloc(sizeof(unsigned char) * tilenum);
+    tf->val_offset = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * tilenum);
+    tf->idx_offset = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * tilenum);
+    if (tf->tile_size == 8)
+        tile_format_build<8>(tf, matrix, rowA, colA);
+    else if (tf->tile_size == 32)
+        tile_format_build<32>(tf, matrix, rowA, colA);
+    else
+        tile_format_build<16>(tf, matrix, rowA, colA);
+}
+
+// refill the COO, ELL and dense values after the matrix values changed in place (tile_refresh_apply)
+void tile_format_refresh(tile_format *tf, Tile_matrix *matrix, int rowA)
+{
+    if (tf->tile_size == 8)
+        tile_format_fill<8>(tf, matrix, rowA);
+    else if (tf->tile_size == 32)
+        tile_format_fill<32>(tf, matrix, rowA);
+    else
+        tile_format_fill<16>(tf, matrix, rowA);
+}
+
+void tile_format_destroy(tile_format *tf)
+{
+    free(tf->format);
+    free(tf->ell_width);
+    free(tf->val_offset);
+    free(tf->idx_offset);
+    free(tf->val);
+    free(tf->idx);
+}
+
+// sum += tile blkj of class PREC times x_win, one kernel per format
+template <int TS, int PREC>
+static inline void tile_format_spmv_prec(tile_format *tf, Tile_matrix *matrix, int blki, int blkj, int rowlength, const MAT_VAL_TYPE *x_win, MAT_VAL_TYPE *sum)
+{
+    typedef typename tile_traits<TS>::ptr_type ptr_type;
+    switch (tf->format[blkj])
+    {
+    case TILE_FMT_COO:
+    {
+        int nnz = tile_span(matrix->blknnz, blkj);
+        const ptr_type *pos = (const ptr_type *)(tf->idx + tf->idx_offset[blkj]);
+        const unsigned char *tile_vals = tf->val + tf->val_offset[blkj];
+        for (int k = 0; k < nnz; k++)
+            sum[pos[k] / TS] += x_win[pos[k] % TS] * packed_load<PREC>(tile_vals, k);
+        break;
+    }
+    case TILE_FMT_ELL:
+    {
+        int width = tf->ell_width[blkj];
+        const unsigned char *col = tf->idx + tf->idx_offset[blkj];
+        const unsigned char *tile_vals = tf->val + tf->val_offset[blkj];
+        for (int k = 0; k < width; k++)
+            for (int ri = 0; ri < rowlength; ri++)
+                sum[ri] += x_win[col[k * rowlength + ri]] * packed_load<PREC>(tile_vals, k * rowlength + ri);
+        break;
+    }
+    case TILE_FMT_DNS:
+    {
+        const unsigned char *tile_vals = tf->val + tf->val_offset[blkj];
+        for (int ri = 0; ri < rowlength; ri++)
+        {
+            MAT_VAL_TYPE s = 0;
+            for (int ci = 0; ci < TS; ci++)
+                s += x_win[ci] * packed_load<PREC>(tile_vals, ri * TS + ci);
+            sum[ri] += s;
+        }
+        break;
+    }
+    default:
+    {
+        int nnz = tile_span(matrix->blknnz, blkj);
+        MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+        MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+        const ptr_type *Blockcsr_Ptr = (const ptr_type *)matrix->Blockcsr_Ptr;
+        const unsigned char *tile_vals = tile_fmt_csr_vals(matrix, blki, blkj);
+        for (int ri = 0; ri < rowlength; ri++)
+        {
+            int stop = ri == rowlength - 1 ? nnz : Blockcsr_Ptr[csrcount + ri + 1];
+            for (int rj = Blockcsr_Ptr[csrcount + ri]; rj < stop; rj++)
+                sum[ri] += x_win[tile_idx_get<TS>(matrix->csr_compressedIdx, csroffset + rj)] * packed_load<PREC>(tile_vals, rj);
+        }
+        break;
+    }
+    }
+}
+
+// tile_format_spmv_prec with the tile's class switched on once
+template <int TS>
+static inline void tile_format_spmv_tile(tile_format *tf, Tile_matrix *matrix, int blki, int blkj, int rowlength, const MAT_VAL_TYPE *x_win, MAT_VAL_TYPE *sum)
+{
+    switch (tile_fmt_prec(matrix, blkj))
+    {
+    case PREC_INT8:
+        tile_format_spmv_prec<TS, PREC_INT8>(tf, matrix, blki, blkj, rowlength, x_win, sum);
+        break;
+    case PREC_FP16:
+        tile_format_spmv_prec<TS, PREC_FP16>(tf, matrix, blki, blkj, rowlength, x_win, sum);
+        break;
+    case PREC_FP32:
+        tile_format_spmv_prec<TS, PREC_FP32>(tf, matrix, blki, blkj, rowlength, x_win, sum);
+        break;
+    default:
+        tile_format_spmv_prec<TS, PREC_FP64>(tf, matrix, blki, blkj, rowlength, x_win, sum);
+    }
+}
+
+// blockspmv_cpu_rowblk over the per-tile formats, returns w.y over the block's rows
+template <int TS>
+MAT_VAL_TYPE tile_format_rowblk(tile_format *tf,
+                                Tile_matrix *matrix,
+                                int blki,
+                                int rowA,
+                                MAT_VAL_TYPE *x,
+                                MAT_VAL_TYPE *y,
+                                MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+    MAT_VAL_TYPE sum[TS];
+    for (int ri = 0; ri < TS; ri++)
+        sum[ri] = 0;
+
+    for (int blkj = matrix->tile_ptr[blki]; blkj < matrix->tile_ptr[blki + 1]; blkj++)
+        tile_format_spmv_tile<TS>(tf, matrix, blki, blkj, rowlength, x + matrix->tile_columnidx[blkj] * TS, sum);
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        y[blki * TS + ri] = sum[ri];
+        dot += w[blki * TS + ri] * sum[ri];
+    }
+    return dot;
+}
+
+typedef MAT_VAL_TYPE (*tile_format_kernel)(tile_format *tf, Tile_matrix *matrix, int blki, int rowA, MAT_VAL_TYPE *x, MAT_VAL_TYPE *y, MAT_VAL_TYPE *w);
+
+tile_format_kernel tile_format_select(int tile_size)
+{
+    return tile_size == 8 ? tile_format_rowblk<8> : (tile_size == 32 ? tile_format_rowblk<32> : tile_format_rowblk<16>);
+}
+
+// time reps SpMVs restricted to the tiles of each format in turn, into tf->time
+template <int TS>
+void tile_format_bench_sized(tile_format *tf, Tile_matrix *matrix, int rowA, int reps, MAT_VAL_TYPE *x, MAT_VAL_TYPE *y)
+{
+    int tilem = matrix->tilem;
+    for (int f = 0; f < TILE_FMT_NUM; f++)
+    {
+        if (!tf->tiles[f])
+            continue;
+        struct timeval t1, t2;
+        gettimeofday(&t1, NULL);
+        for (int rep = 0; rep < reps; rep++)
+        {
+#pragma omp parallel for schedule(static)
+            for (int blki = 0; blki < tilem; blki++)
+            {
+                int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+                MAT_VAL_TYPE sum[TS];
+                for (int ri = 0; ri < TS; ri++)
+                    sum[ri] = 0;
+                for (int blkj = matrix->tile_ptr[blki]; blkj < matrix->tile_ptr[blki + 1]; blkj++)
+                    if (tf->format[blkj] == f)
+                        tile_format_spmv_tile<TS>(tf, matrix, blki, blkj, rowlength, x + matrix->tile_columnidx[blkj] * TS, sum);
+                for (int ri = 0; ri < rowlength; ri++)
+                    y[blki * TS + ri] = sum[ri];
+            }
+        }
+        gettimeofday(&t2, NULL);
+        tf->time[f] = ((t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0) / reps;
+    }
+}
+
+// fill tf->time on a vector of ones, vec_len long like the solver vectors
+void tile_format_bench(tile_format *tf, Tile_matrix *matrix, int rowA, int vec_len, int reps)
+{
+    MAT_VAL_TYPE *x = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * vec_len);
+    MAT_VAL_TYPE *y = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * vec_len);
+    for (int i = 0; i < vec_len; i++)
+        x[i] = 1.0;
+    if (tf->tile_size == 8)
+        tile_format_bench_sized<8>(tf, matrix, rowA, reps, x, y);
+    else if (tf->tile_size == 32)
+        tile_format_bench_sized<32>(tf, matrix, rowA, reps, x, y);
+    else
+        tile_format_bench_sized<16>(tf, matrix, rowA, reps, x, y);
+    free(x);
+    free(y);
+}
+
+// one line per format in use: tiles, nonzeros, bytes streamed per SpMV and the SpMV time over its tiles
+void tile_format_print(tile_format *tf)
+{
+    long long bytes = 0;
+    for (int f = 0; f < TILE_FMT_NUM; f++)
+    {
+        bytes += tf->bytes[f];
+        if (!tf->tiles[f])
+            continue;
+        printf("format=%s tiles=%lld nnz=%lld bytes=%lld (%.2f B/nnz) spmv=%.4f ms\n", tile_fmt_name[f], tf->tiles[f], tf->nnz[f], tf->bytes[f],
+               tf->nnz[f] ? (double)tf->bytes[f] / tf->nnz[f] : 0, tf->time[f]);
+    }
+    printf("tile_format bytes=%lld csr_only=%lld (%.1f%%)\n", bytes, tf->bytes_csr, tf->bytes_csr ? 100.0 * bytes / tf->bytes_csr : 0);
+}
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef _TILE_PARTITION_H_
+#define _TILE_PARTITION_H_
+
+#include "common.h"
+
+// Merge-path split of a sequence of ntiles items (tiles, or row blocks) into nparts contiguous work
+// units. Item k costs its nnz plus a fixed weight, and unit p starts at the first item whose prefix cost
+// reaches p/nparts of the total, so every boundary is an independent binary search on the nnz prefix.
+// The weight keeps units of many near-empty tiles short: it is raised until no unit can hold more than
+// max_tiles items. Units may be empty when a single item outweighs a share, the GPU kernels and the
+// CPU threads both just skip them.
+typedef struct
+{
+    int nparts;
+    int *part_ptr;
+    int max_tiles;
+    long long max_nnz;
+    double imbalance;
+} tile_partition;
+
+template <typename T>
+static inline double tile_partition_cost(const T *nnz_ptr, int k, double weight)
+{
+    return (double)nnz_ptr[k] + weight * k;
+}
+
+// nnz_ptr is the exclusive scan of the item nnz (ntiles + 1 entries), max_tiles <= 0 bounds a unit to
+// TILE_PART_TILE_FACTOR times the mean item count. T is the offset type of the scan: the GPU drivers pass
+// blknnz, the CPU path its 64-bit row-block nnz
+template <typename T>
+void tile_partition_create(tile_partition *part, const T *nnz_ptr, int ntiles, int nparts, int max_tiles)
+{
+    nparts = nparts < 1 ? 1 : nparts;
+    if (max_tiles <= 0)
+        max_tiles = TILE_PART_TILE_FACTOR * ((ntiles + nparts - 1) / nparts);
+    long long nnz = nnz_ptr[ntiles] - nnz_ptr[0];
+    double weight = TILE_PART_WEIGHT;
+    if (max_tiles > 0)
+    {
+        if ((long long)max_tiles * nparts <= ntiles)
+            nparts = ntiles / max_tiles + 1;
+        // a unit holds fewer than cost/(nparts*weight) + 1 items
+        double weight_min = (double)nnz / ((double)max_tiles * nparts - ntiles);
+        weight = weight > weight_min ? weight : weight_min;
+    }
+    double total = tile_partition_cost(nnz_ptr, ntiles, weight) - tile_partition_cost(nnz_ptr, 0, weight);
+
+    part->nparts = nparts;
+    part->part_ptr = (int *)malloc(sizeof(int) * (nparts + 1));
+    part->part_ptr[0] = 0;
+    part->part_ptr[nparts] = ntiles;
+#pragma omp parallel for
+    for (int p = 1; p < nparts; p++)
+    {
+        double target = tile_partition_cost(nnz_ptr, 0, weight) + total * p / nparts;
+        int lo = 0;
+        int hi = ntiles;
+        while (lo < hi)
+        {
+            int mid = lo + (hi - lo) / 2;
+            if (tile_partition_cost(nnz_ptr, mid, weight) < target)
+                lo = mid + 1;
+            else
+                hi = mid;
+        }
+        part->part_ptr[p] = lo;
+    }
+
+    part->max_tiles = 0;
+    part->max_nnz = 0;
+    for (int p = 0; p < nparts; p++)
+    {
+        int tiles = part->part_ptr[p + 1] - part->part_ptr[p];
+        long long part_nnz = nnz_ptr[part->part_ptr[p + 1]] - nnz_ptr[part->part_ptr[p]];
+        part->max_tiles = tiles > part->max_tiles ? tiles : part->max_tiles;
+        part->max_nnz = part_nnz > part->max_nnz ? part_nnz : part->max_nnz;
+    }
+    // heaviest unit over the mean, 1 is perfect balance
+    part->imbalance = nnz ? (double)part->max_nnz * nparts / nnz : 1.0;
+}
+
+void tile_partition_destroy(tile_partition *part)
+{
+    free(part->part_ptr);
+    part->part_ptr = NULL;
+}
+
+// Work units for the persistent GPU kernels: one per resident warp (or nnz/block_nnz of them when
+// block_nnz > 0) and at least one thread block of them for tile_partition_gpu_vector, but never more than
+// fit on the device at once since the kernels spin on each other. Units past tilenum are empty.
+int tile_partition_gpu_nparts(long long nnz, int tilenum, int resident_warps, int block_nnz)
+{
+    long long nparts = block_nnz > 0 ? (nnz + block_nnz - 1) / block_nnz : resident_warps;
+    nparts = nparts > tilenum ? tilenum : nparts;
+    nparts = nparts < WARP_PER_BLOCK ? WARP_PER_BLOCK : nparts;
+    nparts = nparts > resident_warps ? resident_warps : nparts;
+    return nparts < 1 ? 1 : (int)nparts;
+}
+
+// Warps of the *_redce_block kernels, one per row block padded to whole thread blocks plus one. Each of
+// them runs the vector update of its row block, so these kernels need at least as many work units.
+int tile_partition_gpu_rowblk_warps(int tilem)
+{
+    return (tilem / WARP_PER_BLOCK + 2) * WARP_PER_BLOCK;
+}
+
+// Vector update split of the *_below_tilem_32 kernels for nparts >= WARP_PER_BLOCK work units:
+// vector_total warps, whole thread blocks of the first units, of vector_each chunks of 32 rows each,
+// covering the tilem row blocks. The kernels wait on d_block_signal of every one of those row blocks.
+void tile_partition_gpu_vector(int nparts, int tilem, int *vector_each, int *vector_total)
+{
+    int tilem_32 = (tilem + 1) / 2;
+    // a warp per 2 * ceil(tilem / nparts) chunks as the kernels were tuned, while that fits in nparts
+    int each = 2 * ((tilem + nparts - 1) / nparts);
+    int total = ((tilem_32 + each - 1) / each + WARP_PER_BLOCK - 1) / WARP_PER_BLOCK * WARP_PER_BLOCK;
+    int total_max = nparts / WARP_PER_BLOCK * WARP_PER_BLOCK;
+    total = total > total_max ? total_max : total;
+    *vector_total = total;
+    *vector_each = (tilem_32 + total - 1) / total;
+}
+
+#endif
@@ -0,0 +1,328 @@
+#ifndef _TILE_PRECISION_H_
+#define _TILE_PRECISION_H_
+
+#include "common.h"
+#include "format.h"
+#include "utils.h"
+#include "encode.h"
+
+// Per-tile value storage: every tile keeps its values once, in the narrowest class that represents all of
+// them within TILE_PREC_TOL relative error, in one packed byte stream. tile_prec holds the class and
+// tile_val_offset the byte offset of the tile, aligned to the element size. TILE_PREC_TOL = 0 only accepts
+// exact conversions, so SpMV on the packed stream gives the same bits as on Blockcsr_Val.
+#define PREC_FP64 0
+#define PREC_FP32 1
+#define PREC_FP16 2
+#define PREC_INT8 3
+#define PREC_NUM 4
+
+// the SIMD kernels load a full vector from the start of a row and mask the tail
+#define PACKED_TAIL_PAD 128
+
+static const int prec_bytes[PREC_NUM] = {8, 4, 2, 1};
+
+static inline float half_to_float(unsigned short h)
+{
+    unsigned int sign = (h & 0x8000u) << 16;
+    unsigned int exp = (h >> 10) & 0x1f;
+    unsigned int mant = h & 0x3ff;
+    unsigned int bits;
+    if (exp == 0x1f)
+        bits = sign | 0x7f800000u | (mant << 13);
+    else if (exp != 0)
+        bits = sign | ((exp + 112) << 23) | (mant << 13);
+    else if (mant == 0)
+        bits = sign;
+    else
+    {
+        // subnormal half, renormalise
+        exp = 113;
+        while (!(mant & 0x400))
+        {
+            mant <<= 1;
+            exp--;
+        }
+        bits = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+    float f;
+    memcpy(&f, &bits, sizeof(float));
+    return f;
+}
+
+// round to nearest even, overflow goes to inf
+static inline unsigned short float_to_half(float f)
+{
+    unsigned int bits;
+    memcpy(&bits, &f, sizeof(float));
+    unsigned int sign = (bits >> 16) & 0x8000u;
+    unsigned int absb = bits & 0x7fffffffu;
+    if (absb >= 0x7f800000u)
+        return sign | 0x7c00 | (absb > 0x7f800000u ? 0x200 : 0);
+    if (absb >= 0x477ff000u)
+        return sign | 0x7c00;
+    if (absb < 0x38800000u)
+    {
+        // subnormal or zero half: value / 2^-24, rounded
+        if (absb < 0x33000000u)
+            return sign;
+        unsigned int mant = (absb & 0x7fffff) | 0x800000;
+        int shift = 126 - (absb >> 23);
+        unsigned int rounded = mant >> shift;
+        unsigned int rem = mant & ((1u << shift) - 1);
+        unsigned int half = 1u << (shift - 1);
+        if (rem > half || (rem == half && (rounded & 1)))
+            rounded++;
+        return sign | rounded;
+    }
+    unsigned int h = ((absb >> 13) - (112 << 10));
+    unsigned int rem = absb & 0x1fff;
+    if (rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+        h++;
+    return sign | h;
+}
+
+// value idx of a tile of class PREC; the kernels switch on the class once per tile and run a loop on this
+template <int PREC>
+static inline MAT_VAL_TYPE packed_load(const unsigned char *tile_vals, int idx)
+{
+    if (PREC == PREC_INT8)
+        return ((const signed char *)tile_vals)[idx];
+    if (PREC == PREC_FP16)
+        return half_to_float(((const unsigned short *)tile_vals)[idx]);
+    if (PREC == PREC_FP32)
+        return ((const float *)tile_vals)[idx];
+    return ((const MAT_VAL_TYPE *)tile_vals)[idx];
+}
+
+// packed_load with the class known only at run time, for setup code
+static inline MAT_VAL_TYPE packed_val(int prec, const unsigned char *tile_vals, int idx)
+{
+    switch (prec)
+    {
+    case PREC_INT8:
+        return packed_load<PREC_INT8>(tile_vals, idx);
+    case PREC_FP16:
+        return packed_load<PREC_FP16>(tile_vals, idx);
+    case PREC_FP32:
+        return packed_load<PREC_FP32>(tile_vals, idx);
+    default:
+        return packed_load<PREC_FP64>(tile_vals, idx);
+    }
+}
+
+// value after a round trip through class prec
+static inline MAT_VAL_TYPE prec_round(int prec, MAT_VAL_TYPE v)
+{
+    switch (prec)
+    {
+    case PREC_INT8:
+        return (v >= -128.5 && v < 127.5) ? (MAT_VAL_TYPE)(signed char)lrint(v) : NAN;
+    case PREC_FP16:
+        return half_to_float(float_to_half((float)v));
+    case PREC_FP32:
+        return (float)v;
+    default:
+        return v;
+    }
+}
+
+static inline void prec_store(int prec, unsigned char *tile_vals, int idx, MAT_VAL_TYPE v)
+{
+    switch (prec)
+    {
+    case PREC_INT8:
+        ((signed char *)tile_vals)[idx] = (signed char)lrint(v);
+        break;
+    case PREC_FP16:
+        ((unsigned short *)tile_vals)[idx] = float_to_half((float)v);
+        break;
+    case PREC_FP32:
+        ((float *)tile_vals)[idx] = (float)v;
+        break;
+    default:
+        ((MAT_VAL_TYPE *)tile_vals)[idx] = v;
+    }
+}
+
+// byte offsets of the tiles in the packed stream for their tile_prec classes, kept like csr_offset, modulo
+// 2^32 against rowblk_packed_base; sets packedsize
+void tile_pack_offsets(Tile_matrix *matrix)
+{
+    int tilem = matrix->tilem;
+    int tilenum = matrix->tilenum;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *csr_offset = matrix->csr_offset;
+    MAT_PTR_TYPE offset = 0;
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        matrix->rowblk_packed_base[blki] = offset;
+        for (int tile = tile_ptr[blki]; tile < tile_ptr[blki + 1]; tile++)
+        {
+            int bytes = prec_bytes[(int)matrix->tile_prec[tile]];
+            offset = (offset + bytes - 1) / bytes * bytes;
+            if (tile == tile_ptr[blki])
+                matrix->rowblk_packed_base[blki] = offset;
+            matrix->tile_val_offset[tile] = (int)(unsigned)offset;
+            offset += (MAT_PTR_TYPE)bytes * tile_span(csr_offset, tile);
+        }
+    }
+    matrix->rowblk_packed_base[tilem] = offset;
+    matrix->tile_val_offset[tilenum] = (int)(unsigned)offset;
+    matrix->packedsize = offset;
+}
+
+// classify every tile on the CSR values of its nonzeros (those flagged in keep, when given) and lay out
+// Blockcsr_Val_Packed. Tile_create calls this once the tile offsets are known and then stores each value
+// straight into its tile's class, so the tile values are never held in fp64 or fp32 as well
+void tile_pack_layout(Tile_matrix *matrix, int rowA, const MAT_PTR_TYPE *RowPtr, const int *ColIdx, const MAT_VAL_TYPE *Val, const char *keep,
+                      double tol)
+{
+    int ts = matrix->tile_size;
+    int tilem = matrix->tilem;
+    int tilen = matrix->tilen;
+    int tilenum = matrix->tilenum;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    matrix->tile_prec = (char *)malloc(sizeof(char) * tilenum);
+    matrix->tile_val_offset = (int *)malloc(sizeof(int) * (tilenum + 1));
+    matrix->rowblk_packed_base = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (tilem + 1));
+
+    // the tile of each column block of the row block, as in convert_step4_scatter
+    int nthreads = omp_get_max_threads();
+    int *tile_of_g = (int *)malloc(sizeof(int) * nthreads * tilen);
+    for (int i = 0; i < nthreads * tilen; i++)
+        tile_of_g[i] = -1;
+#pragma omp parallel for schedule(dynamic, 16)
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int *tile_of = tile_of_g + omp_get_thread_num() * tilen;
+        int row_stop = (blki + 1) * ts < rowA ? (blki + 1) * ts : rowA;
+        for (int tile = tile_ptr[blki]; tile < tile_ptr[blki + 1]; tile++)
+        {
+            tile_of[tile_columnidx[tile]] = tile;
+            matrix->tile_prec[tile] = PREC_INT8;
+        }
+        for (MAT_PTR_TYPE j = RowPtr[blki * ts]; j < RowPtr[row_stop]; j++)
+        {
+            if (keep && !keep[j])
+                continue;
+            int tile = tile_of[ColIdx[j] / ts];
+            int prec = matrix->tile_prec[tile];
+            MAT_VAL_TYPE v = Val[j];
+            while (prec != PREC_FP64 && !(fabs(prec_round(prec, v) - v) <= tol * fabs(v)))
+                prec--;
+            matrix->tile_prec[tile] = prec;
+        }
+        for (int tile = tile_ptr[blki]; tile < tile_ptr[blki + 1]; tile++)
+            tile_of[tile_columnidx[tile]] = -1;
+    }
+    free(tile_of_g);
+
+    tile_pack_offsets(matrix);
+    matrix->Blockcsr_Val_Packed = (unsigned char *)malloc(matrix->packedsize + PACKED_TAIL_PAD);
+    memset(matrix->Blockcsr_Val_Packed + matrix->packedsize, 0, PACKED_TAIL_PAD);
+}
+
+// value k of the tile (k counted from the tile's first Blockcsr_Val slot) into the packed stream
+static inline void tile_pack_store(Tile_matrix *matrix, int blki, int tile, int k, MAT_VAL_TYPE v)
+{
+    prec_store(matrix->tile_prec[tile], matrix->Blockcsr_Val_Packed + tile_packed_start(matrix, blki, tile), k, v);
+}
+
+void tile_pack_destroy(Tile_matrix *matrix)
+{
+    free(matrix->tile_prec);
+    free(matrix->tile_val_offset);
+    free(matrix->rowblk_packed_base);
+    free(matrix->Blockcsr_Val_Packed);
+    matrix->tile_prec = NULL;
+    matrix->tile_val_offset = NULL;
+    matrix->rowblk_packed_base = NULL;
+    matrix->Blockcsr_Val_Packed = NULL;
+}
+
+// nnz per precision class, and the packed bytes per nnz
+void tile_pack_stats(Tile_matrix *matrix, long long *prec_nnz, double *bytes_per_nnz)
+{
+    for (int p = 0; p < PREC_NUM; p++)
+        prec_nnz[p] = 0;
+    for (int tile = 0; tile < matrix->tilenum; tile++)
+        prec_nnz[(int)matrix->tile_prec[tile]] += tile_span(matrix->csr_offset, tile);
+    *bytes_per_nnz = matrix->csrsize ? (double)matrix->packedsize / matrix->csrsize : 0;
+}
+
+// sum += tile blkj of class PREC, values at tile_vals, times x_win
+template <int TS, int PREC>
+static inline void packed_tile_spmv(Tile_matrix *matrix, int blki, int blkj, int rowlength, const unsigned char *tile_vals, const MAT_VAL_TYPE *x_win, MAT_VAL_TYPE *sum)
+{
+    int *blknnz = matrix->blknnz;
+    unsigned char *csr_compressedIdx = matrix->csr_compressedIdx;
+    typename tile_traits<TS>::ptr_type *Blockcsr_Ptr = (typename tile_traits<TS>::ptr_type *)matrix->Blockcsr_Ptr;
+    MAT_PTR_TYPE csroffset = tile_csr_start(matrix, blki, blkj);
+    MAT_PTR_TYPE csrcount = tile_ptr_start(matrix, blki, blkj);
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        int start = Blockcsr_Ptr[csrcount + ri];
+        int stop = ri == rowlength - 1 ? tile_span(blknnz, blkj) : Blockcsr_Ptr[ri + 1 + csrcount];
+        MAT_VAL_TYPE s = sum[ri];
+        for (int rj = start; rj < stop; rj++)
+            s += x_win[tile_idx_get<TS>(csr_compressedIdx, csroffset + rj)] * packed_load<PREC>(tile_vals, rj);
+        sum[ri] = s;
+    }
+}
+
+// packed_tile_spmv with the tile's class switched on once
+template <int TS>
+static inline void packed_tile_spmv_prec(int prec, Tile_matrix *matrix, int blki, int blkj, int rowlength, const unsigned char *tile_vals, const MAT_VAL_TYPE *x_win,
+                                         MAT_VAL_TYPE *sum)
+{
+    switch (prec)
+    {
+    case PREC_INT8:
+        packed_tile_spmv<TS, PREC_INT8>(matrix, blki, blkj, rowlength, tile_vals, x_win, sum);
+        break;
+    case PREC_FP16:
+        packed_tile_spmv<TS, PREC_FP16>(matrix, blki, blkj, rowlength, tile_vals, x_win, sum);
+        break;
+    case PREC_FP32:
+        packed_tile_spmv<TS, PREC_FP32>(matrix, blki, blkj, rowlength, tile_vals, x_win, sum);
+        break;
+    default:
+        packed_tile_spmv<TS, PREC_FP64>(matrix, blki, blkj, rowlength, tile_vals, x_win, sum);
+    }
+}
+
+// blockspmv_cpu_rowblk on the packed stream
+template <int TS>
+MAT_VAL_TYPE blockspmv_cpu_rowblk_packed(Tile_matrix *matrix,
+                                         int blki,
+                                         int rowA,
+                                         MAT_VAL_TYPE *x,
+                                         MAT_VAL_TYPE *y,
+                                         MAT_VAL_TYPE *w)
+{
+    int tilem = matrix->tilem;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    char *tile_prec = matrix->tile_prec;
+    unsigned char *Blockcsr_Val_Packed = matrix->Blockcsr_Val_Packed;
+
+    int rowlength = blki == tilem - 1 ? rowA - (tilem - 1) * TS : TS;
+    MAT_VAL_TYPE sum[TS];
+    for (int ri = 0; ri < TS; ri++)
+        sum[ri] = 0;
+
+    for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+        packed_tile_spmv_prec<TS>(tile_prec[blkj], matrix, blki, blkj, rowlength, Blockcsr_Val_Packed + tile_packed_start(matrix, blki, blkj),
+                                  x + tile_columnidx[blkj] * TS, sum);
+
+    MAT_VAL_TYPE dot = 0;
+    for (int ri = 0; ri < rowlength; ri++)
+    {
+        y[blki * TS + ri] = sum[ri];
+        dot += w[blki * TS + ri] * sum[ri];
+    }
+    return dot;
+}
+
+#endif
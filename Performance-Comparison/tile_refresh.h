@@ -0,0 +1,172 @@
+#ifndef _TILE_REFRESH_H_
+#define _TILE_REFRESH_H_
+
+#include "common.h"
+#include "format.h"
+#include "tile_precision.h"
+
+// Numeric refresh of a Tile_matrix whose sparsity pattern stays fixed. tile_refresh_create records once where
+// every CSR nonzero of the first rowA rows was stored: its Blockcsr_Val slot, or -1 - its slot in the deferred
+// CSR, plus its tile when the values are packed. tile_refresh_apply then scatters a new CSR value array in
+// a parallel pass over the nonzeros, writing Blockcsr_Val, Blockcsr_Val_Low, the packed stream and the
+// deferred values, whichever the matrix keeps. New values that a packed tile's precision class no longer
+// holds within the tolerance are found before anything is written; their tiles are widened and the packed
+// stream is laid out again, so the matrix always ends up holding all of the new values.
+typedef struct
+{
+    MAT_PTR_TYPE nnz;
+    MAT_PTR_TYPE *slot;
+    int *tile;
+    int *tile_rowblk; // row block of each tile, to address the packed stream
+    double prec_tol;
+    int packed_owned; // Blockcsr_Val_Packed is on the heap, not in a tile cache mapping
+} tile_refresh;
+
+// packed_owned says whether the matrix's packed stream may be freed when a refresh replaces it
+void tile_refresh_create(tile_refresh *tr, Tile_matrix *matrix, int rowA, MAT_PTR_TYPE *RowPtr, int *ColIdx, double prec_tol, int packed_owned)
+{
+    int ts = matrix->tile_size;
+    int tilem = matrix->tilem;
+    int tilen = matrix->tilen;
+    MAT_PTR_TYPE *tile_ptr = matrix->tile_ptr;
+    int *tile_columnidx = matrix->tile_columnidx;
+    tr->nnz = RowPtr[rowA];
+    tr->prec_tol = prec_tol;
+    tr->packed_owned = packed_owned;
+    tr->slot = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * (tr->nnz + 1));
+    tr->tile = matrix->Blockcsr_Val_Packed ? (int *)malloc(sizeof(int) * (tr->nnz + 1)) : NULL;
+    tr->tile_rowblk = matrix->Blockcsr_Val_Packed ? (int *)malloc(sizeof(int) * (matrix->tilenum + 1)) : NULL;
+
+    // the same walk as convert_step4_scatter: a tile stores its rows back to back in input order, and so does
+    // the deferred CSR, so a write cursor per tile and one per row give every slot
+    int nthreads = omp_get_max_threads();
+    int *tile_of_g = (int *)malloc(sizeof(int) * nthreads * tilen);
+    MAT_PTR_TYPE *cursor_g = (MAT_PTR_TYPE *)malloc(sizeof(MAT_PTR_TYPE) * nthreads * tilen);
+    for (int i = 0; i < nthreads * tilen; i++)
+        tile_of_g[i] = -1;
+#pragma omp parallel for schedule(dynamic, 64)
+    for (int blki = 0; blki < tilem; blki++)
+    {
+        int tid = omp_get_thread_num();
+        int *tile_of = tile_of_g + tid * tilen;
+        MAT_PTR_TYPE *cursor = cursor_g + tid * tilen;
+        int row_stop = (blki + 1) * ts < rowA ? (blki + 1) * ts : rowA;
+        for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+        {
+            tile_of[tile_columnidx[blkj]] = blkj;
+            cursor[blkj - tile_ptr[blki]] = tile_csr_start(matrix, blki, blkj);
+            if (tr->tile_rowblk)
+                tr->tile_rowblk[blkj] = blki;
+        }
+        for (int i = blki * ts; i < row_stop; i++)
+        {
+            MAT_PTR_TYPE def = matrix->coototal ? matrix->deferredcoo_ptr[i] : 0;
+            for (MAT_PTR_TYPE j = RowPtr[i]; j < RowPtr[i + 1]; j++)
+            {
+                int blkj = tile_of[ColIdx[j] / ts];
+                if (blkj >= 0)
+                {
+                    tr->slot[j] = cursor[blkj - tile_ptr[blki]]++;
+                    if (tr->tile)
+                        tr->tile[j] = blkj;
+                }
+                else
+                {
+                    tr->slot[j] = -1 - def++;
+                    if (tr->tile)
+                        tr->tile[j] = -1;
+                }
+            }
+        }
+        for (int blkj = tile_ptr[blki]; blkj < tile_ptr[blki + 1]; blkj++)
+            tile_of[tile_columnidx[blkj]] = -1;
+    }
+    free(tile_of_g);
+    free(cursor_g);
+}
+
+void tile_refresh_destroy(tile_refresh *tr)
+{
+    free(tr->slot);
+    free(tr->tile);
+    free(tr->tile_rowblk);
+}
+
+// widen the class of every packed tile to hold the values Val within the tolerance and lay the packed stream
+// out again for the new classes. Runs only when some value does not fit, the values are written afterwards
+static void tile_refresh_widen(tile_refresh *tr, Tile_matrix *matrix, MAT_VAL_TYPE *Val)
+{
+    double tol = tr->prec_tol;
+    for (MAT_PTR_TYPE j = 0; j < tr->nnz; j++)
+    {
+        int tile = tr->tile[j];
+        if (tile < 0)
+            continue;
+        int prec = matrix->tile_prec[tile];
+        MAT_VAL_TYPE v = Val[j];
+        while (prec != PREC_FP64 && !(fabs(prec_round(prec, v) - v) <= tol * fabs(v)))
+            prec--;
+        matrix->tile_prec[tile] = prec;
+    }
+    // tile_prec, tile_val_offset and rowblk_packed_base keep their sizes and are rewritten in place, the
+    // stream grows
+    if (tr->packed_owned)
+        free(matrix->Blockcsr_Val_Packed);
+    tile_pack_offsets(matrix);
+    matrix->Blockcsr_Val_Packed = (unsigned char *)malloc(matrix->packedsize + PACKED_TAIL_PAD);
+    memset(matrix->Blockcsr_Val_Packed + matrix->packedsize, 0, PACKED_TAIL_PAD);
+    tr->packed_owned = 1;
+}
+
+// write the CSR values Val (same pattern as at create) into matrix. Returns the number of values a packed
+// tile's class could not hold; their tiles were widened first, so matrix holds every value either way
+int tile_refresh_apply(tile_refresh *tr, Tile_matrix *matrix, MAT_VAL_TYPE *Val)
+{
+    double tol = tr->prec_tol;
+    int misfit = 0;
+    if (matrix->Blockcsr_Val_Packed)
+    {
+#pragma omp parallel for reduction(+ : misfit)
+        for (MAT_PTR_TYPE j = 0; j < tr->nnz; j++)
+        {
+            int tile = tr->tile[j];
+            if (tile < 0)
+                continue;
+            int prec = matrix->tile_prec[tile];
+            MAT_VAL_TYPE v = Val[j];
+            if (prec != PREC_FP64 && !(fabs(prec_round(prec, v) - v) <= tol * fabs(v)))
+                misfit++;
+        }
+        if (misfit)
+            tile_refresh_widen(tr, matrix, Val);
+    }
+
+    MAT_VAL_TYPE *Blockcsr_Val = matrix->Blockcsr_Val;
+    MAT_VAL_LOW_TYPE *Blockcsr_Val_Low = matrix->Blockcsr_Val_Low;
+    unsigned char *Blockcsr_Val_Packed = matrix->Blockcsr_Val_Packed;
+    MAT_VAL_TYPE *deferredcoo_val = matrix->deferredcoo_val;
+#pragma omp parallel for
+    for (MAT_PTR_TYPE j = 0; j < tr->nnz; j++)
+    {
+        MAT_PTR_TYPE k = tr->slot[j];
+        MAT_VAL_TYPE v = Val[j];
+        if (k < 0)
+        {
+            deferredcoo_val[-1 - k] = v;
+            continue;
+        }
+        if (Blockcsr_Val)
+            Blockcsr_Val[k] = v;
+        if (Blockcsr_Val_Low)
+            Blockcsr_Val_Low[k] = v;
+        if (Blockcsr_Val_Packed)
+        {
+            int tile = tr->tile[j];
+            int blki = tr->tile_rowblk[tile];
+            prec_store(matrix->tile_prec[tile], Blockcsr_Val_Packed + tile_packed_start(matrix, blki, tile), k - tile_csr_start(matrix, blki, tile), v);
+        }
+    }
+    return misfit;
+}
+
+#endif
@@ -0,0 +1,131 @@
+#ifndef _TILE_SIZE_H_
+#define _TILE_SIZE_H_
+
+#include "common.h"
+#include "format.h"
+#include "csr2block.h"
+
+// Per-matrix tile size. Scattered graph matrices leave about one nonzero per tile whatever the size, so
+// 8 wins there with the shortest row loop per tile; banded stencil matrices lose up to half their tiles
+// going from 16 to 32; block-dense FEM rows are long enough for the SIMD kernels, which only exist for 16.
+// tile_size_select counts the tiles each size would create and compares the estimated SpMV times.
+
+// nnz under which an off-diagonal tile goes to the deferred CSR of deferred_coo.h, 0 when that is off
+int deferred_coo_threshold(int tile_size)
+{
+    return DEFERRED_COO ? COO_NNZ_TH * tile_size / 16 : 0;
+}
+
+// tiles a TS-wide tiling of the CSR matrix would hold once the ones under deferred_coo_threshold are left
+// out, and in *deferred the nonzeros those carry
+long long tile_size_count(int ts, int rowA, int colA, MAT_PTR_TYPE *RowPtr, int *ColIdx, long long *deferred)
+{
+    int tilem = (rowA + ts - 1) / ts;
+    int tilen = (colA + ts - 1) / ts;
+    int th = deferred_coo_threshold(ts);
+    long long tiles = 0;
+    long long def = 0;
+#pragma omp parallel reduction(+ : tiles, def)
+    {
+        // the last row block that touched each column block, -1 once its tile is counted, and its nnz
+        int *stamp = (int *)malloc(sizeof(int) * tilen);
+        int *count = (int *)malloc(sizeof(int) * tilen);
+        for (int blkj = 0; blkj < tilen; blkj++)
+            stamp[blkj] = -1;
+#pragma omp for schedule(dynamic, 64)
+        for (int blki = 0; blki < tilem; blki++)
+        {
+            int row_stop = (blki + 1) * ts < rowA ? (blki + 1) * ts : rowA;
+            for (MAT_PTR_TYPE j = RowPtr[blki * ts]; j < RowPtr[row_stop]; j++)
+            {
+                int blkj = ColIdx[j] / ts;
+                if (stamp[blkj] != blki)
+                {
+                    stamp[blkj] = blki;
+                    count[blkj] = 0;
+                }
+                count[blkj]++;
+            }
+            for (MAT_PTR_TYPE j = RowPtr[blki * ts]; j < RowPtr[row_stop]; j++)
+            {
+                int blkj = ColIdx[j] / ts;
+                if (stamp[blkj] != blki)
+                    continue;
+                stamp[blkj] = -1;
+                if (blkj == blki || count[blkj] >= th)
+                    tiles++;
+                else
+                    def += count[blkj];
+            }
+        }
+        free(stamp);
+        free(count);
+    }
+    *deferred = def;
+    return tiles;
+}
+
+// SpMV time for a TS-wide tiling in units of one scalar multiply-add: a fixed cost per tile (its offsets,
+// x window and accumulator loop) plus one per row slot it walks, and the nonzeros, which the 16-wide SIMD
+// kernels process in about TILE_SIZE_SIMD_NNZ_COST of the scalar time and the deferred CSR in
+// TILE_SIZE_COO_NNZ_COST. Tiles are numbered in int, so a size that would need 2^31 of them is ruled out
+double tile_size_cost(int ts, long long nnz, long long tiles, long long deferred, int simd)
+{
+    if (tiles >= INT_MAX)
+        return HUGE_VAL;
+    double nnz_cost = ts == 16 && simd ? TILE_SIZE_SIMD_NNZ_COST : 1.0;
+    return tiles * (TILE_SIZE_TILE_COST + ts * TILE_SIZE_ROW_COST) + (nnz - deferred) * nnz_cost + deferred * TILE_SIZE_COO_NNZ_COST;
+}
+
+// tile_size_cost of a TS-wide tiling of the CSR matrix
+double tile_size_estimate(int ts, int rowA, int colA, MAT_PTR_TYPE *RowPtr, int *ColIdx, int simd)
+{
+    long long deferred;
+    long long tiles = tile_size_count(ts, rowA, colA, RowPtr, ColIdx, &deferred);
+    return tile_size_cost(ts, RowPtr[rowA] - RowPtr[0], tiles, deferred, simd);
+}
+
+// the tile size with the lowest tile_size_cost, simd says whether the 16-wide SIMD kernels will run
+int tile_size_select(int rowA, int colA, MAT_PTR_TYPE *RowPtr, int *ColIdx, int simd)
+{
+    int ts = 16;
+    double best = tile_size_estimate(16, rowA, colA, RowPtr, ColIdx, simd);
+    double cost8 = tile_size_estimate(8, rowA, colA, RowPtr, ColIdx, simd);
+    double cost32 = tile_size_estimate(32, rowA, colA, RowPtr, ColIdx, simd);
+    if (cost8 < best)
+    {
+        ts = 8;
+        best = cost8;
+    }
+    if (cost32 < best)
+        ts = 32;
+    return ts;
+}
+
+// Tile_create for a tile size known only at run time
+void Tile_create_sized(Tile_matrix *matrix,
+                       int tile_size,
+                       int rowA,
+                       int colA,
+                       MAT_PTR_TYPE nnzA,
+                       MAT_PTR_TYPE *csrRowPtrA,
+                       int *csrColIdxA,
+                       MAT_VAL_TYPE *csrValA,
+                       MAT_VAL_LOW_TYPE *csrValA_Low,
+                       double prec_tol,
+                       const char *keep)
+{
+    switch (tile_size)
+    {
+    case 8:
+        Tile_create<8>(matrix, rowA, colA, nnzA, csrRowPtrA, csrColIdxA, csrValA, csrValA_Low, prec_tol, keep);
+        break;
+    case 32:
+        Tile_create<32>(matrix, rowA, colA, nnzA, csrRowPtrA, csrColIdxA, csrValA, csrValA_Low, prec_tol, keep);
+        break;
+    default:
+        Tile_create<16>(matrix, rowA, colA, nnzA, csrRowPtrA, csrColIdxA, csrValA, csrValA_Low, prec_tol, keep);
+    }
+}
+
+#endif
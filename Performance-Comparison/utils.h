@@ -30,13 +30,14 @@ void binary_search_right_boundary_item_kernel(const MAT_PTR_TYPE *row_pointer,
     *nnzpos = key_input - row_pointer[*colpos];
 }
 
-// in-place exclusive scan
-void exclusive_scan(MAT_PTR_TYPE *input, int length)
+// in-place exclusive scan, serial
+template <typename T>
+void exclusive_scan_serial(T *input, int length)
 {
     if (length == 0 || length == 1)
         return;
 
-    MAT_PTR_TYPE old_val, new_val;
+    T old_val, new_val;
 
     old_val = input[0];
     input[0] = 0;
@@ -47,20 +48,63 @@ void exclusive_scan(MAT_PTR_TYPE *input, int length)
         old_val = new_val;
     }
 }
-void exclusive_scan_char(unsigned char *input, int length)
+
+// in-place exclusive scan, on int counts or MAT_PTR_TYPE row pointers. Above PAR_PRIM_MIN entries each
+// thread sums one block, the block sums are scanned, and each thread scans its block again from its offset
+template <typename T>
+void exclusive_scan(T *input, int length)
 {
-    if (length == 0 || length == 1)
+    if (length < PAR_PRIM_MIN || omp_in_parallel() || omp_get_max_threads() == 1)
+    {
+        exclusive_scan_serial(input, length);
         return;
+    }
 
-    unsigned char old_val, new_val;
+    int nthreads = omp_get_max_threads();
+    T *block_sum = (T *)malloc(sizeof(T) * (nthreads + 1));
+#pragma omp parallel num_threads(nthreads)
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int lo = (int)((long long)length * t / nt);
+        int hi = (int)((long long)length * (t + 1) / nt);
+        T sum = 0;
+        for (int i = lo; i < hi; i++)
+            sum += input[i];
+        block_sum[t + 1] = sum;
+#pragma omp barrier
+#pragma omp single
+        {
+            block_sum[0] = 0;
+            for (int b = 0; b < nt; b++)
+                block_sum[b + 1] += block_sum[b];
+        }
+        sum = block_sum[t];
+        for (int i = lo; i < hi; i++)
+        {
+            T val = input[i];
+            input[i] = sum;
+            sum += val;
+        }
+    }
+    free(block_sum);
+}
 
-    old_val = input[0];
-    input[0] = 0;
-    for (int i = 1; i < length; i++)
+void exclusive_scan_char(unsigned char *input, int length)
+{
+    exclusive_scan(input, length);
+}
+
+// exclusive_scan_char for the row pointers of one tile, whatever their width
+template <typename T>
+void exclusive_scan_small(T *input, int length)
+{
+    T sum = 0;
+    for (int i = 0; i < length; i++)
     {
-        new_val = input[i];
-        input[i] = old_val + input[i - 1];
-        old_val = new_val;
+        T val = input[i];
+        input[i] = sum;
+        sum += val;
     }
 }
 
@@ -130,6 +174,9 @@ void quick_sort_key_val_pair(int *key, MAT_VAL_TYPE *val, int length)
     if (length == 0 || length == 1)
         return;
 
+    // middle pivot, the first element makes sorted input quadratic
+    swap_key(&key[0], &key[length / 2]);
+    swap_val(&val[0], &val[length / 2]);
     int small_length = partition_key_val_pair(key, val, length, 0);
     quick_sort_key_val_pair(key, val, small_length);
     quick_sort_key_val_pair(&key[small_length + 1], &val[small_length + 1], length - small_length - 1);
@@ -164,11 +211,195 @@ void quick_sort_key(int *key, int length)
     if (length == 0 || length == 1)
         return;
 
+    swap_key(&key[0], &key[length / 2]);
     int small_length = partition_key(key, length, 0);
     quick_sort_key(key, small_length);
     quick_sort_key(&key[small_length + 1], length - small_length - 1);
 }
 
+// insertion sort key-value pair, for short runs
+template <typename V>
+void insertion_sort_key_val_pair(int *key, V *val, int length)
+{
+    for (int i = 1; i < length; i++)
+    {
+        int k = key[i];
+        V v = val[i];
+        int j = i - 1;
+        for (; j >= 0 && key[j] > k; j--)
+        {
+            key[j + 1] = key[j];
+            val[j + 1] = val[j];
+        }
+        key[j + 1] = k;
+        val[j + 1] = v;
+    }
+}
+
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// LSD radix sort key-value pair, stable, RADIX_BITS of key - min(key) a pass and only as many passes as
+// max(key) - min(key) needs. key_tmp and val_tmp hold length entries. Above PAR_PRIM_MIN pairs each thread
+// counts the digits of one block, the counts are scanned digit by digit across the threads, and each thread
+// scatters its block in order
+template <typename V>
+void radix_sort_key_val_pair(int *key, V *val, int length, int *key_tmp, V *val_tmp)
+{
+    if (length < 2)
+        return;
+    int nthreads = length < PAR_PRIM_MIN || omp_in_parallel() ? 1 : omp_get_max_threads();
+
+    int kmin = key[0], kmax = key[0];
+#pragma omp parallel for num_threads(nthreads) reduction(min : kmin) reduction(max : kmax) if (nthreads > 1)
+    for (int i = 0; i < length; i++)
+    {
+        kmin = key[i] < kmin ? key[i] : kmin;
+        kmax = key[i] > kmax ? key[i] : kmax;
+    }
+    unsigned span = (unsigned)kmax - (unsigned)kmin;
+    int passes = 0;
+    while (passes * RADIX_BITS < 32 && (span >> (passes * RADIX_BITS)) != 0)
+        passes++;
+    if (passes == 0)
+        return;
+
+    int *hist = (int *)malloc(sizeof(int) * RADIX_BUCKETS * nthreads);
+#pragma omp parallel num_threads(nthreads) if (nthreads > 1)
+    {
+        int t = omp_get_thread_num();
+        int nt = omp_get_num_threads();
+        int lo = (int)((long long)length * t / nt);
+        int hi = (int)((long long)length * (t + 1) / nt);
+        int *src_key = key, *dst_key = key_tmp;
+        V *src_val = val, *dst_val = val_tmp;
+        int *count = hist + t * RADIX_BUCKETS;
+        for (int p = 0; p < passes; p++)
+        {
+            int shift = p * RADIX_BITS;
+            memset(count, 0, sizeof(int) * RADIX_BUCKETS);
+            for (int i = lo; i < hi; i++)
+                count[(((unsigned)src_key[i] - (unsigned)kmin) >> shift) & (RADIX_BUCKETS - 1)]++;
+#pragma omp barrier
+#pragma omp single
+            {
+                int sum = 0;
+                for (int d = 0; d < RADIX_BUCKETS; d++)
+                    for (int b = 0; b < nt; b++)
+                    {
+                        int c = hist[b * RADIX_BUCKETS + d];
+                        hist[b * RADIX_BUCKETS + d] = sum;
+                        sum += c;
+                    }
+            }
+            for (int i = lo; i < hi; i++)
+            {
+                int d = (((unsigned)src_key[i] - (unsigned)kmin) >> shift) & (RADIX_BUCKETS - 1);
+                dst_key[count[d]] = src_key[i];
+                dst_val[count[d]++] = src_val[i];
+            }
+            int *kt = src_key;
+            src_key = dst_key;
+            dst_key = kt;
+            V *vt = src_val;
+            src_val = dst_val;
+            dst_val = vt;
+#pragma omp barrier
+        }
+        // an odd number of passes leaves the result in the scratch
+        if (passes & 1)
+        {
+            memcpy(key + lo, key_tmp + lo, sizeof(int) * (hi - lo));
+            memcpy(val + lo, val_tmp + lo, sizeof(V) * (hi - lo));
+        }
+    }
+    free(hist);
+}
+
+// sort key-value pair, insertion below RADIX_SORT_MIN pairs, radix above
+template <typename V>
+void sort_key_val_pair(int *key, V *val, int length, int *key_tmp, V *val_tmp)
+{
+    if (length < RADIX_SORT_MIN)
+        insertion_sort_key_val_pair(key, val, length);
+    else
+        radix_sort_key_val_pair(key, val, length, key_tmp, val_tmp);
+}
+
+// PRIM_BENCH: the serial scan and quick sort against the parallel scan and radix sort on length entries.
+// The scan runs on counts taken from the column indices, the sort on the column indices and values as
+// read and on ascending keys. Prints ms per call and whether the outputs agree
+void prim_bench(const int *ColIdx, const MAT_VAL_TYPE *Val, int length, int reps)
+{
+    struct timeval t1, t2;
+    long long *count = (long long *)malloc(sizeof(long long) * (length + 1));
+    long long *scan_ref = (long long *)malloc(sizeof(long long) * (length + 1));
+    long long *scan_par = (long long *)malloc(sizeof(long long) * (length + 1));
+    for (int i = 0; i < length; i++)
+        count[i] = ColIdx[i] & 15;
+    count[length] = 0;
+    double time_serial = 0, time_par = 0;
+    for (int r = 0; r < reps; r++)
+    {
+        memcpy(scan_ref, count, sizeof(long long) * (length + 1));
+        gettimeofday(&t1, NULL);
+        exclusive_scan_serial(scan_ref, length + 1);
+        gettimeofday(&t2, NULL);
+        time_serial += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+        memcpy(scan_par, count, sizeof(long long) * (length + 1));
+        gettimeofday(&t1, NULL);
+        exclusive_scan(scan_par, length + 1);
+        gettimeofday(&t2, NULL);
+        time_par += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+    }
+    printf("prim scan n=%d serial=%.3f ms parallel=%.3f ms threads=%d %s\n", length + 1, time_serial / reps, time_par / reps,
+           omp_get_max_threads(), memcmp(scan_ref, scan_par, sizeof(long long) * (length + 1)) ? "MISMATCH" : "ok");
+    free(count);
+    free(scan_ref);
+    free(scan_par);
+
+    int *key_in = (int *)malloc(sizeof(int) * length);
+    int *key_ref = (int *)malloc(sizeof(int) * length);
+    int *key_par = (int *)malloc(sizeof(int) * length);
+    int *key_tmp = (int *)malloc(sizeof(int) * length);
+    MAT_VAL_TYPE *val_ref = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * length);
+    MAT_VAL_TYPE *val_par = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * length);
+    MAT_VAL_TYPE *val_tmp = (MAT_VAL_TYPE *)malloc(sizeof(MAT_VAL_TYPE) * length);
+    const char *input[2] = {"as_read", "sorted"};
+    for (int in = 0; in < 2; in++)
+    {
+        for (int i = 0; i < length; i++)
+            key_in[i] = in == 0 ? ColIdx[i] : i;
+        time_serial = 0;
+        time_par = 0;
+        for (int r = 0; r < reps; r++)
+        {
+            memcpy(key_ref, key_in, sizeof(int) * length);
+            memcpy(val_ref, Val, sizeof(MAT_VAL_TYPE) * length);
+            gettimeofday(&t1, NULL);
+            quick_sort_key_val_pair(key_ref, val_ref, length);
+            gettimeofday(&t2, NULL);
+            time_serial += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+            memcpy(key_par, key_in, sizeof(int) * length);
+            memcpy(val_par, Val, sizeof(MAT_VAL_TYPE) * length);
+            gettimeofday(&t1, NULL);
+            radix_sort_key_val_pair(key_par, val_par, length, key_tmp, val_tmp);
+            gettimeofday(&t2, NULL);
+            time_par += (t2.tv_sec - t1.tv_sec) * 1000.0 + (t2.tv_usec - t1.tv_usec) / 1000.0;
+        }
+        // quick sort is not stable, so only the keys have to agree
+        printf("prim sort %s n=%d quick=%.3f ms radix=%.3f ms %s\n", input[in], length, time_serial / reps, time_par / reps,
+               memcmp(key_ref, key_par, sizeof(int) * length) ? "MISMATCH" : "ok");
+    }
+    free(key_in);
+    free(key_ref);
+    free(key_par);
+    free(key_tmp);
+    free(val_ref);
+    free(val_par);
+    free(val_tmp);
+}
+
 void matrix_transposition(const int m,
                           const int n,
                           const MAT_PTR_TYPE nnz,